@@ -0,0 +1,351 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "astfinaliser.hpp"
+#include "astgenerator.hpp"
+#include "astpreparer.hpp"
+#include "astresolver.hpp"
+#include "cppwriterfactory.hpp"
+#include "filenamegenerator.hpp"
+#include "parser.hpp"
+#include "schemagenerator.hpp"
+#include "stage.hpp"
+#include "statistics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <getopt.h>
+#include <sys/stat.h>
+
+namespace
+{
+    static const std::string programname ( "bench_generator" );
+
+    static const struct option longopts [] =
+    {
+        { "help",        no_argument,       NULL, 'h' },
+        { "files",       required_argument, NULL, 'F' },
+        { "messages",    required_argument, NULL, 'm' },
+        { "fields",      required_argument, NULL, 'f' },
+        { "depth",       required_argument, NULL, 'd' },
+        { "inheritance", required_argument, NULL, 'i' },
+        { "nesting",     required_argument, NULL, 'c' },
+        { "externs",     required_argument, NULL, 'e' },
+        { "runs",        required_argument, NULL, 'n' },
+        { "jobs",        required_argument, NULL, 'j' },
+        { "target",      required_argument, NULL, 't' },
+        { "json",        no_argument,       NULL, 'J' },
+        { 0,             0,                 0,    0   }
+    };
+
+    static void usage ( bool error, const char * errstr = 0 )
+    {
+        if ( errstr ) std::cerr << programname << ": " << errstr << std::endl;
+        if ( error ) std::cout << std::endl;
+        std::cout << "Usage: " << programname << " [-hJ] [-F files] [-m messages] [-f fields] [-d depth]" << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " [-i depth] [-c dimensions] [-e files] [-n runs] [-j jobs]" << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " [-t dir]" << std::endl
+                  << "  -h,--help          : print this help message" << std::endl
+                  << "  -F,--files=N       : number of proto files to generate (default 4)" << std::endl
+                  << "  -m,--messages=N    : messages in each file (default 50)" << std::endl
+                  << "  -f,--fields=N      : fields in each message (default 10)" << std::endl
+                  << "  -d,--depth=N       : depth of the namespace holding each file's" << std::endl
+                  << "                       messages (default 3)" << std::endl
+                  << "  -i,--inheritance=N : longest chain of parent messages (default 2)" << std::endl
+                  << "  -c,--nesting=N     : dimensions of each collection field (default 1)" << std::endl
+                  << "  -e,--externs=N     : other files each file refers to through extern" << std::endl
+                  << "                       messages (default 2)" << std::endl
+                  << "  -n,--runs=N        : number of timed runs, after one to warm up" << std::endl
+                  << "                       (default 5)" << std::endl
+                  << "  -j,--jobs=N        : parse and generate with up to N threads" << std::endl
+                  << "  -t,--target=DIR    : directory for the proto and generated files" << std::endl
+                  << "                       (default bench.tmp)" << std::endl
+                  << "  -J,--json          : report the results as JSON" << std::endl;
+        exit ( error ? 1 : 0 );
+    }
+
+    static size_t parseCount ( const char * string, bool positive )
+    {
+        size_t value;
+        std::istringstream buffer ( string );
+        if ( ! ( buffer >> value ) || ! buffer.eof ( ) || ( positive && ! value ) )
+            usage ( true, positive ? "counts must be positive integers" : "counts must be integers" );
+        return value;
+    }
+
+    static void makeDirectory ( const std::string & path )
+    {
+        if ( mkdir ( path.c_str ( ), 0777 ) && errno != EEXIST )
+            throw std::runtime_error ( "Cannot create directory \"" + path + "\"" );
+    }
+
+    // The timings of one stage over every measured run
+    struct stagetimes
+    {
+        stagetimes ( const std::string & name ) : name ( name ), runs ( 0 ), best ( 0.0 ), total ( 0.0 ), allocations ( 0 ) { }
+
+        std::string name;
+        size_t runs;
+        double best,
+               total;
+        unsigned long allocations;
+
+        void add ( const fudgeproto::statistics::record & record )
+        {
+            if ( ! runs++ || record.seconds < best )
+                best = record.seconds;
+            total += record.seconds;
+            allocations += record.allocations;
+        }
+    };
+
+    static void addTimes ( std::vector<stagetimes> & times, const fudgeproto::statistics::record & record )
+    {
+        std::vector<stagetimes>::iterator it ( times.begin ( ) );
+        while ( it != times.end ( ) && it->name != record.name )
+            ++it;
+        if ( it == times.end ( ) )
+            it = times.insert ( it, stagetimes ( record.name ) );
+        it->add ( record );
+    }
+
+    // Runs the same stages as the generator does without --verbose, reporting
+    // them to the current statistics collector
+    static void runPipeline ( const std::vector<std::string> & filenames,
+                              const std::string & target,
+                              size_t jobs )
+    {
+        fudgeproto::statistics & stats ( *fudgeproto::statistics::current ( ) );
+        fudgeproto::arena nodes;
+        fudgeproto::arena::scope nodescope ( nodes );
+
+        fudgeproto::astdumper dumper ( std::cout );
+        fudgeproto::astindex index;
+        fudgeproto::astextrefs extrefs;
+
+        const fudgeproto::statistics::timer parsetimer;
+        fudgeproto::refptr<fudgeproto::namespacedef> root ( fudgeproto::parser::parse ( filenames, jobs ) );
+        fudgeproto::statistics::record parse ( "PARSER STAGE" );
+        parsetimer.stop ( parse );
+        stats.addStage ( parse );
+
+        fudgeproto::cppwriterfactory factory;
+        fudgeproto::filenamegenerator filenamegen ( target, "hpp", "cpp", true );
+        fudgeproto::identifiermutator mutator;
+
+        fudgeproto::Stage * stages [ ] =
+        {
+            new fudgeproto::Stage ( new fudgeproto::astpreparer ( index ), dumper, "PREPARATION STAGE" ),
+            new fudgeproto::Stage ( new fudgeproto::astresolver ( index ), dumper, "INTERNAL TYPE RESOLVER STAGE" ),
+            new fudgeproto::Stage ( new fudgeproto::astfinaliser ( extrefs, index, mutator ), dumper, "FINALISATION STAGE" ),
+            new fudgeproto::Stage ( new fudgeproto::astgenerator ( extrefs, index, factory, filenamegen, jobs ), dumper, "CODE GENERATOR STAGE" )
+        };
+        const size_t numstages ( sizeof ( stages ) / sizeof ( stages [ 0 ] ) );
+        try
+        {
+            for ( size_t index ( 0 ); index < numstages; ++index )
+                stages [ index ]->run ( root );
+        }
+        catch ( ... )
+        {
+            std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+            throw;
+        }
+        std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+    }
+
+    // The figures that a stage's throughput is measured against
+    struct workload
+    {
+        workload ( ) : messages ( 0 ), fields ( 0 ), inputBytes ( 0 ), outputFiles ( 0 ), outputBytes ( 0 ) { }
+
+        size_t messages,
+               fields,
+               inputBytes,
+               outputFiles,
+               outputBytes;
+
+        size_t bytesFor ( const std::string & stage ) const
+        {
+            if ( stage == "PARSER STAGE" ) return inputBytes;
+            if ( stage == "CODE GENERATOR STAGE" ) return outputBytes;
+            return 0;
+        }
+    };
+
+    static void writeText ( std::ostream & output,
+                            const fudgeproto::schemagenerator & schema,
+                            const workload & work,
+                            const std::vector<stagetimes> & times,
+                            size_t runs,
+                            size_t jobs )
+    {
+        const fudgeproto::schemagenerator::shape & shape ( schema.dimensions ( ) );
+        output << "Schema: " << shape.files << " files, " << work.messages << " messages, " << work.fields << " fields, "
+               << work.inputBytes << " bytes (depth " << shape.depth << ", inheritance " << shape.inheritance
+               << ", nesting " << shape.nesting << ", externs " << shape.externs << ")" << std::endl
+               << "Output: " << work.outputFiles << " files, " << work.outputBytes << " bytes" << std::endl
+               << "Runs:   " << runs << " after warming up, " << jobs << ( jobs == 1 ? " job" : " jobs" ) << std::endl
+               << std::endl
+               << "   Best (ms)    Mean (ms)  Allocations   Messages/s     Fields/s      KiB/s  Name" << std::endl;
+        for ( std::vector<stagetimes>::const_iterator it ( times.begin ( ) ); it != times.end ( ); ++it )
+        {
+            const double mean ( it->total / runs );
+            output << std::setprecision ( 3 ) << std::setw ( 12 ) << it->best * 1000.0
+                   << std::setw ( 13 ) << mean * 1000.0
+                   << std::setw ( 13 ) << it->allocations / runs
+                   << std::setprecision ( 0 ) << std::setw ( 13 ) << work.messages / mean
+                   << std::setw ( 13 ) << work.fields / mean;
+            if ( const size_t bytes = work.bytesFor ( it->name ) )
+                output << std::setw ( 11 ) << bytes / mean / 1024.0;
+            else
+                output << std::setw ( 11 ) << "-";
+            output << "  " << it->name << std::endl;
+        }
+    }
+
+    static void writeJson ( std::ostream & output,
+                            const fudgeproto::schemagenerator & schema,
+                            const workload & work,
+                            const std::vector<stagetimes> & times,
+                            size_t runs,
+                            size_t jobs )
+    {
+        const fudgeproto::schemagenerator::shape & shape ( schema.dimensions ( ) );
+        output << std::setprecision ( 6 ) << "{" << std::endl
+               << "  \"shape\": { \"files\": " << shape.files
+               << ", \"messages\": " << shape.messages
+               << ", \"fields\": " << shape.fields
+               << ", \"depth\": " << shape.depth
+               << ", \"inheritance\": " << shape.inheritance
+               << ", \"nesting\": " << shape.nesting
+               << ", \"externs\": " << shape.externs << " }," << std::endl
+               << "  \"workload\": { \"messages\": " << work.messages
+               << ", \"fields\": " << work.fields
+               << ", \"input_bytes\": " << work.inputBytes
+               << ", \"output_files\": " << work.outputFiles
+               << ", \"output_bytes\": " << work.outputBytes << " }," << std::endl
+               << "  \"runs\": " << runs << "," << std::endl
+               << "  \"jobs\": " << jobs << "," << std::endl
+               << "  \"stages\": [";
+        for ( std::vector<stagetimes>::const_iterator it ( times.begin ( ) ); it != times.end ( ); ++it )
+        {
+            const double mean ( it->total / runs );
+            output << ( it == times.begin ( ) ? "" : "," ) << std::endl
+                   << "    { \"name\": \"" << it->name << "\""
+                   << ", \"best_seconds\": " << it->best
+                   << ", \"mean_seconds\": " << mean
+                   << ", \"allocations\": " << it->allocations / runs
+                   << ", \"messages_per_second\": " << work.messages / mean
+                   << ", \"fields_per_second\": " << work.fields / mean;
+            if ( const size_t bytes = work.bytesFor ( it->name ) )
+                output << ", \"bytes_per_second\": " << bytes / mean;
+            output << " }";
+        }
+        output << std::endl << "  ]" << std::endl
+               << "}" << std::endl;
+    }
+}
+
+int main ( int argc, char * argv [ ] )
+{
+    fudgeproto::schemagenerator::shape shape;
+    std::string target ( "bench.tmp" );
+    size_t runs ( 5 ),
+           jobs ( 1 );
+    bool json ( false );
+
+    char option;
+    while ( ( option = getopt_long ( argc, argv, "hJF:m:f:d:i:c:e:n:j:t:", longopts, 0 ) ) >= 0 )
+        switch ( option )
+        {
+            default:    usage ( true );
+            case 'h':   usage ( false );
+
+            case 'F':   shape.files = parseCount ( optarg, true );          break;
+            case 'm':   shape.messages = parseCount ( optarg, true );       break;
+            case 'f':   shape.fields = parseCount ( optarg, false );        break;
+            case 'd':   shape.depth = parseCount ( optarg, true );          break;
+            case 'i':   shape.inheritance = parseCount ( optarg, false );   break;
+            case 'c':   shape.nesting = parseCount ( optarg, false );       break;
+            case 'e':   shape.externs = parseCount ( optarg, false );       break;
+            case 'n':   runs = parseCount ( optarg, true );                 break;
+            case 'j':   jobs = parseCount ( optarg, true );                 break;
+            case 't':   target = optarg;                                    break;
+            case 'J':   json = true;                                        break;
+        }
+    if ( optind != argc )
+        usage ( true, "unexpected arguments" );
+
+    try
+    {
+        // The schema is written once; every run parses it from disk
+        const fudgeproto::schemagenerator schema ( shape );
+        const std::string outputdir ( target + "/out" );
+        makeDirectory ( target );
+        makeDirectory ( outputdir );
+
+        workload work;
+        std::vector<std::string> filenames;
+        work.inputBytes = schema.write ( target, filenames );
+        work.messages = schema.numMessages ( );
+        work.fields = schema.numFields ( );
+
+        // The warm-up run writes the generated files, so every timed run
+        // finds them up to date and does the same amount of work
+        fudgeproto::statistics::enableCounting ( );
+        std::vector<stagetimes> times;
+        for ( size_t run ( 0 ); run <= runs; ++run )
+        {
+            fudgeproto::statistics stats;
+            fudgeproto::statistics::scope statsscope ( stats );
+            const fudgeproto::statistics::timer totaltimer;
+            runPipeline ( filenames, outputdir, jobs );
+            fudgeproto::statistics::record total;
+            totaltimer.stop ( total );
+
+            if ( ! run )
+            {
+                work.outputFiles = stats.files ( ).size ( );
+                for ( std::vector<fudgeproto::statistics::record>::const_iterator it ( stats.files ( ).begin ( ) ); it != stats.files ( ).end ( ); ++it )
+                    work.outputBytes += it->bytes;
+                continue;
+            }
+
+            for ( std::vector<fudgeproto::statistics::record>::const_iterator it ( stats.stages ( ).begin ( ) ); it != stats.stages ( ).end ( ); ++it )
+                addTimes ( times, *it );
+            total.name = "TOTAL";
+            addTimes ( times, total );
+        }
+
+        std::cout << std::fixed;
+        if ( json )
+            writeJson ( std::cout, schema, work, times, runs, jobs );
+        else
+            writeText ( std::cout, schema, work, times, runs, jobs );
+    }
+    catch ( const std::exception & exception )
+    {
+        std::cerr << "FATAL: " << exception.what ( ) << std::endl;
+        return 1;
+    }
+    return 0;
+}
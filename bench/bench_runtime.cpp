@@ -0,0 +1,482 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "bench_arraymessage.hpp"
+#include "bench_collectionmessage.hpp"
+#include "bench_flatmessage.hpp"
+#include "bench_leafmessage.hpp"
+#include "bench_nestedmessage.hpp"
+#include "bench_opaquemessage.hpp"
+#include "config.h"
+#include "statistics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <fudge-cpp/codec.hpp>
+#include <getopt.h>
+
+using namespace bench;
+
+namespace
+{
+    static const std::string programname ( "bench_runtime" );
+
+    static const struct option longopts [] =
+    {
+        { "help",     no_argument,       NULL, 'h' },
+        { "samples",  required_argument, NULL, 'n' },
+        { "batch",    required_argument, NULL, 'b' },
+        { "elements", required_argument, NULL, 'e' },
+        { "label",    required_argument, NULL, 'l' },
+        { "json",     no_argument,       NULL, 'J' },
+        { "output",   required_argument, NULL, 'o' },
+        { 0,          0,                 0,    0   }
+    };
+
+    static void usage ( bool error, const char * errstr = 0 )
+    {
+        if ( errstr ) std::cerr << programname << ": " << errstr << std::endl;
+        if ( error ) std::cout << std::endl;
+        std::cout << "Usage: " << programname << " [-hJ] [-n samples] [-b batch] [-e elements] [-l label]" << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " [-o file]" << std::endl
+                  << "  -h,--help          : print this help message" << std::endl
+                  << "  -n,--samples=N     : number of timed samples of each operation" << std::endl
+                  << "                       (default 200)" << std::endl
+                  << "  -b,--batch=N       : operations in each sample; the percentiles are" << std::endl
+                  << "                       of each sample's mean (default enough to take" << std::endl
+                  << "                       about a millisecond)" << std::endl
+                  << "  -e,--elements=N    : size of the large collections (default 1000)" << std::endl
+                  << "  -l,--label=TEXT    : label the results, such as with the commit" << std::endl
+                  << "                       they were measured at" << std::endl
+                  << "  -J,--json          : report the results as JSON" << std::endl
+                  << "  -o,--output=FILE   : also write the results to FILE as JSON" << std::endl;
+        exit ( error ? 1 : 0 );
+    }
+
+    static size_t parseCount ( const char * string )
+    {
+        size_t value;
+        std::istringstream buffer ( string );
+        if ( ! ( buffer >> value ) || ! buffer.eof ( ) || ! value )
+            usage ( true, "counts must be positive integers" );
+        return value;
+    }
+
+    static std::string quote ( const std::string & string )
+    {
+        std::string result ( "\"" );
+        for ( std::string::const_iterator it ( string.begin ( ) ); it != string.end ( ); ++it )
+        {
+            if ( *it == '"' || *it == '\\' )
+                result += '\\';
+            result += *it;
+        }
+        return result + "\"";
+    }
+
+    // Encodes and decodes one populated message. The source is encoded once
+    // up front, so that decoding always starts from the same bytes.
+    class benchcase
+    {
+        public:
+            benchcase ( const std::string & name ) : m_name ( name ), m_bytes ( 0 ), m_numbytes ( 0 ) { }
+            virtual ~benchcase ( ) { free ( m_bytes ); }
+
+            inline const std::string & name ( ) const { return m_name; }
+            inline fudge_i32 numbytes ( ) const { return m_numbytes; }
+
+            void prepare ( )
+            {
+                encode ( m_bytes, m_numbytes );
+                decodeOnce ( );
+            }
+
+            void encodeOnce ( )
+            {
+                fudge_byte * bytes ( 0 );
+                fudge_i32 numbytes ( 0 );
+                encode ( bytes, numbytes );
+                free ( bytes );
+            }
+
+            void decodeOnce ( )
+            {
+                decode ( fudge::codec ( ).decode ( m_bytes, m_numbytes ).payload ( ) );
+            }
+
+            inline static void destroy ( benchcase * target ) { delete target; }
+
+        protected:
+            virtual void encode ( fudge_byte * & bytes, fudge_i32 & numbytes ) const = 0;
+            virtual void decode ( const fudge::message & source ) const = 0;
+
+        private:
+            std::string m_name;
+            fudge_byte * m_bytes;
+            fudge_i32 m_numbytes;
+
+            // Not implemented - the case owns the encoded bytes
+            benchcase ( const benchcase & source );
+            benchcase & operator= ( const benchcase & source );
+    };
+
+    template<class T>
+    class messagecase : public benchcase
+    {
+        public:
+            messagecase ( const std::string & name, T * source ) : benchcase ( name ), m_source ( source ) { }
+
+        protected:
+            void encode ( fudge_byte * & bytes, fudge_i32 & numbytes ) const
+            {
+                fudge::codec ( ).encode ( fudge::envelope ( 0, 0, 0, m_source->asFudgeMessage ( ) ), bytes, numbytes );
+            }
+
+            void decode ( const fudge::message & source ) const
+            {
+                T target;
+                target.fromFudgeMessage ( source );
+            }
+
+        private:
+            std::auto_ptr<T> m_source;
+    };
+
+    template<class T>
+    benchcase * createCase ( const std::string & name, T * source )
+    {
+        return new messagecase<T> ( name, source );
+    }
+
+    static std::string makeString ( const char * prefix, size_t index )
+    {
+        std::ostringstream buffer;
+        buffer << prefix << index;
+        return buffer.str ( );
+    }
+
+    static FlatMessage * createFlat ( size_t index )
+    {
+        std::auto_ptr<FlatMessage> message ( new FlatMessage );
+        message->setidentifier ( static_cast<fudge_i32> ( index ) );
+        message->settimestamp ( 1325376000000LL + static_cast<fudge_i64> ( index ) );
+        message->setprice ( 100.0 + static_cast<fudge_f64> ( index ) / 8.0 );
+        message->setdescription ( fudge::string ( makeString ( "Flat message ", index ) ) );
+        message->setactive ( fudge::optional<fudge_bool> ( index % 2 ? FUDGE_TRUE : FUDGE_FALSE ) );
+        return message.release ( );
+    }
+
+    static NestedMessage * createNested ( )
+    {
+        std::vector<NestedMessage::Leg *> legs;
+        for ( size_t index ( 0 ); index < 8; ++index )
+        {
+            legs.push_back ( new NestedMessage::Leg );
+            legs.back ( )->setquantity ( static_cast<fudge_i32> ( index * 100 ) );
+            legs.back ( )->setprice ( 99.5 + static_cast<fudge_f64> ( index ) );
+        }
+
+        std::auto_ptr<NestedMessage> message ( new NestedMessage );
+        message->setheader ( createFlat ( 1 ) );
+        message->setprevious ( createFlat ( 0 ) );
+        message->setlegs ( legs );
+        message->setcomment ( fudge::string ( "Eight legs" ) );
+        return message.release ( );
+    }
+
+    static ArrayMessage * createArray ( )
+    {
+        std::vector< std::vector<fudge_f64> > matrix ( 16, std::vector<fudge_f64> ( 16 ) );
+        for ( size_t y ( 0 ); y < matrix.size ( ); ++y )
+            for ( size_t x ( 0 ); x < matrix [ y ].size ( ); ++x )
+                matrix [ y ] [ x ] = static_cast<fudge_f64> ( y ) / static_cast<fudge_f64> ( x + 1 );
+
+        std::vector<fudge::string> tags;
+        for ( size_t index ( 0 ); index < 32; ++index )
+            tags.push_back ( fudge::string ( makeString ( "Tag ", index ) ) );
+
+        std::auto_ptr<ArrayMessage> message ( new ArrayMessage );
+        message->setmatrix ( matrix );
+        message->settags ( tags );
+        message->setcorners ( std::vector<fudge_i32> ( 4, 1 ) );
+        return message.release ( );
+    }
+
+    static LeafMessage * createLeaf ( )
+    {
+        std::auto_ptr<LeafMessage> message ( new LeafMessage );
+        message->setbaseId ( 1 );
+        message->setbaseName ( fudge::string ( "Base" ) );
+        message->setfirstValue ( 2 );
+        message->setfirstRatio ( fudge::optional<fudge_f64> ( 0.5 ) );
+        message->setsecondValue ( 3 );
+        message->setsecondRatio ( fudge::optional<fudge_f64> ( 0.25 ) );
+        message->setleafName ( fudge::string ( "Leaf" ) );
+        message->setleafFlag ( fudge::optional<fudge_bool> ( FUDGE_TRUE ) );
+        return message.release ( );
+    }
+
+    static OpaqueMessage * createOpaque ( )
+    {
+        fudge::message payload;
+        for ( size_t index ( 0 ); index < 8; ++index )
+            payload.addField ( static_cast<fudge_i32> ( index ), fudge::string ( makeString ( "field", index ) ) );
+        std::vector<fudge::message> attachments ( 4, payload );
+
+        std::auto_ptr<OpaqueMessage> message ( new OpaqueMessage );
+        message->settopic ( fudge::string ( "Opaque" ) );
+        message->setpayload ( payload );
+        message->setattachments ( attachments );
+        return message.release ( );
+    }
+
+    static CollectionMessage * createCollection ( size_t elements )
+    {
+        std::vector<FlatMessage *> items;
+        std::vector<fudge_f64> values;
+        std::vector<fudge::string> labels;
+        for ( size_t index ( 0 ); index < elements; ++index )
+        {
+            items.push_back ( createFlat ( index ) );
+            values.push_back ( static_cast<fudge_f64> ( index ) * 1.5 );
+            labels.push_back ( fudge::string ( makeString ( "Label ", index ) ) );
+        }
+
+        std::auto_ptr<CollectionMessage> message ( new CollectionMessage );
+        message->setitems ( items );
+        message->setvalues ( values );
+        message->setlabels ( labels );
+        return message.release ( );
+    }
+
+    // The figures for one operation on one message
+    struct opresult
+    {
+        // Each sample times a whole batch of calls, so the spread is that of
+        // the mean time per call in a batch rather than of single calls
+        size_t batch;
+        double mean,                // Seconds per operation, over every sample
+               batchP50,
+               batchP90,
+               batchP99,
+               batchMax;
+        double allocations;         // Per operation
+    };
+
+    struct caseresult
+    {
+        std::string name;
+        fudge_i32 bytes;
+        opresult encode,
+                 decode;
+    };
+
+    static double percentile ( const std::vector<double> & sorted, double fraction )
+    {
+        return sorted [ std::min ( sorted.size ( ) - 1, static_cast<size_t> ( fraction * sorted.size ( ) ) ) ];
+    }
+
+    // Times the operation in samples of a batch of calls each, after one
+    // batch to warm up. Without a batch size the warm up runs for the sample
+    // time, and the number of calls it made becomes the batch size.
+    // Allocations are those made through operator new.
+    static opresult measure ( benchcase & target, void ( benchcase::*operation ) ( ), size_t samples, size_t batch )
+    {
+        static const double sampleTime ( 0.001 );
+
+        const double warmup ( fudgeproto::statistics::now ( ) );
+        size_t calls ( 0 );
+        do
+            ( target.*operation ) ( );
+        while ( ++calls < batch || ( ! batch && fudgeproto::statistics::now ( ) - warmup < sampleTime ) );
+        if ( ! batch )
+            batch = calls;
+
+        std::vector<double> batchMeans ( samples );
+        const unsigned long allocations ( fudgeproto::statistics::allocations ( ) );
+        double total ( 0.0 );
+        for ( size_t sample ( 0 ); sample < samples; ++sample )
+        {
+            const double start ( fudgeproto::statistics::now ( ) );
+            for ( size_t call ( 0 ); call < batch; ++call )
+                ( target.*operation ) ( );
+            const double elapsed ( fudgeproto::statistics::now ( ) - start );
+            batchMeans [ sample ] = elapsed / batch;
+            total += elapsed;
+        }
+
+        opresult result;
+        result.batch = batch;
+        result.allocations = static_cast<double> ( fudgeproto::statistics::allocations ( ) - allocations ) / ( samples * batch );
+        result.mean = total / ( samples * batch );
+        std::sort ( batchMeans.begin ( ), batchMeans.end ( ) );
+        result.batchP50 = percentile ( batchMeans, 0.5 );
+        result.batchP90 = percentile ( batchMeans, 0.9 );
+        result.batchP99 = percentile ( batchMeans, 0.99 );
+        result.batchMax = batchMeans.back ( );
+        return result;
+    }
+
+    static void writeTextRow ( std::ostream & output, const caseresult & result, const opresult & op, const char * name )
+    {
+        output << std::setprecision ( 0 ) << std::setw ( 10 ) << 1.0 / op.mean
+               << std::setprecision ( 2 ) << std::setw ( 10 ) << result.bytes / op.mean / ( 1024.0 * 1024.0 )
+               << std::setprecision ( 3 ) << std::setw ( 16 ) << op.batchP50 * 1e6
+               << std::setw ( 16 ) << op.batchP90 * 1e6
+               << std::setw ( 16 ) << op.batchP99 * 1e6
+               << std::setprecision ( 1 ) << std::setw ( 11 ) << op.allocations
+               << "  " << result.name << " " << name << std::endl;
+    }
+
+    static void writeText ( std::ostream & output, const std::vector<caseresult> & results )
+    {
+        output << "     Bytes  Name" << std::endl;
+        for ( std::vector<caseresult>::const_iterator it ( results.begin ( ) ); it != results.end ( ); ++it )
+            output << std::setw ( 10 ) << it->bytes << "  " << it->name << std::endl;
+
+        output << std::endl
+               << "     Ops/s     MiB/s  Batch p50 (us)  Batch p90 (us)  Batch p99 (us)  Allocs/op  Name" << std::endl;
+        for ( std::vector<caseresult>::const_iterator it ( results.begin ( ) ); it != results.end ( ); ++it )
+        {
+            writeTextRow ( output, *it, it->encode, "encode" );
+            writeTextRow ( output, *it, it->decode, "decode" );
+        }
+    }
+
+    static void writeJsonOp ( std::ostream & output, const caseresult & result, const opresult & op )
+    {
+        output << "{ \"batch\": " << op.batch
+               << ", \"ops_per_second\": " << 1.0 / op.mean
+               << ", \"bytes_per_second\": " << result.bytes / op.mean
+               << ", \"mean_seconds\": " << op.mean
+               << ", \"p50_batch_mean_seconds\": " << op.batchP50
+               << ", \"p90_batch_mean_seconds\": " << op.batchP90
+               << ", \"p99_batch_mean_seconds\": " << op.batchP99
+               << ", \"max_batch_mean_seconds\": " << op.batchMax
+               << ", \"allocations\": " << op.allocations << " }";
+    }
+
+    static void writeJson ( std::ostream & output,
+                            const std::vector<caseresult> & results,
+                            const std::string & label,
+                            size_t samples,
+                            size_t elements )
+    {
+        output << std::setprecision ( 9 ) << "{" << std::endl
+               << "  \"label\": " << quote ( label ) << "," << std::endl
+               << "  \"version\": " << quote ( PACKAGE_VERSION ) << "," << std::endl
+               << "  \"samples\": " << samples << "," << std::endl
+               << "  \"elements\": " << elements << "," << std::endl
+               << "  \"cases\": [";
+        for ( std::vector<caseresult>::const_iterator it ( results.begin ( ) ); it != results.end ( ); ++it )
+        {
+            output << ( it == results.begin ( ) ? "" : "," ) << std::endl
+                   << "    { \"name\": " << quote ( it->name ) << ", \"bytes\": " << it->bytes << "," << std::endl
+                   << "      \"encode\": ";
+            writeJsonOp ( output, *it, it->encode );
+            output << "," << std::endl
+                   << "      \"decode\": ";
+            writeJsonOp ( output, *it, it->decode );
+            output << " }";
+        }
+        output << std::endl << "  ]" << std::endl
+               << "}" << std::endl;
+    }
+}
+
+int main ( int argc, char * argv [ ] )
+{
+    size_t samples ( 200 ),
+           batch ( 0 ),
+           elements ( 1000 );
+    std::string label,
+                output;
+    bool json ( false );
+
+    char option;
+    while ( ( option = getopt_long ( argc, argv, "hJn:b:e:l:o:", longopts, 0 ) ) >= 0 )
+        switch ( option )
+        {
+            default:    usage ( true );
+            case 'h':   usage ( false );
+
+            case 'n':   samples = parseCount ( optarg );    break;
+            case 'b':   batch = parseCount ( optarg );      break;
+            case 'e':   elements = parseCount ( optarg );   break;
+            case 'l':   label = optarg;                     break;
+            case 'J':   json = true;                        break;
+            case 'o':   output = optarg;                    break;
+        }
+    if ( optind != argc )
+        usage ( true, "unexpected arguments" );
+
+    std::vector<benchcase *> cases;
+    std::vector<caseresult> results;
+    try
+    {
+        cases.push_back ( createCase ( "flat", createFlat ( 1 ) ) );
+        cases.push_back ( createCase ( "nested", createNested ( ) ) );
+        cases.push_back ( createCase ( "array", createArray ( ) ) );
+        cases.push_back ( createCase ( "inheritance", createLeaf ( ) ) );
+        cases.push_back ( createCase ( "opaque", createOpaque ( ) ) );
+        cases.push_back ( createCase ( "collection", createCollection ( elements ) ) );
+
+        fudgeproto::statistics::enableCounting ( );
+        for ( std::vector<benchcase *>::const_iterator it ( cases.begin ( ) ); it != cases.end ( ); ++it )
+        {
+            caseresult result;
+            ( *it )->prepare ( );
+            result.name = ( *it )->name ( );
+            result.bytes = ( *it )->numbytes ( );
+            result.encode = measure ( **it, &benchcase::encodeOnce, samples, batch );
+            result.decode = measure ( **it, &benchcase::decodeOnce, samples, batch );
+            results.push_back ( result );
+        }
+    }
+    catch ( const std::exception & exception )
+    {
+        std::for_each ( cases.begin ( ), cases.end ( ), benchcase::destroy );
+        std::cerr << "FATAL: " << exception.what ( ) << std::endl;
+        return 1;
+    }
+    std::for_each ( cases.begin ( ), cases.end ( ), benchcase::destroy );
+
+    std::cout << std::fixed;
+    if ( json )
+        writeJson ( std::cout, results, label, samples, elements );
+    else
+        writeText ( std::cout, results );
+
+    if ( ! output.empty ( ) )
+    {
+        std::ofstream file ( output.c_str ( ) );
+        file << std::fixed;
+        writeJson ( file, results, label, samples, elements );
+        if ( ! file )
+        {
+            std::cerr << "FATAL: Cannot write results to \"" << output << "\"" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "schemagenerator.hpp"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace fudgeproto;
+
+namespace
+{
+    // Byte is left out as its collections are treated as opaque data
+    const char * const fieldTypes [ ] = { "int", "string", "double", "boolean", "long", "float", "short" };
+    const size_t numFieldTypes ( sizeof ( fieldTypes ) / sizeof ( fieldTypes [ 0 ] ) );
+
+    std::string indent ( size_t level )
+    {
+        return std::string ( level * 4, ' ' );
+    }
+}
+
+schemagenerator::shape::shape ( )
+    : files ( 4 )
+    , messages ( 50 )
+    , fields ( 10 )
+    , depth ( 3 )
+    , inheritance ( 2 )
+    , nesting ( 1 )
+    , externs ( 2 )
+{
+}
+
+schemagenerator::schemagenerator ( const shape & shape )
+    : m_shape ( shape )
+{
+    if ( ! m_shape.files || ! m_shape.messages || ! m_shape.depth )
+        throw std::invalid_argument ( "Schema must have at least one file, message and namespace" );
+}
+
+size_t schemagenerator::numFields ( ) const
+{
+    return numMessages ( ) * ( m_shape.fields + ( numExterns ( ) ? 1 : 0 ) );
+}
+
+std::string schemagenerator::content ( size_t file ) const
+{
+    std::ostringstream output;
+    output << "// Synthetic schema " << file + 1 << " of " << m_shape.files << ", generated for benchmarking" << std::endl
+           << std::endl;
+
+    // The messages are held in nested namespace blocks, one per level
+    const std::string name ( namespaceName ( file ) );
+    size_t level ( 0 ), start ( 0 );
+    for ( size_t end ( 0 ); end != std::string::npos; start = end + 1, ++level )
+    {
+        end = name.find ( '.', start );
+        output << indent ( level ) << "namespace " << name.substr ( start, end == std::string::npos ? end : end - start ) << std::endl
+               << indent ( level ) << "{" << std::endl;
+    }
+
+    const size_t externs ( numExterns ( ) );
+    for ( size_t message ( 0 ); message < m_shape.messages; ++message )
+    {
+        if ( message )
+            output << std::endl;
+        output << indent ( level ) << "message " << messageName ( message );
+        if ( m_shape.inheritance && message % ( m_shape.inheritance + 1 ) )
+            output << " extends " << messageName ( message - 1 );
+        output << std::endl
+               << indent ( level ) << "{" << std::endl;
+
+        for ( size_t field ( 0 ); field < m_shape.fields; ++field )
+            output << indent ( level + 1 ) << ( field % 2 ? "optional " : "required " ) << fieldType ( message, field )
+                   << " m" << message << "f" << field << ";" << std::endl;
+        if ( externs )
+            output << indent ( level + 1 ) << "optional "
+                   << namespaceName ( externFile ( file, message % externs ) ) << "." << messageName ( m_shape.messages - 1 )
+                   << " m" << message << "x;" << std::endl;
+
+        output << indent ( level ) << "}" << std::endl;
+    }
+
+    while ( level-- )
+        output << indent ( level ) << "}" << std::endl;
+
+    // Messages from the other files are only declared, as they would be if
+    // each file was generated on its own
+    for ( size_t index ( 0 ); index < externs; ++index )
+        output << std::endl
+               << "namespace " << namespaceName ( externFile ( file, index ) ) << std::endl
+               << "{" << std::endl
+               << indent ( 1 ) << "extern message " << messageName ( m_shape.messages - 1 ) << ";" << std::endl
+               << "}" << std::endl;
+
+    return output.str ( );
+}
+
+size_t schemagenerator::write ( const std::string & directory, std::vector<std::string> & filenames ) const
+{
+    size_t bytes ( 0 );
+    for ( size_t file ( 0 ); file < m_shape.files; ++file )
+    {
+        std::ostringstream filename;
+        filename << directory << "/schema" << file << ".proto";
+
+        const std::string text ( content ( file ) );
+        std::ofstream output;
+        output.exceptions ( std::ios::failbit | std::ios::badbit );
+        output.open ( filename.str ( ).c_str ( ) );
+        output << text;
+
+        filenames.push_back ( filename.str ( ) );
+        bytes += text.size ( );
+    }
+    return bytes;
+}
+
+std::string schemagenerator::namespaceName ( size_t file ) const
+{
+    std::ostringstream name;
+    for ( size_t level ( 1 ); level < m_shape.depth; ++level )
+        name << "level" << level << ".";
+    name << "file" << file;
+    return name.str ( );
+}
+
+std::string schemagenerator::fieldType ( size_t message, size_t field ) const
+{
+    // Every fifth field refers to the message before in the same chain, so
+    // that the chains only depend on each other through the extern messages.
+    // Every third field is a collection.
+    const bool chained ( message % ( m_shape.inheritance + 1 ) );
+    std::string type ( chained && field % 5 == 4 ? messageName ( message - 1 ) : fieldTypes [ field % numFieldTypes ] );
+    if ( field % 3 == 2 )
+        for ( size_t dimension ( 0 ); dimension < m_shape.nesting; ++dimension )
+            type += "[]";
+    return type;
+}
+
+size_t schemagenerator::externFile ( size_t file, size_t index ) const
+{
+    return ( file + index + 1 ) % m_shape.files;
+}
+
+size_t schemagenerator::numExterns ( ) const
+{
+    return std::min ( m_shape.externs, m_shape.files - 1 );
+}
+
+std::string schemagenerator::messageName ( size_t message )
+{
+    std::ostringstream name;
+    name << "Message" << message;
+    return name.str ( );
+}
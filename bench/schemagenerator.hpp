@@ -0,0 +1,72 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_SCHEMAGENERATOR
+#define INC_FUDGEPROTO_SCHEMAGENERATOR
+
+#include <string>
+#include <vector>
+
+namespace fudgeproto {
+
+// Writes synthetic proto files of a configurable size and shape, for
+// measuring how the generator scales. Each file holds its messages in its own
+// nested namespace; messages extend and refer to the one before in chains,
+// and refer to extern messages defined by the files that follow.
+class schemagenerator
+{
+    public:
+        struct shape
+        {
+            shape ( );
+
+            size_t files,
+                   messages,        // Per file
+                   fields,          // Per message, not counting extern references
+                   depth,           // Of the namespace holding each file's messages
+                   inheritance,     // Longest chain of parents
+                   nesting,         // Dimensions of each collection field
+                   externs;         // Other files referred to by each file
+        };
+
+        schemagenerator ( const shape & shape );
+
+        inline const shape & dimensions ( ) const { return m_shape; }
+
+        inline size_t numMessages ( ) const { return m_shape.files * m_shape.messages; }
+        size_t numFields ( ) const;
+
+        std::string content ( size_t file ) const;
+
+        // Writes every file to the directory, which must exist, returning
+        // their names and the total number of bytes written
+        size_t write ( const std::string & directory, std::vector<std::string> & filenames ) const;
+
+    private:
+        shape m_shape;
+
+        std::string namespaceName ( size_t file ) const;
+        std::string fieldType ( size_t message, size_t field ) const;
+        size_t externFile ( size_t file, size_t index ) const;
+        size_t numExterns ( ) const;
+
+        static std::string messageName ( size_t message );
+};
+
+}
+
+#endif
@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "statistics.hpp"
+#include <cstdlib>
+#include <new>
+
+// Replacing the global allocator lets --stats count every allocation. It's
+// kept out of the programs' other sources so the compiler can't see both the
+// replacement and the new expressions it serves.
+void * operator new ( size_t size )
+{
+    fudgeproto::statistics::countAllocation ( );
+    for ( ;; )
+    {
+        if ( void * pointer = std::malloc ( size ? size : 1 ) )
+            return pointer;
+
+        std::new_handler handler ( std::set_new_handler ( 0 ) );
+        std::set_new_handler ( handler );
+        if ( ! handler )
+            throw std::bad_alloc ( );
+        handler ( );
+    }
+}
+
+void operator delete ( void * pointer ) throw ( )
+{
+    std::free ( pointer );
+}
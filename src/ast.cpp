@@ -16,6 +16,7 @@
 
 #include "ast.hpp"
 #include <cstring>
+#include <memory>
 #include <sstream>
 #include <typeinfo>
 
@@ -23,11 +24,13 @@ using namespace fudgeproto;
 
 identifier::identifier ( )
 {
+    update ( );
 }
 
 identifier::identifier ( const std::string & first )
 {
-    m_elements.push_back ( first );
+    m_elements.push_back ( symboltable::intern ( first ) );
+    update ( );
 }
 
 identifier::~identifier ( )
@@ -38,12 +41,15 @@ identifier * identifier::clone ( ) const
 {
     identifier * result ( new identifier );
     result->m_elements = m_elements;
+    result->m_dotted = m_dotted;
+    result->m_scoped = m_scoped;
     return result;
 }
 
 void identifier::append ( const std::string & element )
 {
-    m_elements.push_back ( element );
+    m_elements.push_back ( symboltable::intern ( element ) );
+    update ( );
 }
 
 void identifier::extend ( const identifier & source )
@@ -51,11 +57,13 @@ void identifier::extend ( const identifier & source )
     std::copy ( source.m_elements.begin ( ),
                 source.m_elements.end ( ),
                 std::back_inserter ( m_elements ) );
+    update ( );
 }
 
 void identifier::prepend ( const std::string & element )
 {
-    m_elements.push_front ( element );
+    m_elements.push_front ( symboltable::intern ( element ) );
+    update ( );
 }
 
 void identifier::prepend ( const identifier & source )
@@ -63,6 +71,7 @@ void identifier::prepend ( const identifier & source )
     std::copy ( source.m_elements.rbegin ( ),
                 source.m_elements.rend ( ),
                 std::front_inserter ( m_elements ) );
+    update ( );
 }
 
 void identifier::pop ( )
@@ -70,36 +79,46 @@ void identifier::pop ( )
     if ( m_elements.empty ( ) )
         throw std::runtime_error ( "Cannot pop from empty identifier" );
     m_elements.pop_back ( );
+    update ( );
 }
 
 void identifier::clear ( )
 {
     m_elements.clear ( );
+    update ( );
 }
 
 std::string identifier::asString ( const std::string & separator ) const
 {
-    std::ostringstream text;
-    for ( size_t index ( 0 ); index < m_elements.size ( ); ++index )
-    {
-        if ( index ) text << separator;
-        text << m_elements [ index ];
-
-    }
-    return text.str ( );
+    if ( separator == "." )
+        return *m_dotted;
+    else if ( separator == "::" )
+        return m_scoped;
+    else
+        return join ( separator );
 }
 
 bool identifier::equals ( const identifier & id ) const
 {
-    if ( size ( ) == id.size ( ) )
+    // Elements are interned, so only their addresses need comparing
+    return m_dotted == id.m_dotted && m_elements == id.m_elements;
+}
+
+void identifier::update ( )
+{
+    m_dotted = symboltable::intern ( join ( "." ) );
+    m_scoped = join ( "::" );
+}
+
+std::string identifier::join ( const std::string & separator ) const
+{
+    std::string text;
+    for ( size_t index ( 0 ); index < m_elements.size ( ); ++index )
     {
-        for ( size_t index ( 0 ); index < size ( ); ++index )
-            if ( m_elements [ index ] != id.at ( index ) )
-                return false;
-        return true;
+        if ( index ) text += separator;
+        text += *m_elements [ index ];
     }
-    else
-        return false;
+    return text;
 }
 
 identifier * identifier::createAndConsume ( char * source )
@@ -159,6 +178,8 @@ identifier * identifier::createFromString ( const std::string & source,
     return id;
 }
 
+const std::string definition::s_nullId ( "NULL" );
+
 definition::definition ( identifier * id )
     : m_id ( id )
 {
@@ -190,11 +211,17 @@ void definition::resetIdentifier ( identifier * id )
     refcounted::dec ( old );
 }
 
+identifier * definition::cloneId ( ) const
+{
+    return m_id ? m_id->clone ( ) : 0;
+}
+
 definition * definition::setIdentifierAndConsume ( definition * target, char * source )
 {
     if ( ! target ) throw std::runtime_error ( "Cannot set the identifier (char) of a NULL definition" );
     if ( ! source ) throw std::runtime_error ( "Cannot set a definition's identifier with a NULL character array" );
-    target->setIdentifier ( identifier::createAndConsume ( source ) );
+    refptr<identifier> id ( identifier::createAndConsume ( source ) );
+    target->setIdentifier ( id.get ( ) );
     return target;
 }
 
@@ -231,7 +258,6 @@ fieldtype::fieldtype ( const fieldtype & source )
     , m_definition ( source.m_definition )
 {
     refcounted::inc ( m_id );
-    refcounted::inc ( m_definition );
 }
 
 fieldtype & fieldtype::operator= ( const fieldtype & source )
@@ -241,9 +267,7 @@ fieldtype & fieldtype::operator= ( const fieldtype & source )
         const identifier * oldId ( m_id );
         refcounted::inc ( ( m_id = source.m_id ) );
         refcounted::dec ( oldId );
-        const definition * oldDef ( m_definition );
-        refcounted::inc ( ( m_definition = source.m_definition ) );
-        refcounted::dec ( oldDef );
+        m_definition = source.m_definition;
         m_type = source.m_type;
     }
     return *this;
@@ -252,7 +276,6 @@ fieldtype & fieldtype::operator= ( const fieldtype & source )
 fieldtype::~fieldtype ( )
 {
     refcounted::dec ( m_id );
-    refcounted::dec ( m_definition );
 }
 
 bool fieldtype::isComplex ( ) const
@@ -305,7 +328,13 @@ void fieldtype::setDefinition ( const definition * def )
     if ( m_type != FUDGEPROTO_TYPE_USER ) throw std::invalid_argument ( "Cannot set definition for non-user type fieldtype" );
     if ( ! def )                          throw std::invalid_argument ( "Cannot set fieldtype definition with NULL" );
     if ( m_definition )                   throw std::invalid_argument ( "Cannot set fieldtype definition, already set" );
-    refcounted::inc ( ( m_definition = def ) );
+    m_definition = def;
+}
+
+fieldtype * fieldtype::createAndConsume ( identifier * id )
+{
+    refptr<identifier> owner ( id );
+    return new fieldtype ( id );
 }
 
 fieldconstraint::fieldconstraint ( int bound )
@@ -437,6 +466,14 @@ enumdef::enumdef ( identifier * id )
 {
 }
 
+enumdef * enumdef::clone ( ) const
+{
+    refptr<identifier> id ( cloneId ( ) );
+    enumdef * copy ( new enumdef ( id.get ( ) ) );
+    copy->m_pairs = m_pairs;
+    return copy;
+}
+
 void enumdef::append ( const std::string & key )
 {
     append ( key, m_pairs.empty ( ) ? 0 : m_pairs.back ( ).second + 1 );
@@ -447,6 +484,13 @@ void enumdef::append ( const std::string & key, int32_t value )
     m_pairs.push_back ( std::make_pair ( key, value ) );
 }
 
+enumdef * enumdef::createAndConsume ( char * name )
+{
+    if ( ! name ) throw std::runtime_error ( "Cannot create enum with NULL name" );
+    refptr<identifier> id ( identifier::createAndConsume ( name ) );
+    return new enumdef ( id.get ( ) );
+}
+
 enumdef * enumdef::appendAndConsume ( enumdef * enumeration, char * key, int32_t value, bool hasValue )
 {
     if ( ! enumeration ) throw std::runtime_error ( "Cannot append to a NULL enumdef" );
@@ -464,13 +508,15 @@ fielddef::fielddef ( identifier * id,
                      const fieldtype & type,
                      fudgeproto_modifier modifier,
                      const std::vector<int> & constraints,
-                     literalvalue * defvalue )
+                     literalvalue * defvalue,
+                     fudgeproto_option options )
     : definition ( id )
     , m_type ( type )
     , m_modifier ( modifier )
     , m_constraints ( constraints )
     , m_ordinal ( 0 )
     , m_defvalue ( defvalue )
+    , m_options ( options )
 {
     refcounted::inc ( m_defvalue );
 }
@@ -481,6 +527,17 @@ fielddef::~fielddef ( )
     refcounted::dec ( m_defvalue );
 }
 
+fielddef * fielddef::clone ( ) const
+{
+    refptr<identifier> id ( cloneId ( ) );
+    refptr<identifier> typeId ( m_type.type ( ) == FUDGEPROTO_TYPE_USER ? m_type.name ( ).clone ( ) : 0 );
+    const fieldtype type ( typeId ? fieldtype ( typeId.get ( ) ) : fieldtype ( m_type.type ( ) ) );
+    fielddef * copy ( new fielddef ( id.get ( ), type, m_modifier, m_constraints, m_defvalue, m_options ) );
+    if ( m_ordinal )
+        copy->setOrdinal ( *m_ordinal );
+    return copy;
+}
+
 void fielddef::setOrdinal ( int ordinal )
 {
     if ( m_ordinal ) throw std::runtime_error ( "Attempted to set ordinal for \"" + idString ( ) + "\" twice" );
@@ -492,31 +549,37 @@ fielddef * fielddef::createAndConsume ( char * name,
                                         int modifier,
                                         fieldconstraint * constraints,
                                         int ordinal,
-                                        literalvalue * defvalue )
+                                        literalvalue * defvalue,
+                                        int options )
 {
     static const std::vector<int> emptyConstraints;
 
+    // The arguments are consumed even if the field is rejected
+    std::auto_ptr<fieldtype> typeOwner ( type );
+    std::auto_ptr<fieldconstraint> constraintsOwner ( constraints );
+    refptr<literalvalue> defvalueOwner ( defvalue );
+
     if ( ! name ) throw std::runtime_error ( "Cannot create field with NULL name" );
+    refptr<identifier> id ( identifier::createAndConsume ( name ) );
     if ( ! type ) throw std::runtime_error ( "Cannot create field with NULL type" );
 
     if ( defvalue && ! defvalue->isCompatibleType ( type->type ( ) ) )
     {
         std::ostringstream buffer;
-        buffer << "Default value for field \"" << name << "\" not compatible with field type";
+        buffer << "Default value for field \"" << id->at ( 0 ) << "\" not compatible with field type";
         throw std::runtime_error ( buffer.str ( ) );
     }
 
-    fielddef * field ( new fielddef ( identifier::createAndConsume ( name ),
-                                      *type,
-                                      cleanModifier ( modifier ),
-                                      constraints ? constraints->bounds ( ) : emptyConstraints,
-                                      defvalue ) );
+    const fudgeproto_option cleanOptions ( checkOptions ( id->at ( 0 ).c_str ( ), *type, constraints, ordinal, options ) );
+    refptr<fielddef> field ( new fielddef ( id.get ( ),
+                                            *type,
+                                            cleanModifier ( modifier ),
+                                            constraints ? constraints->bounds ( ) : emptyConstraints,
+                                            defvalue,
+                                            cleanOptions ) );
     if ( ordinal != FUDGEPROTO_ORDINAL_NONE )
         field->setOrdinal ( ordinal );
-    delete type;
-    delete constraints;
-    refcounted::dec ( defvalue );
-    return field;
+    return field.release ( );
 }
 
 fudgeproto_modifier fielddef::cleanModifier ( int modifier )
@@ -534,6 +597,52 @@ fudgeproto_modifier fielddef::cleanModifier ( int modifier )
     return static_cast<fudgeproto_modifier> ( modifier );
 }
 
+int fielddef::optionFromStringAndConsume ( char * name )
+{
+    if ( ! name ) throw std::runtime_error ( "Cannot parse NULL field option" );
+
+    const std::string option ( name );
+    delete [] name;
+
+    if ( option == "inline" ) return FUDGEPROTO_OPTION_INLINE;
+    if ( option == "lazy" )   return FUDGEPROTO_OPTION_LAZY;
+    if ( option == "packed" ) return FUDGEPROTO_OPTION_PACKED;
+    if ( option == "pooled" ) return FUDGEPROTO_OPTION_POOLED;
+    if ( option == "flat" )   return FUDGEPROTO_OPTION_FLAT;
+    throw std::runtime_error ( "Unknown field option \"" + option + "\"" );
+}
+
+fudgeproto_option fielddef::checkOptions ( const char * name,
+                                           const fieldtype & type,
+                                           const fieldconstraint * constraints,
+                                           int ordinal,
+                                           int options )
+{
+    const std::string field ( name );
+    const bool builtin ( type.type ( ) != FUDGEPROTO_TYPE_USER && type.type ( ) != FUDGEPROTO_TYPE_MESSAGE );
+
+    // Inline setters are only generated for plain assignments
+    if ( ( options & FUDGEPROTO_OPTION_INLINE ) && ( constraints || ! builtin ) )
+        throw std::runtime_error ( "Field option \"inline\" for field \"" + field + "\" requires a single value of a built-in type" );
+
+    // Packed fields are written without their name so need something else to find them by
+    if ( ( options & FUDGEPROTO_OPTION_PACKED ) && ordinal == FUDGEPROTO_ORDINAL_NONE )
+        throw std::runtime_error ( "Field option \"packed\" for field \"" + field + "\" requires an ordinal" );
+
+    // Flat collections are written as a single native array, so every row below the
+    // outermost must have a fixed size
+    if ( options & FUDGEPROTO_OPTION_FLAT )
+    {
+        if ( ! constraints || constraints->bounds ( ).size ( ) < 2 || ! ( type.isInteger ( ) || type.isFloating ( ) ) )
+            throw std::runtime_error ( "Field option \"flat\" for field \"" + field + "\" requires a multi-dimensional numeric collection" );
+        for ( size_t index ( 0 ); index + 1 < constraints->bounds ( ).size ( ); ++index )
+            if ( constraints->bounds ( ) [ index ] == FUDGEPROTO_CONSTRAINT_UNBOUNDED )
+                throw std::runtime_error ( "Field option \"flat\" for field \"" + field + "\" requires fixed inner dimensions" );
+    }
+
+    return static_cast<fudgeproto_option> ( options );
+}
+
 messagedef::messagedef ( )
     : definition ( 0 )
     , m_extern ( false )
@@ -558,6 +667,24 @@ messagedef::~messagedef ( )
     std::for_each ( m_parents.begin ( ),  m_parents.end ( ),  refcounted::dec );
 }
 
+messagedef * messagedef::clone ( ) const
+{
+    refptr<identifier> id ( cloneId ( ) );
+    refptr<messagedef> copy ( new messagedef ( id.get ( ), m_extern ) );
+    copy->m_sourceFile = m_sourceFile;
+    for ( std::vector<const identifier *>::const_iterator it ( m_parents.begin ( ) ); it != m_parents.end ( ); ++it )
+        copy->m_parents.push_back ( ( *it )->clone ( ) );
+    copy->m_parentDefs.resize ( m_parents.size ( ), 0 );
+
+    for ( std::list<enumdef *>::const_iterator it ( m_enums.begin ( ) ); it != m_enums.end ( ); ++it )
+        copy->m_enums.push_back ( ( *it )->clone ( ) );
+    for ( std::list<fielddef *>::const_iterator it ( m_fields.begin ( ) ); it != m_fields.end ( ); ++it )
+        copy->m_fields.push_back ( ( *it )->clone ( ) );
+    for ( std::list<messagedef *>::const_iterator it ( m_messages.begin ( ) ); it != m_messages.end ( ); ++it )
+        copy->m_messages.push_back ( ( *it )->clone ( ) );
+    return copy.release ( );
+}
+
 void messagedef::addContent ( definition * content )
 {
     if ( ! content ) throw std::runtime_error ( "Cannot add NULL content to \"" + idString ( ) + "\"" );
@@ -584,6 +711,7 @@ void messagedef::addParents ( const identifier_list & parents )
     m_parents.reserve ( m_parents.size ( ) + parents.size ( ) );
     std::for_each ( parents.content ( ).begin ( ), parents.content ( ).end ( ), refcounted::inc );
     std::copy ( parents.content ( ).begin ( ), parents.content ( ).end ( ), std::back_inserter ( m_parents ) );
+    m_parentDefs.resize ( m_parents.size ( ), 0 );
 }
 
 void messagedef::replaceParent ( size_t index, const identifier * parent )
@@ -594,6 +722,38 @@ void messagedef::replaceParent ( size_t index, const identifier * parent )
     refcounted::dec ( old );
 }
 
+const messagedef * messagedef::parentDef ( size_t index ) const
+{
+    if ( index >= m_parentDefs.size ( ) ) throw std::out_of_range ( "Invalid index for message parent definition" );
+    return m_parentDefs [ index ];
+}
+
+void messagedef::setParentDef ( size_t index, const messagedef * def )
+{
+    if ( index >= m_parentDefs.size ( ) ) throw std::out_of_range ( "Invalid index for message parent definition" );
+    if ( ! def )                          throw std::invalid_argument ( "Cannot set message parent definition with NULL" );
+    m_parentDefs [ index ] = def;
+}
+
+void messagedef::collectFields ( std::vector<const fielddef *> & fields ) const
+{
+    // Own fields first, then the parents' in declaration order. A name already
+    // collected hides any later field of the same name. Extern parents have no
+    // known fields.
+    for ( std::list<fielddef *>::const_iterator it ( m_fields.begin ( ) ); it != m_fields.end ( ); ++it )
+    {
+        bool hidden ( false );
+        for ( size_t index ( 0 ); index < fields.size ( ) && ! hidden; ++index )
+            hidden = fields [ index ]->id ( ).equals ( ( *it )->id ( ) );
+        if ( ! hidden )
+            fields.push_back ( *it );
+    }
+
+    for ( size_t index ( 0 ); index < m_parentDefs.size ( ); ++index )
+        if ( m_parentDefs [ index ] )
+            m_parentDefs [ index ]->collectFields ( fields );
+}
+
 void messagedef::saveOriginalId ( )
 {
     if ( m_originalId )
@@ -602,6 +762,19 @@ void messagedef::saveOriginalId ( )
     m_originalId = id ( ).clone ( );
 }
 
+void messagedef::clearOriginalId ( )
+{
+    refcounted::dec ( m_originalId );
+    m_originalId = 0;
+}
+
+messagedef * messagedef::createAndConsume ( char * name, bool isExtern )
+{
+    if ( ! name ) throw std::runtime_error ( "Cannot create message with NULL name" );
+    refptr<identifier> id ( identifier::createAndConsume ( name ) );
+    return new messagedef ( id.get ( ), isExtern );
+}
+
 messagedef * messagedef::addContentAndConsume ( messagedef * message, definition * definition )
 {
     if ( ! message ) throw std::runtime_error ( "Cannot add content to a NULL message" );
@@ -645,6 +818,15 @@ namespacedef::~namespacedef ( )
     clear ( );
 }
 
+namespacedef * namespacedef::clone ( ) const
+{
+    refptr<identifier> id ( cloneId ( ) );
+    refptr<namespacedef> copy ( new namespacedef ( id.get ( ) ) );
+    for ( std::list<definition *>::const_iterator it ( m_content.begin ( ) ); it != m_content.end ( ); ++it )
+        copy->m_content.push_back ( ( *it )->clone ( ) );
+    return copy.release ( );
+}
+
 void namespacedef::addContent ( definition * content )
 {
     if ( ! content )       throw std::runtime_error ( "Cannot add NULL content to \"" + idString ( ) + "\"" );
@@ -666,7 +848,10 @@ void namespacedef::removeContentIf ( bool ( *predicate ) ( const definition & )
     {
         prev = it++;
         if ( predicate ( **prev ) )
+        {
+            refcounted::dec ( *prev );
             m_content.erase ( prev );
+        }
     }
 }
 
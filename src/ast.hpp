@@ -19,6 +19,7 @@
 
 #include "constants.hpp"
 #include "memoryutil.hpp"
+#include "symboltable.hpp"
 #include <algorithm>
 #include <deque>
 #include <list>
@@ -29,6 +30,9 @@
 
 namespace fudgeproto {
 
+// A qualified name, held as a sequence of interned symbols. The dotted and
+// C++ scoped forms are kept up to date as the identifier is modified, and the
+// dotted form is itself interned so it can be used as a key.
 class identifier : public refcounted
 {
     public:
@@ -38,8 +42,9 @@ class identifier : public refcounted
         identifier * clone ( ) const;
 
         inline size_t size ( ) const { return m_elements.size ( ); }
-        inline const std::string & at ( size_t index ) const { return m_elements [ index ]; }
+        inline const std::string & at ( size_t index ) const { return *m_elements [ index ]; }
         inline const std::string & operator[] ( size_t index ) const { return at ( index ); }
+        inline symbol symbolAt ( size_t index ) const { return m_elements [ index ]; }
 
         void append ( const std::string & element );
         void extend ( const identifier & source );
@@ -50,6 +55,10 @@ class identifier : public refcounted
 
         std::string asString ( const std::string & separator ) const;
 
+        inline symbol key ( ) const { return m_dotted; }
+        inline const std::string & dotted ( ) const { return *m_dotted; }
+        inline const std::string & scoped ( ) const { return m_scoped; }
+
         bool equals ( const identifier & id ) const;
 
         static identifier * createAndConsume ( char * source );
@@ -61,7 +70,12 @@ class identifier : public refcounted
     private:
         identifier ( );
 
-        std::deque<std::string> m_elements;
+        std::deque<symbol> m_elements;
+        symbol m_dotted;
+        std::string m_scoped;
+
+        void update ( );
+        std::string join ( const std::string & separator ) const;
 };
 
 class definition : public refcounted
@@ -74,9 +88,13 @@ class definition : public refcounted
 
         virtual void addContent ( definition * ) = 0;
 
+        // Deep copy of the definition as parsed. Anything filled in by the
+        // post-parse stages, such as resolved types, is not copied.
+        virtual definition * clone ( ) const = 0;
+
         inline bool hasId ( ) const { return m_id; }
         inline const identifier & id ( ) const { return *m_id; }
-        inline std::string idString ( ) const { return m_id ? m_id->asString ( "." ) : "NULL"; }
+        inline const std::string & idString ( ) const { return m_id ? m_id->dotted ( ) : s_nullId; }
 
         void setIdentifier ( identifier * id );
         void resetIdentifier ( identifier * id );
@@ -84,10 +102,15 @@ class definition : public refcounted
         static definition * setIdentifierAndConsume ( definition * target, char * source );
         static definition * setIdentifierAndConsume ( definition * target, identifier * source );
 
+    protected:
+        identifier * cloneId ( ) const;
+
     private:
         definition ( );         // Not implemented
 
         identifier * m_id;
+
+        static const std::string s_nullId;
 };
 
 class fieldtype
@@ -111,9 +134,14 @@ class fieldtype
         const definition & def ( ) const;
         void setDefinition ( const definition * def );
 
+        static fieldtype * createAndConsume ( identifier * id );
+
     private:
         fudgeproto_type m_type;
         const identifier * m_id;
+
+        // Not referenced, as it belongs to the same tree and messages may
+        // refer to each other
         const definition * m_definition;
 };
 
@@ -216,6 +244,7 @@ class enumdef : public definition
         enumdef ( identifier * id );
 
         inline void addContent ( definition * ) { throw std::runtime_error ( "Cannot add content to an enum" ); }
+        enumdef * clone ( ) const;
 
         inline size_t size ( ) const { return m_pairs.size ( ); }
         inline const std::pair<std::string, int32_t> & operator[] ( size_t index ) const { return m_pairs [ index ]; }
@@ -223,6 +252,7 @@ class enumdef : public definition
         void append ( const std::string & key );
         void append ( const std::string & key, int32_t value );
 
+        static enumdef * createAndConsume ( char * name );
         static enumdef * appendAndConsume ( enumdef * enumeration, char * key, int32_t value, bool hasValue );
 
     private:
@@ -237,10 +267,12 @@ class fielddef : public definition
                    const fieldtype & type,
                    fudgeproto_modifier modifier,
                    const std::vector<int> & constraints,
-                   literalvalue * defvalue );
+                   literalvalue * defvalue,
+                   fudgeproto_option options = FUDGEPROTO_OPTION_NONE );
         ~fielddef ( );
 
         inline void addContent ( definition * ) { throw std::runtime_error ( "Cannot add content to a field" ); }
+        fielddef * clone ( ) const;
 
         inline fieldtype & type ( ) { return m_type; }
         inline const fieldtype & type ( ) const { return m_type; }
@@ -251,6 +283,8 @@ class fielddef : public definition
         inline bool hasDefValue ( ) const { return m_defvalue; }
         inline const literalvalue & defValue ( ) const { return *m_defvalue; }
         inline bool isOptional ( ) const { return m_modifier & FUDGEPROTO_MODIFIER_OPTIONAL; }
+        inline fudgeproto_option options ( ) const { return m_options; }
+        inline bool hasOption ( fudgeproto_option option ) const { return m_options & option; }
 
         inline bool isCollection ( ) const { return ! m_constraints.empty ( ); }
 
@@ -261,9 +295,11 @@ class fielddef : public definition
                                              int modifier,
                                              fieldconstraint * constraints,
                                              int ordinal,
-                                             literalvalue * defvalue );
+                                             literalvalue * defvalue,
+                                             int options = FUDGEPROTO_OPTION_NONE );
 
         static fudgeproto_modifier cleanModifier ( int modifier );
+        static int optionFromStringAndConsume ( char * name );
 
     private:
         fieldtype m_type;
@@ -271,6 +307,13 @@ class fielddef : public definition
         std::vector<int> m_constraints;
         int * m_ordinal;
         literalvalue * m_defvalue;
+        fudgeproto_option m_options;
+
+        static fudgeproto_option checkOptions ( const char * name,
+                                                const fieldtype & type,
+                                                const fieldconstraint * constraints,
+                                                int ordinal,
+                                                int options );
 };
 
 class messagedef : public definition
@@ -280,6 +323,8 @@ class messagedef : public definition
         messagedef ( identifier * id, bool isExtern = false );
         ~messagedef ( );
 
+        messagedef * clone ( ) const;
+
         inline bool isExtern ( ) const { return m_extern; }
 
         inline const std::vector<const identifier *> & parents ( ) const { return m_parents; }
@@ -292,17 +337,29 @@ class messagedef : public definition
 
         void replaceParent ( size_t index, const identifier * parent );
 
+        const messagedef * parentDef ( size_t index ) const;
+        void setParentDef ( size_t index, const messagedef * def );
+
+        void collectFields ( std::vector<const fielddef *> & fields ) const;
+
         inline std::string originalIdString ( ) const { return m_originalId ? m_originalId->asString ( "." ) : idString ( ); }
 
         void saveOriginalId ( );
+        void clearOriginalId ( );
+
+        inline const std::string & sourceFile ( ) const { return m_sourceFile; }
+        inline void setSourceFile ( const std::string & filename ) { m_sourceFile = filename; }
 
+        static messagedef * createAndConsume ( char * name, bool isExtern = false );
         static messagedef * addContentAndConsume ( messagedef * message, definition * definition );
         static messagedef * addParentsAndConsume ( messagedef * message, identifier_list * parents );
 
     private:
         bool m_extern;
         identifier * m_originalId;
+        std::string m_sourceFile;
         std::vector<const identifier *> m_parents;
+        std::vector<const messagedef *> m_parentDefs;   // Not referenced, see fieldtype
         std::list<enumdef *> m_enums;
         std::list<fielddef *> m_fields;
         std::list<messagedef *> m_messages;
@@ -316,6 +373,8 @@ class namespacedef: public definition
         namespacedef & operator= ( const namespacedef & source );
         ~namespacedef ( );
 
+        namespacedef * clone ( ) const;
+
         void addContent ( definition * content );
         void clear ( );
         void removeContentIf ( bool ( *predicate ) ( const definition & ) );
@@ -30,6 +30,30 @@ void astaliaser::walk ( definition * node )
     astwalker::walk ( node );
 }
 
+void astaliaser::restore ( )
+{
+    // In reverse, so that each index key is replaced by the one it replaced
+    for ( std::vector<renamed>::reverse_iterator it ( m_renamed.rbegin ( ) ); it != m_renamed.rend ( ); ++it )
+    {
+        if ( it->parent != static_cast<size_t> ( -1 ) )
+            dynamic_cast<messagedef *> ( it->node )->replaceParent ( it->parent, it->id.get ( ) );
+        else
+        {
+            const symbol newid ( it->node->id ( ).key ( ) );
+            it->node->resetIdentifier ( it->id.get ( ) );
+            m_index.replace ( newid, it->node );
+        }
+    }
+    m_renamed.clear ( );
+
+    for ( std::deque<messagedef *>::const_iterator it ( m_messages.begin ( ) ); it != m_messages.end ( ); ++it )
+    {
+        ( *it )->clearOriginalId ( );
+        renameFields ( *it );
+    }
+    m_messages.clear ( );
+}
+
 
 void astaliaser::walk ( enumdef & node )
 {
@@ -39,7 +63,10 @@ void astaliaser::walk ( enumdef & node )
 void astaliaser::walk ( fielddef & node )
 {
     if ( node.type ( ).type ( ) == FUDGEPROTO_TYPE_USER )
-        node.type ( ).resetIdentifier ( node.type ( ).def ( ).id ( ).clone ( ) );
+    {
+        refptr<identifier> newid ( node.type ( ).def ( ).id ( ).clone ( ) );
+        node.type ( ).resetIdentifier ( newid.get ( ) );
+    }
 }
 
 void astaliaser::walk ( messagedef & node )
@@ -52,7 +79,11 @@ void astaliaser::walk ( messagedef & node )
         const identifier * parent ( node.parents ( ) [ index ] );
         refptr<identifier> newid ( m_mutator.mutatedCloneStem ( *parent ) );
         if ( ! newid->equals ( *parent ) )
+        {
+            const renamed undo = { &node, index, parent->clone ( ) };
+            m_renamed.push_back ( undo );
             node.replaceParent ( index, newid.get ( ) );
+        }
     }
 
     walkCollection ( node.enums ( ) );
@@ -66,15 +97,15 @@ void astaliaser::walk ( namespacedef & node )
 
     // Top-level - clear out state
     m_messages.clear ( );
+    m_renamed.clear ( );
 
     walkCollection ( node.content ( ) );
 
-    // Tree/index is now internally consistent, update fields
+    // Tree/index is now internally consistent, update fields. The messages
+    // are kept in case the names have to be restored.
     std::for_each ( m_messages.begin ( ),
                     m_messages.end ( ),
                     std::bind1st ( std::mem_fun( &astaliaser::renameFields ), this ) );
-
-    m_messages.clear ( );
 }
 
 void astaliaser::rename ( definition * node )
@@ -82,8 +113,10 @@ void astaliaser::rename ( definition * node )
     refptr<identifier> newid ( m_mutator.mutatedCloneStem ( node->id ( ) ) );
     if ( ! newid->equals ( node->id ( ) ) )
     {
-        const std::string oldid ( node->idString ( ) );
-        node->resetIdentifier ( newid.release ( ) );
+        const renamed undo = { node, static_cast<size_t> ( -1 ), node->id ( ).clone ( ) };
+        m_renamed.push_back ( undo );
+        const symbol oldid ( node->id ( ).key ( ) );
+        node->resetIdentifier ( newid.get ( ) );
         m_index.replace ( oldid, node );
     }
 }
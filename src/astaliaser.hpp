@@ -31,10 +31,22 @@ class astaliaser : public astwalker
 
         void walk ( definition * node );
 
+        // Puts back every name changed by the last walk, so that the tree can
+        // be aliased again with another mutator
+        void restore ( );
+
     private:
+        struct renamed
+        {
+            definition * node;
+            size_t parent;
+            refptr<identifier> id;
+        };
+
         astindex & m_index;
         identifiermutator & m_mutator;
         std::deque<messagedef *> m_messages;
+        std::vector<renamed> m_renamed;
 
         void walk ( enumdef & node );
         void walk ( fielddef & node );
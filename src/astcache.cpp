@@ -0,0 +1,613 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "astcache.hpp"
+#include "config.h"
+#include "outputfile.hpp"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <typeinfo>
+
+using namespace fudgeproto;
+
+namespace
+{
+    // Every value is written little-endian, whatever the host
+    const char magic [ ] = "SFPCACHE";
+    const size_t magicSize ( sizeof ( magic ) - 1 );
+    const uint32_t noIdentifier ( 0xffffffff );
+
+    enum
+    {
+        TAG_ENUM      = 'E',
+        TAG_FIELD     = 'F',
+        TAG_MESSAGE   = 'M',
+        TAG_NAMESPACE = 'N'
+    };
+
+    void putInt ( std::ostream & output, uint32_t value )
+    {
+        char bytes [ 4 ];
+        for ( size_t index ( 0 ); index < sizeof ( bytes ); ++index )
+            bytes [ index ] = static_cast<char> ( value >> ( 8 * index ) );
+        output.write ( bytes, sizeof ( bytes ) );
+    }
+
+    void putLong ( std::ostream & output, uint64_t value )
+    {
+        putInt ( output, static_cast<uint32_t> ( value ) );
+        putInt ( output, static_cast<uint32_t> ( value >> 32 ) );
+    }
+
+    void putString ( std::ostream & output, const std::string & value )
+    {
+        putInt ( output, static_cast<uint32_t> ( value.size ( ) ) );
+        output.write ( value.data ( ), value.size ( ) );
+    }
+
+    void putIdentifier ( std::ostream & output, const identifier * id )
+    {
+        if ( ! id )
+        {
+            putInt ( output, noIdentifier );
+            return;
+        }
+
+        putInt ( output, static_cast<uint32_t> ( id->size ( ) ) );
+        for ( size_t index ( 0 ); index < id->size ( ); ++index )
+            putString ( output, ( *id ) [ index ] );
+    }
+
+    bool readFile ( const std::string & filename, std::string & content )
+    {
+        std::ifstream input ( filename.c_str ( ), std::ios::in | std::ios::binary );
+        if ( ! input )
+            return false;
+        content.assign ( std::istreambuf_iterator<char> ( input ), std::istreambuf_iterator<char> ( ) );
+        return ! input.bad ( );
+    }
+
+    uint64_t hashOptions ( const std::string & options )
+    {
+        const std::string versioned ( std::string ( PACKAGE_STRING ) + '\0' + options );
+        return outputfile::hash ( versioned.data ( ), versioned.size ( ) );
+    }
+
+    // Reads values back from a cache held in memory. Any attempt to read past
+    // the end means the file is truncated or corrupt.
+    class cacheinput
+    {
+        public:
+            cacheinput ( const std::string & data )
+                : m_data ( data )
+                , m_position ( 0 )
+            {
+            }
+
+            inline bool atEnd ( ) const { return m_position == m_data.size ( ); }
+
+            uint8_t getByte ( )
+            {
+                need ( 1 );
+                return static_cast<uint8_t> ( m_data [ m_position++ ] );
+            }
+
+            uint32_t getInt ( )
+            {
+                need ( 4 );
+                uint32_t value ( 0 );
+                for ( size_t index ( 0 ); index < 4; ++index )
+                    value |= static_cast<uint32_t> ( static_cast<unsigned char> ( m_data [ m_position++ ] ) ) << ( 8 * index );
+                return value;
+            }
+
+            uint64_t getLong ( )
+            {
+                const uint64_t low ( getInt ( ) );
+                return low | static_cast<uint64_t> ( getInt ( ) ) << 32;
+            }
+
+            // Each counted item takes at least one byte, so a corrupt count
+            // can't cause a huge allocation
+            uint32_t getCount ( )
+            {
+                const uint32_t count ( getInt ( ) );
+                need ( count );
+                return count;
+            }
+
+            std::string getString ( )
+            {
+                const uint32_t size ( getCount ( ) );
+                const std::string value ( m_data, m_position, size );
+                m_position += size;
+                return value;
+            }
+
+            identifier * getIdentifier ( )
+            {
+                const uint32_t size ( getInt ( ) );
+                if ( size == noIdentifier )
+                    return 0;
+                if ( ! size )
+                    throw std::runtime_error ( "Empty identifier in cache" );
+
+                refptr<identifier> id ( new identifier ( getString ( ) ) );
+                need ( size - 1 );
+                for ( uint32_t index ( 1 ); index < size; ++index )
+                    id->append ( getString ( ) );
+                return id.release ( );
+            }
+
+        private:
+            const std::string & m_data;
+            size_t m_position;
+
+            void need ( size_t size ) const
+            {
+                if ( size > m_data.size ( ) - m_position )
+                    throw std::runtime_error ( "Cache is truncated" );
+            }
+    };
+
+    // Rebuilds the tree, numbering the nodes in the same order as the writer
+    // so that references to them can be restored once they all exist
+    class treereader
+    {
+        public:
+            treereader ( cacheinput & input )
+                : m_input ( input )
+            {
+            }
+
+            definition * read ( )
+            {
+                const uint8_t tag ( m_input.getByte ( ) );
+                refptr<identifier> id ( m_input.getIdentifier ( ) );
+                switch ( tag )
+                {
+                    case TAG_ENUM:      return readEnum ( id.get ( ) );
+                    case TAG_FIELD:     return readField ( id.get ( ) );
+                    case TAG_MESSAGE:   return readMessage ( id.get ( ) );
+                    case TAG_NAMESPACE: return readNamespace ( id.get ( ) );
+                    default:
+                        throw std::runtime_error ( "Unknown definition in cache" );
+                }
+            }
+
+            definition * node ( uint32_t ref ) const
+            {
+                if ( ! ref || ref > m_nodes.size ( ) )
+                    throw std::runtime_error ( "Invalid definition reference in cache" );
+                return m_nodes [ ref - 1 ];
+            }
+
+            void resolve ( ) const
+            {
+                for ( std::vector<std::pair<fielddef *, uint32_t> >::const_iterator it ( m_types.begin ( ) ); it != m_types.end ( ); ++it )
+                    it->first->type ( ).setDefinition ( node ( it->second ) );
+
+                for ( std::vector<parentref>::const_iterator it ( m_parents.begin ( ) ); it != m_parents.end ( ); ++it )
+                {
+                    const messagedef * parent ( dynamic_cast<const messagedef *> ( node ( it->ref ) ) );
+                    if ( ! parent )
+                        throw std::runtime_error ( "Message parent in cache is not a message" );
+                    it->message->setParentDef ( it->index, parent );
+                }
+            }
+
+        private:
+            struct parentref
+            {
+                messagedef * message;
+                size_t index;
+                uint32_t ref;
+            };
+
+            cacheinput & m_input;
+            std::vector<definition *> m_nodes;
+            std::vector<std::pair<fielddef *, uint32_t> > m_types;
+            std::vector<parentref> m_parents;
+
+            enumdef * readEnum ( identifier * id )
+            {
+                refptr<enumdef> node ( new enumdef ( id ) );
+                m_nodes.push_back ( node.get ( ) );
+
+                for ( uint32_t count ( m_input.getCount ( ) ); count; --count )
+                {
+                    const std::string key ( m_input.getString ( ) );
+                    node->append ( key, static_cast<int32_t> ( m_input.getInt ( ) ) );
+                }
+                return node.release ( );
+            }
+
+            fielddef * readField ( identifier * id )
+            {
+                if ( ! id )
+                    throw std::runtime_error ( "Field without a name in cache" );
+
+                const int type ( static_cast<int32_t> ( m_input.getInt ( ) ) );
+                refptr<identifier> typeId ( type == FUDGEPROTO_TYPE_USER ? m_input.getIdentifier ( ) : 0 );
+                const uint32_t typeRef ( typeId ? m_input.getInt ( ) : 0 );
+                if ( type == FUDGEPROTO_TYPE_USER && ! typeId )
+                    throw std::runtime_error ( "User field type without a name in cache" );
+
+                const int modifier ( static_cast<int32_t> ( m_input.getInt ( ) ) );
+                std::auto_ptr<fieldconstraint> constraints;
+                for ( uint32_t count ( m_input.getCount ( ) ); count; --count )
+                {
+                    const int bound ( static_cast<int32_t> ( m_input.getInt ( ) ) );
+                    if ( constraints.get ( ) )
+                        constraints->append ( bound );
+                    else
+                        constraints.reset ( new fieldconstraint ( bound ) );
+                }
+                const bool hasOrdinal ( m_input.getByte ( ) );
+                const int ordinal ( static_cast<int32_t> ( m_input.getInt ( ) ) );
+                refptr<literalvalue> defvalue ( readLiteral ( ) );
+                const int options ( static_cast<int32_t> ( m_input.getInt ( ) ) );
+
+                // The factory consumes its arguments and applies the same
+                // checks as the parser, so the placeholder name is replaced
+                // by the cached identifier afterwards
+                std::auto_ptr<fieldtype> fieldType ( typeId ? new fieldtype ( typeId.get ( ) ) : new fieldtype ( type ) );
+                char * name ( new char [ id->at ( 0 ).size ( ) + 1 ] );
+                std::strcpy ( name, id->at ( 0 ).c_str ( ) );
+                refptr<fielddef> node ( fielddef::createAndConsume ( name,
+                                                                     fieldType.release ( ),
+                                                                     modifier,
+                                                                     constraints.release ( ),
+                                                                     hasOrdinal ? ordinal : FUDGEPROTO_ORDINAL_NONE,
+                                                                     defvalue.release ( ),
+                                                                     options ) );
+                node->resetIdentifier ( id );
+                m_nodes.push_back ( node.get ( ) );
+                if ( typeRef )
+                    m_types.push_back ( std::make_pair ( node.get ( ), typeRef ) );
+                return node.release ( );
+            }
+
+            literalvalue * readLiteral ( )
+            {
+                switch ( m_input.getByte ( ) )
+                {
+                    case FUDGEPROTO_TYPE_INVALID:   return 0;
+                    case FUDGEPROTO_TYPE_BOOLEAN:   return new literalvalue ( m_input.getByte ( ) != 0 );
+                    case FUDGEPROTO_TYPE_INT:       return new literalvalue ( static_cast<int> ( static_cast<int32_t> ( m_input.getInt ( ) ) ) );
+                    case FUDGEPROTO_TYPE_STRING:    return new literalvalue ( m_input.getString ( ) );
+                    case FUDGEPROTO_TYPE_DOUBLE:
+                    {
+                        const uint64_t bits ( m_input.getLong ( ) );
+                        double value;
+                        std::memcpy ( &value, &bits, sizeof ( value ) );
+                        return new literalvalue ( value );
+                    }
+                    default:
+                        throw std::runtime_error ( "Unknown literal value in cache" );
+                }
+            }
+
+            messagedef * readMessage ( identifier * id )
+            {
+                if ( ! id )
+                    throw std::runtime_error ( "Message without a name in cache" );
+
+                // Aliased messages keep their original name, which is recorded
+                // just as the aliaser does
+                const bool isExtern ( m_input.getByte ( ) );
+                const std::string original ( m_input.getString ( ) );
+                refptr<identifier> originalId ( original.empty ( ) ? 0 : identifier::createFromString ( original, "." ) );
+                refptr<messagedef> node ( new messagedef ( originalId ? originalId.get ( ) : id, isExtern ) );
+                if ( originalId )
+                {
+                    node->saveOriginalId ( );
+                    node->resetIdentifier ( id );
+                }
+                node->setSourceFile ( m_input.getString ( ) );
+                m_nodes.push_back ( node.get ( ) );
+
+                std::vector<refptr<identifier> > parents ( m_input.getCount ( ) );
+                std::vector<uint32_t> parentRefs ( parents.size ( ) );
+                for ( size_t index ( 0 ); index < parents.size ( ); ++index )
+                {
+                    parents [ index ] = m_input.getIdentifier ( );
+                    parentRefs [ index ] = m_input.getInt ( );
+                    if ( ! parents [ index ] )
+                        throw std::runtime_error ( "Message parent without a name in cache" );
+                }
+                if ( ! parents.empty ( ) )
+                {
+                    refptr<identifier_list> list ( new identifier_list );
+                    for ( size_t index ( parents.size ( ) ); index; --index )
+                        list->prepend ( parents [ index - 1 ].get ( ) );
+                    node->addParents ( *list );
+                }
+                for ( size_t index ( 0 ); index < parentRefs.size ( ); ++index )
+                    if ( parentRefs [ index ] )
+                    {
+                        const parentref ref = { node.get ( ), index, parentRefs [ index ] };
+                        m_parents.push_back ( ref );
+                    }
+
+                // Enums, fields then nested messages
+                for ( size_t group ( 0 ); group < 3; ++group )
+                    for ( uint32_t count ( m_input.getCount ( ) ); count; --count )
+                    {
+                        refptr<definition> content ( read ( ) );
+                        node->addContent ( content.get ( ) );
+                    }
+                return node.release ( );
+            }
+
+            namespacedef * readNamespace ( identifier * id )
+            {
+                refptr<namespacedef> node ( new namespacedef ( id ) );
+                m_nodes.push_back ( node.get ( ) );
+
+                for ( uint32_t count ( m_input.getCount ( ) ); count; --count )
+                {
+                    refptr<definition> content ( read ( ) );
+                    node->addContent ( content.get ( ) );
+                }
+                return node.release ( );
+            }
+    };
+}
+
+const uint32_t astcache::s_version ( 2 );
+
+astcache::astcache ( const std::string & filename, const std::string & options )
+    : m_filename ( filename )
+    , m_key ( hashOptions ( options ) )
+{
+}
+
+bool astcache::load ( refptr<namespacedef> & root, astindex & index )
+{
+    std::string data;
+    if ( ! readFile ( m_filename, data ) )
+        return false;
+
+    try
+    {
+        cacheinput input ( data );
+        if ( data.compare ( 0, magicSize, magic ) )
+            return false;
+        for ( size_t count ( 0 ); count < magicSize; ++count )
+            input.getByte ( );
+        if ( input.getInt ( ) != s_version || input.getLong ( ) != m_key )
+            return false;
+
+        // Every file that was parsed must be unchanged
+        std::vector<std::string> files ( input.getCount ( ) );
+        for ( std::vector<std::string>::iterator it ( files.begin ( ) ); it != files.end ( ); ++it )
+        {
+            *it = input.getString ( );
+            const uint64_t hash ( input.getLong ( ) );
+            std::string content;
+            if ( ! readFile ( *it, content ) || outputfile::hash ( content.data ( ), content.size ( ) ) != hash )
+                return false;
+        }
+
+        treereader reader ( input );
+        refptr<definition> tree ( reader.read ( ) );
+        if ( ! tree.istype<namespacedef> ( ) )
+            return false;
+
+        astindex::definitionmap entries;
+        for ( uint32_t count ( input.getCount ( ) ); count; --count )
+        {
+            const symbol name ( symboltable::intern ( input.getString ( ) ) );
+            entries [ name ] = reader.node ( input.getInt ( ) );
+        }
+        reader.resolve ( );
+        if ( ! input.atEnd ( ) )
+            return false;
+
+        index.load ( entries );
+        root = refptr<namespacedef> ( dynamic_cast<namespacedef *> ( tree.release ( ) ) );
+        m_files.swap ( files );
+        return true;
+    }
+    catch ( const std::exception & )
+    {
+        // A damaged cache is simply rebuilt
+        return false;
+    }
+}
+
+astcachewriter::astcachewriter ( const astcache & cache, const astindex & index, const parsecache & files )
+    : m_cache ( cache )
+    , m_index ( index )
+    , m_files ( files )
+    , m_output ( 0 )
+{
+}
+
+void astcachewriter::walk ( definition * node )
+{
+    if ( peekStack ( ) || ! node )
+    {
+        astwalker::walk ( node );
+        return;
+    }
+
+    // The nodes are numbered up front, as fields can refer to messages that
+    // are written after them
+    m_nodes.clear ( );
+    numberNodes ( *node );
+
+    // Only the generated code is reported in the statistics
+    outputfile output ( m_cache.filename ( ), false );
+    m_output = &output.stream ( );
+    m_output->write ( magic, magicSize );
+    putInt ( *m_output, astcache::s_version );
+    putLong ( *m_output, m_cache.key ( ) );
+
+    putInt ( *m_output, static_cast<uint32_t> ( m_files.files ( ).size ( ) ) );
+    for ( parsecache::filemap::const_iterator it ( m_files.files ( ).begin ( ) ); it != m_files.files ( ).end ( ); ++it )
+    {
+        putString ( *m_output, it->first );
+        putLong ( *m_output, it->second.hash );
+    }
+
+    astwalker::walk ( node );
+
+    putInt ( *m_output, static_cast<uint32_t> ( m_index.numEnums ( ) + m_index.numMessages ( ) ) );
+    const astindex::definitionmap * maps [ ] = { &m_index.enumMap ( ), &m_index.messageMap ( ) };
+    for ( size_t map ( 0 ); map < 2; ++map )
+    {
+        // In name order, so the same inputs always give the same cache
+        astindex::sortedmap sorted;
+        astindex::sortByName ( *maps [ map ], sorted );
+        for ( astindex::sortedmapcit it ( sorted.begin ( ) ); it != sorted.end ( ); ++it )
+        {
+            putString ( *m_output, it->first );
+            putInt ( *m_output, nodeRef ( it->second ) );
+        }
+    }
+
+    m_output = 0;
+    output.commit ( );
+}
+
+void astcachewriter::walk ( enumdef & node )
+{
+    m_output->put ( TAG_ENUM );
+    putIdentifier ( *m_output, node.hasId ( ) ? &node.id ( ) : 0 );
+    putInt ( *m_output, static_cast<uint32_t> ( node.size ( ) ) );
+    for ( size_t index ( 0 ); index < node.size ( ); ++index )
+    {
+        putString ( *m_output, node [ index ].first );
+        putInt ( *m_output, static_cast<uint32_t> ( node [ index ].second ) );
+    }
+}
+
+void astcachewriter::walk ( fielddef & node )
+{
+    m_output->put ( TAG_FIELD );
+    putIdentifier ( *m_output, node.hasId ( ) ? &node.id ( ) : 0 );
+    putInt ( *m_output, static_cast<uint32_t> ( node.type ( ).type ( ) ) );
+    if ( node.type ( ).type ( ) == FUDGEPROTO_TYPE_USER )
+    {
+        putIdentifier ( *m_output, &node.type ( ).name ( ) );
+        putInt ( *m_output, nodeRef ( &node.type ( ).def ( ) ) );
+    }
+
+    putInt ( *m_output, static_cast<uint32_t> ( node.modifier ( ) ) );
+    putInt ( *m_output, static_cast<uint32_t> ( node.constraints ( ).size ( ) ) );
+    for ( std::vector<int>::const_iterator it ( node.constraints ( ).begin ( ) ); it != node.constraints ( ).end ( ); ++it )
+        putInt ( *m_output, static_cast<uint32_t> ( *it ) );
+    m_output->put ( node.hasOrdinal ( ) );
+    putInt ( *m_output, static_cast<uint32_t> ( node.hasOrdinal ( ) ? node.ordinal ( ) : 0 ) );
+
+    if ( ! node.hasDefValue ( ) )
+        m_output->put ( FUDGEPROTO_TYPE_INVALID );
+    else
+    {
+        const literalvalue & value ( node.defValue ( ) );
+        m_output->put ( static_cast<char> ( value.type ( ) ) );
+        switch ( value.type ( ) )
+        {
+            case FUDGEPROTO_TYPE_BOOLEAN:   m_output->put ( value.getBool ( ) ); break;
+            case FUDGEPROTO_TYPE_INT:       putInt ( *m_output, static_cast<uint32_t> ( value.getInt ( ) ) ); break;
+            case FUDGEPROTO_TYPE_STRING:    putString ( *m_output, value.getString ( ) ); break;
+            case FUDGEPROTO_TYPE_DOUBLE:
+            {
+                const double dprecision ( value.getDouble ( ) );
+                uint64_t bits;
+                std::memcpy ( &bits, &dprecision, sizeof ( bits ) );
+                putLong ( *m_output, bits );
+                break;
+            }
+            default:
+                throw std::logic_error ( "Cannot cache default value of field \"" + node.idString ( ) + "\"" );
+        }
+    }
+
+    putInt ( *m_output, static_cast<uint32_t> ( node.options ( ) ) );
+}
+
+void astcachewriter::walk ( messagedef & node )
+{
+    m_output->put ( TAG_MESSAGE );
+    putIdentifier ( *m_output, &node.id ( ) );
+    m_output->put ( node.isExtern ( ) );
+    const std::string original ( node.originalIdString ( ) );
+    putString ( *m_output, original == node.idString ( ) ? std::string ( ) : original );
+    putString ( *m_output, node.sourceFile ( ) );
+
+    putInt ( *m_output, static_cast<uint32_t> ( node.parents ( ).size ( ) ) );
+    for ( size_t index ( 0 ); index < node.parents ( ).size ( ); ++index )
+    {
+        putIdentifier ( *m_output, node.parents ( ) [ index ] );
+        putInt ( *m_output, node.parentDef ( index ) ? nodeRef ( node.parentDef ( index ) ) : 0 );
+    }
+
+    const std::list<messagedef *> messages ( node.messages ( ) );
+    putInt ( *m_output, static_cast<uint32_t> ( node.enums ( ).size ( ) ) );
+    walkCollection ( node.enums ( ) );
+    putInt ( *m_output, static_cast<uint32_t> ( node.fields ( ).size ( ) ) );
+    walkCollection ( node.fields ( ) );
+    putInt ( *m_output, static_cast<uint32_t> ( messages.size ( ) ) );
+    walkCollection ( messages );
+}
+
+void astcachewriter::walk ( namespacedef & node )
+{
+    m_output->put ( TAG_NAMESPACE );
+    putIdentifier ( *m_output, node.hasId ( ) ? &node.id ( ) : 0 );
+    putInt ( *m_output, static_cast<uint32_t> ( node.content ( ).size ( ) ) );
+    walkCollection ( node.content ( ) );
+}
+
+void astcachewriter::numberNodes ( const definition & node )
+{
+    // Numbered from one in the order they're written, zero means no node
+    m_nodes [ &node ] = static_cast<uint32_t> ( m_nodes.size ( ) + 1 );
+
+    if ( typeid ( node ) == typeid ( messagedef ) )
+    {
+        const messagedef & message ( dynamic_cast<const messagedef &> ( node ) );
+        const std::list<messagedef *> messages ( message.messages ( ) );
+        for ( std::list<enumdef *>::const_iterator it ( message.enums ( ).begin ( ) ); it != message.enums ( ).end ( ); ++it )
+            numberNodes ( **it );
+        for ( std::list<fielddef *>::const_iterator it ( message.fields ( ).begin ( ) ); it != message.fields ( ).end ( ); ++it )
+            numberNodes ( **it );
+        for ( std::list<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+            numberNodes ( **it );
+    }
+    else if ( typeid ( node ) == typeid ( namespacedef ) )
+    {
+        const namespacedef & ns ( dynamic_cast<const namespacedef &> ( node ) );
+        for ( std::list<definition *>::const_iterator it ( ns.content ( ).begin ( ) ); it != ns.content ( ).end ( ); ++it )
+            numberNodes ( **it );
+    }
+}
+
+uint32_t astcachewriter::nodeRef ( const definition * node ) const
+{
+    std::map<const definition *, uint32_t>::const_iterator it ( m_nodes.find ( node ) );
+    if ( it == m_nodes.end ( ) )
+        throw std::logic_error ( "Cannot cache reference to \"" + node->idString ( ) + "\", it is not in the tree" );
+    return it->second;
+}
+
@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_ASTCACHE
+#define INC_FUDGEPROTO_ASTCACHE
+
+#include "astindex.hpp"
+#include "astwalker.hpp"
+#include "parser.hpp"
+#include <stdint.h>
+#include <vector>
+
+namespace fudgeproto {
+
+// A resolved tree and its index saved to a file, so that a run on unchanged
+// inputs can skip parsing and resolution. The cache is only used if it was
+// written by the same version of the generator with the same options, and
+// every file that was read to build it still has the same content.
+class astcache
+{
+    public:
+        astcache ( const std::string & filename, const std::string & options );
+
+        // Returns false if the cache is missing, out of date or unreadable,
+        // in which case the root and index are left alone
+        bool load ( refptr<namespacedef> & root, astindex & index );
+
+        inline const std::string & filename ( ) const { return m_filename; }
+        inline uint64_t key ( ) const { return m_key; }
+
+        // The files that the loaded tree was built from
+        inline const std::vector<std::string> & files ( ) const { return m_files; }
+
+        static const uint32_t s_version;
+
+    private:
+        std::string m_filename;
+        uint64_t m_key;
+        std::vector<std::string> m_files;
+};
+
+// Writes the resolved tree, along with the index and the content hashes of
+// the parsed files, to the cache
+class astcachewriter : public astwalker
+{
+    public:
+        astcachewriter ( const astcache & cache, const astindex & index, const parsecache & files );
+
+        void walk ( definition * node );
+
+    private:
+        const astcache & m_cache;
+        const astindex & m_index;
+        const parsecache & m_files;
+        std::map<const definition *, uint32_t> m_nodes;
+        std::ostream * m_output;
+
+        void walk ( enumdef & node );
+        void walk ( fielddef & node );
+        void walk ( messagedef & node );
+        void walk ( namespacedef & node );
+
+        void numberNodes ( const definition & node );
+        uint32_t nodeRef ( const definition * node ) const;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,243 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "astdependencies.hpp"
+#include <algorithm>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <typeinfo>
+
+using namespace fudgeproto;
+
+namespace
+{
+    void writeList ( std::ostream & output, const std::vector<std::string> & files )
+    {
+        for ( std::vector<std::string>::const_iterator it ( files.begin ( ) ); it != files.end ( ); ++it )
+            output << ( it == files.begin ( ) ? "" : " " ) << *it;
+    }
+}
+
+astdependencies::astdependencies ( const astextrefs & extrefs,
+                                   const astindex & index,
+                                   const codewriterfactory & factory,
+                                   const filenamegenerator & filenamegen,
+                                   const std::vector<std::string> & inputs,
+                                   const identifier * registry )
+    : m_extrefs ( extrefs )
+    , m_index ( index )
+    , m_factory ( factory )
+    , m_filenamegen ( filenamegen )
+    , m_inputs ( inputs )
+    , m_registry ( registry ? registry->clone ( ) : 0 )
+{
+}
+
+astdependencies::~astdependencies ( )
+{
+    if ( m_registry )
+        refcounted::dec ( m_registry );
+}
+
+void astdependencies::walk ( definition * node )
+{
+    astwalker::walk ( node );
+}
+
+void astdependencies::reset ( )
+{
+    astwalker::reset ( );
+    m_outputs.clear ( );
+    m_externals.clear ( );
+    m_imports.clear ( );
+    m_groups.clear ( );
+    m_amalgamations.clear ( );
+}
+
+void astdependencies::writeManifest ( std::ostream & output ) const
+{
+    for ( std::vector<std::string>::const_iterator it ( m_outputs.begin ( ) ); it != m_outputs.end ( ); ++it )
+        output << *it << std::endl;
+}
+
+void astdependencies::writeDepfile ( std::ostream & output ) const
+{
+    for ( std::vector<outputgroup>::const_iterator it ( m_groups.begin ( ) ); it != m_groups.end ( ); ++it )
+    {
+        std::vector<std::string> targets, inputs, headers;
+        std::transform ( it->outputs.begin ( ), it->outputs.end ( ), std::back_inserter ( targets ), escape );
+        std::transform ( it->inputs.begin ( ), it->inputs.end ( ), std::back_inserter ( inputs ), escape );
+        std::transform ( it->headers.begin ( ), it->headers.end ( ), std::back_inserter ( headers ), escape );
+
+        writeList ( output, targets );
+        output << ": ";
+        writeList ( output, inputs );
+        output << std::endl;
+
+        // External headers are included by the generated code, but aren't read
+        // by the generator, so they only affect the build order
+        if ( ! headers.empty ( ) )
+        {
+            writeList ( output, targets );
+            output << ": | ";
+            writeList ( output, headers );
+            output << std::endl;
+        }
+    }
+
+    // Empty rules for the inputs and external headers, so that removing one
+    // doesn't leave Make without a rule for it
+    output << std::endl;
+    std::set<std::string> written;
+    for ( std::vector<std::string>::const_iterator it ( m_inputs.begin ( ) ); it != m_inputs.end ( ); ++it )
+        if ( written.insert ( *it ).second )
+            output << escape ( *it ) << ":" << std::endl;
+    for ( std::set<std::string>::const_iterator it ( m_imports.begin ( ) ); it != m_imports.end ( ); ++it )
+        if ( written.insert ( *it ).second )
+            output << escape ( *it ) << ":" << std::endl;
+    for ( std::set<std::string>::const_iterator it ( m_externals.begin ( ) ); it != m_externals.end ( ); ++it )
+        if ( written.insert ( *it ).second )
+            output << escape ( *it ) << ":" << std::endl;
+}
+
+void astdependencies::walk ( enumdef & )
+{
+    // Enums are generated with the message that contains them
+}
+
+void astdependencies::walk ( fielddef & )
+{
+    throw std::logic_error ( "Field walker not implemented in dependency collector" );
+}
+
+void astdependencies::walk ( messagedef & node )
+{
+    // Amalgamated implementations are added by the namespace walker once
+    // every message has been seen
+    outputgroup group;
+    addOutputs ( group, node.id ( ).asString ( "_" ), ! m_filenamegen.isAmalgamated ( ) );
+    addInput ( group, node );
+
+    astextrefs::stringset refids;
+    m_extrefs.findAllrefs ( refids, node.idString ( ) );
+    for ( astextrefs::stringsetcit it ( refids.begin ( ) ); it != refids.end ( ); ++it )
+    {
+        refptr<const definition> ref ( m_index.find ( *it ) );
+        if ( ! ref )
+            throw std::logic_error ( "Missing external reference \"" + *it + "\" in index" );
+        if ( ! ref.istype<messagedef> ( ) )
+            throw std::logic_error ( "Non-message external reference \"" + ref->idString ( ) + "\" in index" );
+
+        // Messages generated by this invocation are read from their proto file,
+        // the others are only included. Imported messages are also read from the
+        // file they were imported from.
+        const messagedef & message ( dynamic_cast<const messagedef &> ( *ref ) );
+        if ( message.isExtern ( ) )
+        {
+            const std::string header ( m_filenamegen.generate ( message, m_factory.hasHeaderFile ( ), false ) );
+            group.headers.insert ( header );
+            m_externals.insert ( header );
+
+            if ( ! message.sourceFile ( ).empty ( ) )
+            {
+                group.inputs.insert ( message.sourceFile ( ) );
+                m_imports.insert ( message.sourceFile ( ) );
+            }
+        }
+        else
+            addInput ( group, message );
+    }
+
+    if ( m_filenamegen.isAmalgamated ( ) )
+    {
+        outputgroup & amalgamation ( m_amalgamations [ m_filenamegen.amalgamation ( node ) ] );
+        amalgamation.inputs.insert ( group.inputs.begin ( ), group.inputs.end ( ) );
+        amalgamation.headers.insert ( group.headers.begin ( ), group.headers.end ( ) );
+    }
+    if ( ! group.outputs.empty ( ) )
+        m_groups.push_back ( group );
+}
+
+void astdependencies::walk ( namespacedef & node )
+{
+    if ( peekStack ( 1 ) )
+        throw std::invalid_argument ( "AST dependency collector only accepts a namespace at the top-level" );
+
+    for ( std::list<definition *>::const_iterator it ( node.content ( ).begin ( ) );
+          it != node.content ( ).end ( );
+          ++it )
+    {
+        if ( typeid ( **it ) != typeid ( messagedef ) )
+            continue;
+        messagedef & message ( dynamic_cast<messagedef &> ( **it ) );
+
+        if ( ! message.isExtern ( ) )
+            walk ( message );
+    }
+
+    for ( std::map<std::string, outputgroup>::iterator it ( m_amalgamations.begin ( ) ); it != m_amalgamations.end ( ); ++it )
+    {
+        it->second.outputs.push_back ( m_filenamegen.generate ( it->first, false, false ) );
+        m_outputs.push_back ( it->second.outputs.back ( ) );
+        m_groups.push_back ( it->second );
+    }
+    m_amalgamations.clear ( );
+
+    if ( m_registry )
+    {
+        // The registry covers every message, so depends on every input
+        outputgroup group;
+        addOutputs ( group, m_registry->asString ( "_" ) );
+        group.inputs.insert ( m_inputs.begin ( ), m_inputs.end ( ) );
+        m_groups.push_back ( group );
+    }
+}
+
+void astdependencies::addOutputs ( outputgroup & group, const std::string & name, bool impl )
+{
+    if ( m_factory.hasHeaderFile ( ) )
+        group.outputs.push_back ( m_filenamegen.generate ( name, true, false ) );
+    if ( impl )
+        group.outputs.push_back ( m_filenamegen.generate ( name, false, false ) );
+    m_outputs.insert ( m_outputs.end ( ), group.outputs.begin ( ), group.outputs.end ( ) );
+}
+
+void astdependencies::addInput ( outputgroup & group, const messagedef & message )
+{
+    // Messages that weren't parsed from a file could have come from any input
+    if ( message.sourceFile ( ).empty ( ) )
+        group.inputs.insert ( m_inputs.begin ( ), m_inputs.end ( ) );
+    else
+        group.inputs.insert ( message.sourceFile ( ) );
+}
+
+std::string astdependencies::escape ( const std::string & filename )
+{
+    // Make treats whitespace as a separator and expands dollars
+    std::string escaped;
+    for ( std::string::const_iterator it ( filename.begin ( ) ); it != filename.end ( ); ++it )
+    {
+        if ( *it == ' ' || *it == '\t' || *it == '#' )
+            escaped += '\\';
+        else if ( *it == '$' )
+            escaped += '$';
+        escaped += *it;
+    }
+    return escaped;
+}
+
@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_ASTDEPENDENCIES
+#define INC_FUDGEPROTO_ASTDEPENDENCIES
+
+#include "astextrefs.hpp"
+#include "astindex.hpp"
+#include "astwalker.hpp"
+#include "codewriterfactory.hpp"
+#include "filenamegenerator.hpp"
+#include <iosfwd>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace fudgeproto {
+
+// Collects the files that the generators will write for an AST, along with
+// the proto files they're generated from (those defining the message and any
+// messages it references) and the headers of any external messages they
+// include. These can then be written out as a manifest (one
+// output per line) or as a Make style dependency file, so a build system
+// only has to invoke the generator once per proto file.
+class astdependencies : public astwalker
+{
+    public:
+        astdependencies ( const astextrefs & extrefs,
+                          const astindex & index,
+                          const codewriterfactory & factory,
+                          const filenamegenerator & filenamegen,
+                          const std::vector<std::string> & inputs,
+                          const identifier * registry = 0 );
+        ~astdependencies ( );
+
+        inline const std::vector<std::string> & inputs ( ) const { return m_inputs; }
+        inline const std::vector<std::string> & outputs ( ) const { return m_outputs; }
+        inline const std::set<std::string> & externals ( ) const { return m_externals; }
+
+        void walk ( definition * node );
+        void reset ( );
+
+        void writeManifest ( std::ostream & output ) const;
+        void writeDepfile ( std::ostream & output ) const;
+
+    private:
+        struct outputgroup
+        {
+            std::vector<std::string> outputs;
+            std::set<std::string> inputs,
+                                  headers;
+        };
+
+        const astextrefs & m_extrefs;
+        const astindex & m_index;
+        const codewriterfactory & m_factory;
+        const filenamegenerator & m_filenamegen;
+        const std::vector<std::string> m_inputs;
+        identifier * m_registry;
+
+        std::vector<std::string> m_outputs;
+        std::set<std::string> m_externals,
+                              m_imports;
+        std::vector<outputgroup> m_groups;
+        std::map<std::string, outputgroup> m_amalgamations;
+
+        void walk ( enumdef & node );
+        void walk ( fielddef & node );
+        void walk ( messagedef & node );
+        void walk ( namespacedef & node );
+
+        void addOutputs ( outputgroup & group, const std::string & name, bool impl = true );
+        void addInput ( outputgroup & group, const messagedef & message );
+
+        static std::string escape ( const std::string & filename );
+};
+
+}
+
+#endif
+
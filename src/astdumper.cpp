@@ -29,8 +29,11 @@ astdumper::astdumper ( std::ostream & output )
 
 std::string astdumper::dumpIndex ( const astindex::definitionmap & index )
 {
+    astindex::sortedmap sorted;
+    astindex::sortByName ( index, sorted );
+
     std::ostringstream buffer;
-    for ( fudgeproto::astindex::definitionmapcit it ( index.begin ( ) ); it != index.end ( ); ++it )
+    for ( astindex::sortedmapcit it ( sorted.begin ( ) ); it != sorted.end ( ); ++it )
         buffer << "    " << it->first << " -> " << it->second << std::endl;
     return buffer.str ( );
 }
@@ -55,8 +58,15 @@ void astdumper::walk ( fielddef & node )
              << " " << node.idString ( );
     if ( node.hasOrdinal ( ) )
         m_output << " = " << node.ordinal ( );
-    if ( node.hasDefValue ( ) )
-        m_output << " [default=" << literalAsString ( node.defValue ( ) ) << "]";
+    if ( node.hasDefValue ( ) || node.options ( ) != FUDGEPROTO_OPTION_NONE )
+    {
+        std::list<std::string> options;
+        if ( node.hasDefValue ( ) )
+            options.push_back ( "default=" + literalAsString ( node.defValue ( ) ) );
+        if ( node.options ( ) != FUDGEPROTO_OPTION_NONE )
+            options.push_back ( optionAsString ( node.options ( ) ) );
+        m_output << " [" << join_any ( options.begin ( ), options.end ( ), "," ) << "]";
+    }
     m_output << " )" << std::endl;
 }
 
@@ -138,6 +148,17 @@ std::string astdumper::modifierAsString ( fudgeproto_modifier modifier )
     return join_any ( strings.begin ( ), strings.end ( ), " " );
 }
 
+std::string astdumper::optionAsString ( fudgeproto_option option )
+{
+    std::list<std::string> strings;
+    if ( option & FUDGEPROTO_OPTION_INLINE ) strings.push_back ( "inline" );
+    if ( option & FUDGEPROTO_OPTION_LAZY )   strings.push_back ( "lazy" );
+    if ( option & FUDGEPROTO_OPTION_PACKED ) strings.push_back ( "packed" );
+    if ( option & FUDGEPROTO_OPTION_POOLED ) strings.push_back ( "pooled" );
+    if ( option & FUDGEPROTO_OPTION_FLAT )   strings.push_back ( "flat" );
+    return join_any ( strings.begin ( ), strings.end ( ), "," );
+}
+
 std::string astdumper::constraintAsString ( const std::vector<int> & constraint )
 {
     std::vector<std::string> text ( constraint.size ( ) );
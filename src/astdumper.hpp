@@ -41,6 +41,7 @@ class astdumper : public astwalker
 
         std::string typeAsString ( const fieldtype & type );
         std::string modifierAsString ( fudgeproto_modifier modifier );
+        std::string optionAsString ( fudgeproto_option option );
         std::string constraintAsString ( const std::vector<int> & constraint );
         std::string literalAsString ( const literalvalue & value );
 
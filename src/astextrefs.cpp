@@ -15,19 +15,183 @@
  */
 
 #include "astextrefs.hpp"
-#include <deque>
-#include <iostream>
+#include <algorithm>
+#include <climits>
 #include <stdexcept>
 
 using namespace fudgeproto;
 
+namespace
+{
+    typedef std::vector<unsigned long> bitset;
+
+    const size_t bitsPerWord ( sizeof ( unsigned long ) * CHAR_BIT );
+    const size_t npos ( static_cast<size_t> ( -1 ) );
+
+    inline void setBit ( bitset & bits, size_t index )
+    {
+        bits [ index / bitsPerWord ] |= 1ul << ( index % bitsPerWord );
+    }
+
+    inline size_t lowestBit ( unsigned long word )
+    {
+#ifdef __GNUC__
+        return __builtin_ctzl ( word );
+#else
+        size_t index ( 0 );
+        for ( ; ! ( word & 1ul ); word >>= 1 )
+            ++index;
+        return index;
+#endif
+    }
+
+    // Lists the set bits a word at a time, so a sparse set is cheap to walk
+    void listBits ( const bitset & bits, std::vector<size_t> & indices )
+    {
+        indices.clear ( );
+        for ( size_t word ( 0 ); word < bits.size ( ); ++word )
+            for ( unsigned long remaining ( bits [ word ] ); remaining; remaining &= remaining - 1 )
+                indices.push_back ( word * bitsPerWord + lowestBit ( remaining ) );
+    }
+
+    void mergeBits ( bitset & target, const bitset & source )
+    {
+        for ( size_t index ( 0 ); index < target.size ( ); ++index )
+            target [ index ] |= source [ index ];
+    }
+
+    // Finds the strongly connected components of a graph using Tarjan's
+    // algorithm, without recursion so deep graphs can't overflow the stack.
+    // Components are numbered in reverse topological order: everything a
+    // component depends on has a lower number.
+    size_t findComponents ( const std::vector<std::vector<size_t> > & edges, std::vector<size_t> & components )
+    {
+        const size_t size ( edges.size ( ) );
+        std::vector<size_t> order ( size, npos ), lowlink ( size, 0 );
+        std::vector<bool> onstack ( size, false );
+        std::vector<size_t> stack;
+        std::vector<std::pair<size_t, size_t> > calls;
+        size_t counter ( 0 ), numcomponents ( 0 );
+
+        components.assign ( size, npos );
+        for ( size_t root ( 0 ); root < size; ++root )
+        {
+            if ( order [ root ] != npos )
+                continue;
+
+            calls.push_back ( std::make_pair ( root, 0 ) );
+            while ( ! calls.empty ( ) )
+            {
+                const size_t node ( calls.back ( ).first );
+                size_t & next ( calls.back ( ).second );
+                if ( ! next )
+                {
+                    order [ node ] = lowlink [ node ] = counter++;
+                    stack.push_back ( node );
+                    onstack [ node ] = true;
+                }
+
+                if ( next < edges [ node ].size ( ) )
+                {
+                    const size_t target ( edges [ node ] [ next++ ] );
+                    if ( order [ target ] == npos )
+                        calls.push_back ( std::make_pair ( target, 0 ) );
+                    else if ( onstack [ target ] )
+                        lowlink [ node ] = std::min ( lowlink [ node ], order [ target ] );
+                    continue;
+                }
+
+                // All edges followed - pop the component if this is its root
+                if ( lowlink [ node ] == order [ node ] )
+                {
+                    size_t member;
+                    do
+                    {
+                        member = stack.back ( );
+                        stack.pop_back ( );
+                        onstack [ member ] = false;
+                        components [ member ] = numcomponents;
+                    }
+                    while ( member != node );
+                    ++numcomponents;
+                }
+
+                calls.pop_back ( );
+                if ( ! calls.empty ( ) )
+                    lowlink [ calls.back ( ).first ] = std::min ( lowlink [ calls.back ( ).first ], lowlink [ node ] );
+            }
+        }
+        return numcomponents;
+    }
+}
+
 void astextrefs::load ( const stringsetmap & source )
 {
     m_refs = source;
-
     m_allrefs.clear ( );
+    m_dependents.clear ( );
+
+    // Number every message in the graph, by interned name
+    std::vector<symbol> names;
+    std::map<symbol, size_t> ids;
+    std::vector<std::vector<size_t> > edges;
     for ( stringsetmapcit it ( m_refs.begin ( ) ); it != m_refs.end ( ); ++it )
-        walkMessage ( it->first );
+    {
+        const size_t from ( addNode ( it->first, names, ids, edges ) );
+        for ( stringsetcit target ( it->second.begin ( ) ); target != it->second.end ( ); ++target )
+        {
+            const size_t to ( addNode ( *target, names, ids, edges ) );
+            edges [ from ].push_back ( to );
+        }
+    }
+
+    // The closure of each component is computed once, from those of the
+    // components it depends on, which have already been done
+    std::vector<size_t> components;
+    const size_t numcomponents ( findComponents ( edges, components ) );
+    std::vector<std::vector<size_t> > members ( numcomponents );
+    for ( size_t node ( 0 ); node < names.size ( ); ++node )
+        members [ components [ node ] ].push_back ( node );
+
+    const size_t words ( ( names.size ( ) + bitsPerWord - 1 ) / bitsPerWord );
+    std::vector<bitset> closures ( numcomponents, bitset ( words, 0 ) );
+    for ( size_t component ( 0 ); component < numcomponents; ++component )
+    {
+        bitset & closure ( closures [ component ] );
+        for ( std::vector<size_t>::const_iterator node ( members [ component ].begin ( ) ); node != members [ component ].end ( ); ++node )
+        {
+            for ( std::vector<size_t>::const_iterator target ( edges [ *node ].begin ( ) ); target != edges [ *node ].end ( ); ++target )
+            {
+                // Within a cycle every member reaches every other
+                setBit ( closure, *target );
+                if ( components [ *target ] != component )
+                    mergeBits ( closure, closures [ components [ *target ] ] );
+                else
+                    for ( std::vector<size_t>::const_iterator member ( members [ component ].begin ( ) ); member != members [ component ].end ( ); ++member )
+                        setBit ( closure, *member );
+            }
+        }
+    }
+
+    // Every message in the graph gets an entry, including those that only
+    // appear as references. Messages never list themselves as dependencies,
+    // even when in a cycle.
+    std::vector<size_t> targets;
+    for ( size_t component ( 0 ); component < numcomponents; ++component )
+    {
+        listBits ( closures [ component ], targets );
+        for ( std::vector<size_t>::const_iterator node ( members [ component ].begin ( ) ); node != members [ component ].end ( ); ++node )
+        {
+            stringset & refs ( m_allrefs [ *names [ *node ] ] );
+            for ( std::vector<size_t>::const_iterator target ( targets.begin ( ) ); target != targets.end ( ); ++target )
+            {
+                if ( *target == *node )
+                    continue;
+                refs.insert ( *names [ *target ] );
+                m_dependents [ *names [ *target ] ].insert ( *names [ *node ] );
+            }
+        }
+    }
 }
 
 void astextrefs::findAllrefs ( stringset & refs, const std::string & id ) const
@@ -39,26 +203,26 @@ void astextrefs::findAllrefs ( stringset & refs, const std::string & id ) const
         refs = it->second;
 }
 
-void astextrefs::walkMessage ( const std::string & toplevel )
+void astextrefs::findDependents ( stringset & dependents, const std::string & id ) const
 {
-    m_allrefs.insert ( std::make_pair ( toplevel, stringset ( ) ) );
+    stringsetmapcit it ( m_dependents.find ( id ) );
+    if ( it == m_dependents.end ( ) )
+        dependents.clear ( );
+    else
+        dependents = it->second;
+}
 
-    std::deque<std::string> queue;
-    std::set<std::string> visited;
-    queue.push_back ( toplevel );
-    while ( ! queue.empty ( ) )
+size_t astextrefs::addNode ( const std::string & name,
+                             std::vector<symbol> & names,
+                             std::map<symbol, size_t> & ids,
+                             std::vector<std::vector<size_t> > & edges )
+{
+    const symbol key ( symboltable::intern ( name ) );
+    std::pair<std::map<symbol, size_t>::iterator, bool> result ( ids.insert ( std::make_pair ( key, names.size ( ) ) ) );
+    if ( result.second )
     {
-        const std::string id ( queue.front ( ) );
-        queue.pop_front ( );
-        if ( ! visited.insert ( id ).second )
-            continue;
-
-        if ( id != toplevel )
-            m_allrefs [ toplevel ].insert ( id );
-
-        const std::set<std::string> & deps ( m_refs [ id ] );
-        queue.insert ( queue.end ( ), deps.begin ( ), deps.end ( ) );
+        names.push_back ( key );
+        edges.push_back ( std::vector<size_t> ( ) );
     }
+    return result.first->second;
 }
-
-
@@ -17,9 +17,11 @@
 #ifndef INC_FUDGEPROTO_ASTEXTREFS
 #define INC_FUDGEPROTO_ASTEXTREFS
 
+#include "symboltable.hpp"
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
 
 namespace fudgeproto {
 
@@ -33,14 +35,23 @@ class astextrefs
 
         void load ( const stringsetmap & source );
 
+        // Every message that each message depends on, directly or not
         inline const stringsetmap & allrefs ( ) const { return m_allrefs; }
         void findAllrefs ( stringset & refs, const std::string & id ) const;
 
+        // Every message that depends on each message, directly or not
+        inline const stringsetmap & dependents ( ) const { return m_dependents; }
+        void findDependents ( stringset & dependents, const std::string & id ) const;
+
     private:
         stringsetmap m_refs,
-                     m_allrefs;
+                     m_allrefs,
+                     m_dependents;
 
-        void walkMessage ( const std::string & toplevel );
+        static size_t addNode ( const std::string & name,
+                                std::vector<symbol> & names,
+                                std::map<symbol, size_t> & ids,
+                                std::vector<std::vector<size_t> > & edges );
 };
 
 }
@@ -47,16 +47,41 @@ void astextresolver::walk ( enumdef & node )
 
 void astextresolver::walk ( fielddef & node )
 {
-    if ( node.type ( ).type ( ) == FUDGEPROTO_TYPE_USER )
-        addExternalReference ( node.type ( ).def ( ), *peekStack ( 1 ) );
+    throw std::domain_error ( "Field walker not implemented in resolver" );
 }
 
 void astextresolver::walk ( messagedef & node )
+{
+    addReferences ( node );
+    walkCollection ( node.messages ( ) );
+}
+
+void astextresolver::walk ( namespacedef & node )
+{
+    if ( peekStack ( 1 ) || node.hasId ( ) )
+        throw std::invalid_argument ( "AST extern resolver should only be passed an anonymous namespace at the top-level" );
+
+    walkCollection ( node.content ( ) );
+}
+
+void astextresolver::resolveIndex ( )
+{
+    // The index holds every message, nested or not, that the walk would
+    // visit. They're taken in name order so that any error is stable.
+    astindex::sortedmap messages;
+    astindex::sortByName ( m_index.messageMap ( ), messages );
+    m_references.clear ( );
+    for ( astindex::sortedmapcit it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        addReferences ( dynamic_cast<const messagedef &> ( *it->second ) );
+    m_extrefs.load ( m_references );
+}
+
+void astextresolver::addReferences ( const messagedef & node )
 {
     for ( size_t index ( 0 ); index < node.parents ( ).size ( ); ++index )
     {
-        const std::string id ( node.parents ( ) [ index ]->asString ( "." ) );
-        const definition * parent ( m_index.find ( id ) );
+        const std::string & id ( node.parents ( ) [ index ]->dotted ( ) );
+        const definition * parent ( m_index.find ( *node.parents ( ) [ index ] ) );
         if ( ! parent )
             throw std::logic_error ( "Cannot find parent \"" + id +
                                      "\" for message \"" + node.idString ( ) + "\"" );
@@ -65,18 +90,12 @@ void astextresolver::walk ( messagedef & node )
                                      "\" as parent of \"" + node.idString ( ) + "\"" );
 
         addExternalReference ( *parent, node );
+        refcounted::dec ( parent );
     }
 
-    walkCollection ( node.messages ( ) );
-    walkCollection ( node.fields ( ) );
-}
-
-void astextresolver::walk ( namespacedef & node )
-{
-    if ( peekStack ( 1 ) || node.hasId ( ) )
-        throw std::invalid_argument ( "AST extern resolver should only be passed an anonymous namespace at the top-level" );
-
-    walkCollection ( node.content ( ) );
+    for ( std::list<fielddef *>::const_iterator it ( node.fields ( ).begin ( ) ); it != node.fields ( ).end ( ); ++it )
+        if ( ( *it )->type ( ).type ( ) == FUDGEPROTO_TYPE_USER )
+            addExternalReference ( ( *it )->type ( ).def ( ), node );
 }
 
 void astextresolver::addExternalReference ( const definition & target, const definition & message )
@@ -87,7 +106,7 @@ void astextresolver::addExternalReference ( const definition & target, const def
         id->pop ( );
 
     // Find the message type corresponding to the identifier
-    const definition * type ( m_index.find ( id->asString ( "." ) ) );
+    const definition * type ( m_index.find ( *id ) );
     if ( ! type )
         throw std::logic_error ( "Cannot add unknown external reference \"" + id->asString ( "." ) +
                                  "\" to message \"" + message.idString ( ) + "\"" );
@@ -109,7 +128,7 @@ bool astextresolver::isParentMessage ( const definition & type )
 {
     identifier * parent ( type.id ( ).clone ( ) );
     parent->pop ( );
-    const std::string parentid ( parent->asString ( "." ) );
+    const symbol parentid ( parent->key ( ) );
     refcounted::dec ( parent );
 
     return  m_index.messageMap ( ).find ( parentid ) != m_index.messageMap ( ).end ( );
@@ -32,6 +32,10 @@ class astextresolver : public astwalker
         void walk ( definition * node );
         void reset ( );
 
+        // Collects the references of every indexed message, without walking
+        // the tree. Can be used once the index is final.
+        void resolveIndex ( );
+
     private:
         astextrefs & m_extrefs;
         const astindex & m_index;
@@ -42,6 +46,7 @@ class astextresolver : public astwalker
         void walk ( messagedef & node );
         void walk ( namespacedef & node );
 
+        void addReferences ( const messagedef & node );
         void addExternalReference ( const definition & target, const definition & message );
 
         bool isParentMessage ( const definition & type );
@@ -0,0 +1,42 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "astfinaliser.hpp"
+
+using namespace fudgeproto;
+
+astfinaliser::astfinaliser ( astextrefs & extrefs,
+                             astindex & index,
+                             identifiermutator & mutator )
+    : astaliaser ( index, mutator )
+    , m_extresolver ( extrefs, index )
+{
+}
+
+void astfinaliser::walk ( definition * node )
+{
+    astaliaser::walk ( node );
+
+    if ( ! peekStack ( ) )
+        m_extresolver.resolveIndex ( );
+}
+
+void astfinaliser::reset ( )
+{
+    astaliaser::reset ( );
+    m_extresolver.reset ( );
+}
@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_ASTFINALISER
+#define INC_FUDGEPROTO_ASTFINALISER
+
+#include "astaliaser.hpp"
+#include "astextresolver.hpp"
+
+namespace fudgeproto {
+
+// Runs the aliaser, then collects the external references from the index
+// rather than walking the tree again.
+class astfinaliser : public astaliaser
+{
+    public:
+        astfinaliser ( astextrefs & extrefs,
+                       astindex & index,
+                       identifiermutator & mutator );
+
+        void walk ( definition * node );
+        void reset ( );
+
+    private:
+        astextresolver m_extresolver;
+};
+
+}
+
+#endif
@@ -30,7 +30,7 @@ namespace
 
 void astflattener::walk ( definition * node )
 {
-    if ( node && ( node->hasId ( ) ^ peekStack ( ) != 0 ) )
+    if ( node && ( node->hasId ( ) ^ ( peekStack ( ) != 0 ) ) )
         throw std::runtime_error ( "Cannot flatten an id-less node below the top-level" );
 
     astwalker::walk ( node );
@@ -15,44 +15,131 @@
  */
 
 #include "astgenerator.hpp"
-#include <fstream>
+#include "config.h"
+#include "outputfile.hpp"
 #include <iostream>
+#include <map>
 #include <stdexcept>
+#include <typeinfo>
+
+// Parallel generation relies on the AST reference counts being atomic
+#if defined(HAS_PTHREADS) && defined(HAS_ATOMIC_BUILTINS)
+#define FUDGEPROTO_PARALLEL_GENERATOR
+#include <pthread.h>
+#endif
 
 using namespace fudgeproto;
 
+namespace
+{
+    typedef std::map<std::string, const definition *> toplevelmap;
+
+    // Maps every message, nested or not, to the top-level message containing
+    // it, and collects those defined in any of the given files
+    void mapMessages ( const messagedef & message,
+                       const definition * top,
+                       const std::set<std::string> & filenames,
+                       toplevelmap & toplevel,
+                       astextrefs::stringset & found )
+    {
+        toplevel [ message.idString ( ) ] = top;
+        if ( filenames.count ( message.sourceFile ( ) ) )
+            found.insert ( message.idString ( ) );
+
+        const std::list<messagedef *> messages ( message.messages ( ) );
+        for ( std::list<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+            mapMessages ( **it, top, filenames, toplevel, found );
+    }
+}
+
+#ifdef FUDGEPROTO_PARALLEL_GENERATOR
+struct astgenerator::workqueue
+{
+    workqueue ( const astgenerator & owner, const std::vector<messagedef *> & messages )
+        : owner ( owner )
+        , messages ( messages )
+        , next ( 0 )
+    {
+        pthread_mutex_init ( &mutex, 0 );
+    }
+
+    ~workqueue ( )
+    {
+        pthread_mutex_destroy ( &mutex );
+    }
+
+    messagedef * pop ( )
+    {
+        pthread_mutex_lock ( &mutex );
+        messagedef * message ( error.empty ( ) && next < messages.size ( ) ? messages [ next++ ] : 0 );
+        pthread_mutex_unlock ( &mutex );
+        return message;
+    }
+
+    void fail ( const std::string & what )
+    {
+        pthread_mutex_lock ( &mutex );
+        if ( error.empty ( ) )
+            error = what;
+        pthread_mutex_unlock ( &mutex );
+    }
+
+    const astgenerator & owner;
+    const std::vector<messagedef *> & messages;
+    size_t next;
+    std::string error;
+    pthread_mutex_t mutex;
+};
+#endif
+
 astgenerator::astgenerator ( const astextrefs & extrefs,
                              const astindex & index,
                              const codewriterfactory & factory,
-                             const filenamegenerator & filenamegen )
+                             const filenamegenerator & filenamegen,
+                             size_t jobs )
     : m_extrefs ( extrefs )
     , m_index ( index )
     , m_factory ( factory )
     , m_filenamegen ( filenamegen )
+    , m_jobs ( jobs ? jobs : 1 )
+    , m_incremental ( false )
 {
 }
 
-void astgenerator::walkTopLevelMessage ( messagedef & node )
+bool astgenerator::isParallel ( )
 {
-    std::ofstream output;
-    output.exceptions ( std::ios::failbit | std::ios::badbit );
+#ifdef FUDGEPROTO_PARALLEL_GENERATOR
+    return true;
+#else
+    return false;
+#endif
+}
 
+void astgenerator::setChangedFiles ( const std::set<std::string> & filenames )
+{
+    m_incremental = true;
+    m_changedFiles = filenames;
+}
+
+void astgenerator::walkTopLevelMessage ( messagedef & node )
+{
+    // Amalgamated implementations are written once every header is done
     if ( m_factory.hasHeaderFile ( ) )
-    {
-        output.open ( m_filenamegen.generate ( node, true, false ).c_str ( ) );
-        m_writer.reset ( m_factory.headerWriter ( output ) );
-        startFile ( node );
-        walk ( node );
-        endFile ( node );
-        output.close ( );
-    }
+        generateFile ( node, true );
+    if ( ! m_filenamegen.isAmalgamated ( ) )
+        generateFile ( node, false );
+}
 
-    output.open ( m_filenamegen.generate ( node, false, false ).c_str ( ) );
-    m_writer.reset ( m_factory.implWriter ( output ) );
+void astgenerator::generateFile ( messagedef & node, bool header )
+{
+    outputfile output ( m_filenamegen.generate ( node, header, false ) );
+    m_writer.reset ( header ? m_factory.headerWriter ( output.stream ( ) )
+                            : m_factory.implWriter ( output.stream ( ) ) );
     startFile ( node );
     walk ( node );
     endFile ( node );
-    output.close ( );
+    m_writer.reset ( );
+    output.commit ( );
 }
 
 void astgenerator::walk ( enumdef & node )
@@ -80,6 +167,7 @@ void astgenerator::walk ( namespacedef & node )
         throw std::invalid_argument ( "AST generator only accepts a namespace at the top-level" );
 
     namespacedef & ns ( dynamic_cast<namespacedef &> ( node ) );
+    std::vector<messagedef *> messages;
     for ( std::list<definition *>::const_iterator it ( ns.content ( ).begin ( ) );
           it != ns.content ( ).end ( );
           ++it )
@@ -89,8 +177,155 @@ void astgenerator::walk ( namespacedef & node )
         messagedef & message ( dynamic_cast<messagedef &> ( **it ) );
 
         if ( ! message.isExtern ( ) )
-            walkTopLevelMessage ( message );
+            messages.push_back ( &message );
+    }
+
+    std::vector<messagedef *> selected ( messages );
+    if ( m_incremental )
+        selectChanged ( ns, selected );
+    walkTopLevelMessages ( selected );
+    if ( m_filenamegen.isAmalgamated ( ) )
+        generateAmalgamations ( messages, selected );
+}
+
+void astgenerator::walkTopLevelMessages ( const std::vector<messagedef *> & messages )
+{
+#ifdef FUDGEPROTO_PARALLEL_GENERATOR
+    if ( m_jobs > 1 && messages.size ( ) > 1 )
+    {
+        // Each top-level message is written to its own files, so once resolved they
+        // can be generated independently. Each worker has its own generator and so
+        // its own writer.
+        workqueue queue ( *this, messages );
+        std::vector<pthread_t> threads;
+        const size_t numthreads ( std::min ( m_jobs, messages.size ( ) ) );
+        for ( size_t index ( 0 ); index < numthreads; ++index )
+        {
+            pthread_t thread;
+            if ( pthread_create ( &thread, 0, &astgenerator::worker, &queue ) )
+            {
+                queue.fail ( "Failed to start code generator thread" );
+                break;
+            }
+            threads.push_back ( thread );
+        }
+
+        for ( std::vector<pthread_t>::iterator it ( threads.begin ( ) ); it != threads.end ( ); ++it )
+            pthread_join ( *it, 0 );
+
+        if ( ! queue.error.empty ( ) )
+            throw std::runtime_error ( queue.error );
+        return;
+    }
+#endif
+
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        walkTopLevelMessage ( **it );
+}
+
+void astgenerator::generateAmalgamations ( const std::vector<messagedef *> & messages,
+                                          const std::vector<messagedef *> & selected )
+{
+    // Each amalgamation holds every message that belongs in it, so has to be
+    // rewritten if any one of them is
+    typedef std::map<std::string, std::vector<messagedef *> > groupmap;
+    groupmap groups;
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        groups [ m_filenamegen.amalgamation ( **it ) ].push_back ( *it );
+
+    std::set<std::string> changed;
+    for ( std::vector<messagedef *>::const_iterator it ( selected.begin ( ) ); it != selected.end ( ); ++it )
+        changed.insert ( m_filenamegen.amalgamation ( **it ) );
+
+    for ( groupmap::const_iterator it ( groups.begin ( ) ); it != groups.end ( ); ++it )
+        if ( changed.count ( it->first ) )
+            generateAmalgamation ( it->first, it->second );
+}
+
+void astgenerator::generateAmalgamation ( const std::string & name, const std::vector<messagedef *> & messages )
+{
+    outputfile output ( m_filenamegen.generate ( name, false, false ) );
+    m_writer.reset ( m_factory.implWriter ( output.stream ( ) ) );
+    m_writer->amalgamationHeader ( std::vector<const messagedef *> ( messages.begin ( ), messages.end ( ) ), m_filenamegen );
+
+    // The headers of the messages themselves have already been included
+    std::set<std::string> used;
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+    {
+        std::set<std::string> defined, declared, refids;
+        collectExternals ( **it, defined, declared, refids );
+        used.insert ( refids.begin ( ), refids.end ( ) );
     }
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        used.erase ( ( *it )->idString ( ) );
+    writeExternals ( std::set<std::string> ( ), std::set<std::string> ( ), used );
+    m_writer->includeStandard ( );
+
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+    {
+        refptr<identifier> ns ( ( *it )->id ( ).clone ( ) );
+        ns->pop ( );
+        m_writer->startNamespace ( *ns );
+        walk ( **it );
+        m_writer->endNamespace ( *ns );
+    }
+    m_writer.reset ( );
+    output.commit ( );
+}
+
+void astgenerator::selectChanged ( const namespacedef & node, std::vector<messagedef *> & messages ) const
+{
+    // Find the messages, nested or not, that came from the changed files. This
+    // includes the extern stubs of imported files.
+    toplevelmap toplevel;
+    astextrefs::stringset changed;
+    for ( std::list<definition *>::const_iterator it ( node.content ( ).begin ( ) ); it != node.content ( ).end ( ); ++it )
+        if ( typeid ( **it ) == typeid ( messagedef ) )
+            mapMessages ( dynamic_cast<const messagedef &> ( **it ), *it, m_changedFiles, toplevel, changed );
+
+    // Anything that refers to a changed message, directly or not, must also
+    // be regenerated. Code is generated per top-level message.
+    std::set<const definition *> selected;
+    astextrefs::stringset dependents;
+    for ( astextrefs::stringsetcit it ( changed.begin ( ) ); it != changed.end ( ); ++it )
+    {
+        selected.insert ( toplevel [ *it ] );
+        m_extrefs.findDependents ( dependents, *it );
+        for ( astextrefs::stringsetcit dependent ( dependents.begin ( ) ); dependent != dependents.end ( ); ++dependent )
+        {
+            const toplevelmap::const_iterator top ( toplevel.find ( *dependent ) );
+            if ( top != toplevel.end ( ) )
+                selected.insert ( top->second );
+        }
+    }
+
+    std::vector<messagedef *> result;
+    for ( std::vector<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        if ( selected.count ( *it ) )
+            result.push_back ( *it );
+    messages.swap ( result );
+}
+
+void * astgenerator::worker ( void * queue )
+{
+#ifdef FUDGEPROTO_PARALLEL_GENERATOR
+    workqueue & work ( *static_cast<workqueue *> ( queue ) );
+    try
+    {
+        astgenerator generator ( work.owner.m_extrefs, work.owner.m_index, work.owner.m_factory, work.owner.m_filenamegen );
+        while ( messagedef * message = work.pop ( ) )
+            generator.walkTopLevelMessage ( *message );
+    }
+    catch ( const std::exception & exception )
+    {
+        work.fail ( exception.what ( ) );
+    }
+    catch ( ... )
+    {
+        work.fail ( "Unknown error in code generator thread" );
+    }
+#endif
+    return 0;
 }
 
 void astgenerator::startFile ( messagedef & node )
@@ -115,19 +350,102 @@ void astgenerator::endFile ( messagedef & node )
 
 void astgenerator::includeExternal ( messagedef & node )
 {
-    astextrefs::stringset refids;
-    m_extrefs.findAllrefs ( refids, node.idString ( ) );
-    for ( astextrefs::stringsetcit it ( refids.begin ( ) ); it != refids.end ( ); ++it )
+    std::set<std::string> defined, declared, used;
+    collectExternals ( node, defined, declared, used );
+    writeExternals ( defined, declared, used );
+}
+
+void astgenerator::collectExternals ( const messagedef & node,
+                                      std::set<std::string> & defined,
+                                      std::set<std::string> & declared,
+                                      std::set<std::string> & used ) const
+{
+    collectReferences ( node, node, defined, declared, used );
+    used.insert ( defined.begin ( ), defined.end ( ) );
+    used.insert ( declared.begin ( ), declared.end ( ) );
+    used.erase ( node.idString ( ) );
+}
+
+void astgenerator::collectReferences ( const messagedef & top,
+                                       const messagedef & message,
+                                       std::set<std::string> & defined,
+                                       std::set<std::string> & declared,
+                                       std::set<std::string> & used ) const
+{
+    // A message's header needs the definitions of its parents and of any
+    // message owning a type it uses that can't be declared on its own; other
+    // messages are only held through pointers, so a declaration will do
+    std::string id;
+    for ( size_t index ( 0 ); index < message.parents ( ).size ( ); ++index )
     {
-        refptr<const definition> ref ( m_index.find ( *it ) );
-        if ( ! ref )
-            throw std::logic_error ( "Missing external reference \"" + *it + "\" in index" );
-        if ( ! ref.istype<messagedef> ( ) )
-            throw std::logic_error ( "Non-message external reference \"" + ref->idString ( ) + "\" in index" );
+        findTopLevel ( findMessage ( message.parents ( ) [ index ]->dotted ( ) ), id );
+        if ( id != top.idString ( ) )
+            defined.insert ( id );
+    }
+
+    for ( std::list<fielddef *>::const_iterator it ( message.fields ( ).begin ( ) ); it != message.fields ( ).end ( ); ++it )
+    {
+        if ( ( *it )->type ( ).type ( ) != FUDGEPROTO_TYPE_USER )
+            continue;
+        const bool complete ( findTopLevel ( ( *it )->type ( ).def ( ), id ) );
+        if ( id != top.idString ( ) )
+            ( complete ? defined : declared ).insert ( id );
+    }
+
+    const std::list<messagedef *> messages ( message.messages ( ) );
+    for ( std::list<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        collectReferences ( top, **it, defined, declared, used );
 
-        m_writer->includeExternal ( dynamic_cast<const messagedef &> ( *ref ), m_filenamegen );
+    // The implementation uses everything the message depends on, not just the
+    // messages it refers to directly
+    astextrefs::stringset refids;
+    m_extrefs.findAllrefs ( refids, message.idString ( ) );
+    used.insert ( refids.begin ( ), refids.end ( ) );
+}
+
+void astgenerator::writeExternals ( const std::set<std::string> & defined,
+                                    const std::set<std::string> & declared,
+                                    const std::set<std::string> & used )
+{
+    for ( std::set<std::string>::const_iterator it ( defined.begin ( ) ); it != defined.end ( ); ++it )
+        m_writer->includeExternal ( findMessage ( *it ), m_filenamegen );
+    for ( std::set<std::string>::const_iterator it ( used.begin ( ) ); it != used.end ( ); ++it )
+        if ( ! defined.count ( *it ) )
+            m_writer->declareExternal ( findMessage ( *it ), m_filenamegen, declared.count ( *it ) );
+
+    m_writer->endOfExternals ( used.size ( ) );
+}
+
+bool astgenerator::findTopLevel ( const definition & type, std::string & top ) const
+{
+    // Enums and nested messages can't be declared outside of the message
+    // containing them, so that has to be defined
+    refptr<identifier> id ( type.id ( ).clone ( ) );
+    bool complete ( typeid ( type ) == typeid ( enumdef ) );
+    if ( complete )
+        id->pop ( );
+
+    top = id->dotted ( );
+    while ( id->size ( ) > 1 )
+    {
+        id->pop ( );
+        refptr<const definition> outer ( m_index.find ( *id ) );
+        if ( ! outer || ! outer.istype<messagedef> ( ) )
+            break;
+        top = id->dotted ( );
+        complete = true;
     }
+    return complete;
+}
 
-    m_writer->endOfExternals ( refids.size ( ) );
+const messagedef & astgenerator::findMessage ( const std::string & id ) const
+{
+    // The index keeps the definition alive, so the reference can be dropped
+    refptr<const definition> ref ( m_index.find ( id ) );
+    if ( ! ref )
+        throw std::logic_error ( "Missing external reference \"" + id + "\" in index" );
+    if ( ! ref.istype<messagedef> ( ) )
+        throw std::logic_error ( "Non-message external reference \"" + ref->idString ( ) + "\" in index" );
+    return dynamic_cast<const messagedef &> ( *ref );
 }
 
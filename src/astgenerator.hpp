@@ -23,6 +23,8 @@
 #include "filenamegenerator.hpp"
 #include "codewriterfactory.hpp"
 #include <memory>
+#include <set>
+#include <vector>
 
 namespace fudgeproto {
 
@@ -32,17 +34,37 @@ class astgenerator : public astwalker
         astgenerator ( const astextrefs & extrefs,
                        const astindex & index,
                        const codewriterfactory & factory,
-                       const filenamegenerator & filenamegen );
+                       const filenamegenerator & filenamegen,
+                       size_t jobs = 1 );
+
+        static bool isParallel ( );
+
+        // Only generates code for messages defined in the given files, and for
+        // the messages that depend on them
+        void setChangedFiles ( const std::set<std::string> & filenames );
 
     private:
+        struct workqueue;
+
         const astextrefs & m_extrefs;
         const astindex & m_index;
         const codewriterfactory & m_factory;
         const filenamegenerator & m_filenamegen;
+        const size_t m_jobs;
+        bool m_incremental;
+        std::set<std::string> m_changedFiles;
 
         std::auto_ptr<codewriter> m_writer;
 
         void walkTopLevelMessage ( messagedef & node );
+        void generateFile ( messagedef & node, bool header );
+        void walkTopLevelMessages ( const std::vector<messagedef *> & messages );
+        void generateAmalgamations ( const std::vector<messagedef *> & messages,
+                                     const std::vector<messagedef *> & selected );
+        void generateAmalgamation ( const std::string & name, const std::vector<messagedef *> & messages );
+        void selectChanged ( const namespacedef & node, std::vector<messagedef *> & messages ) const;
+
+        static void * worker ( void * queue );
 
         void walk ( enumdef & node );
         void walk ( fielddef & node );
@@ -53,6 +75,20 @@ class astgenerator : public astwalker
         void endFile ( messagedef & node );
 
         void includeExternal ( messagedef & node );
+        void collectExternals ( const messagedef & node,
+                                std::set<std::string> & defined,
+                                std::set<std::string> & declared,
+                                std::set<std::string> & used ) const;
+        void collectReferences ( const messagedef & top,
+                                 const messagedef & message,
+                                 std::set<std::string> & defined,
+                                 std::set<std::string> & declared,
+                                 std::set<std::string> & used ) const;
+        void writeExternals ( const std::set<std::string> & defined,
+                              const std::set<std::string> & declared,
+                              const std::set<std::string> & used );
+        bool findTopLevel ( const definition & type, std::string & top ) const;
+        const messagedef & findMessage ( const std::string & id ) const;
 };
 
 }
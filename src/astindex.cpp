@@ -19,7 +19,11 @@
 
 using namespace fudgeproto;
 
+const size_t astindex::npos ( static_cast<size_t> ( -1 ) );
+
 astindex::astindex ( )
+    : m_scopeNodes ( 1, static_cast<const definition *> ( 0 ) )
+    , m_numScopeEdges ( 0 )
 {
 }
 
@@ -37,6 +41,7 @@ void astindex::load ( const definitionmap & source )
         else
             throw std::runtime_error ( "Index only accepts enum and messages" );
 
+        addScoped ( it->second->id ( ), it->second );
         refcounted::inc ( it->second );
     }
 }
@@ -45,11 +50,16 @@ void astindex::reset ( )
 {
     decrementMap ( m_enums );
     decrementMap ( m_messages );
+    m_scopeNodes.assign ( 1, static_cast<const definition *> ( 0 ) );
+    m_scopeEdges.clear ( );
+    m_numScopeEdges = 0;
 }
 
-const definition * astindex::find ( const std::string & id ) const
+const definition * astindex::find ( symbol id ) const
 {
     definition * result ( 0 );
+    if ( ! id )
+        return result;
 
     definitionmapcit it ( m_enums.find ( id ) );
     if ( it != m_enums.end ( ) )
@@ -61,7 +71,7 @@ const definition * astindex::find ( const std::string & id ) const
     return result;
 }
 
-void astindex::replace ( const std::string & oldid, definition * def )
+void astindex::replace ( symbol oldid, definition * def )
 {
     definitionmap * map;
     if (      typeid ( *def ) == typeid ( enumdef ) )    map = &m_enums;
@@ -71,13 +81,111 @@ void astindex::replace ( const std::string & oldid, definition * def )
 
     definitionmapit it ( map->find ( oldid ) );
     if ( it == map->end ( ) )
-        throw std::runtime_error ( "Index cannot replace key \"" + oldid + "\" with \"" +
+        throw std::runtime_error ( "Index cannot replace key \"" + *oldid + "\" with \"" +
                                    def->idString ( ) + "\", not found in index" );
 
     map->erase ( it );
-    if ( ! map->insert ( std::make_pair ( def->idString ( ), def ) ).second )
+    if ( ! map->insert ( std::make_pair ( def->id ( ).key ( ), def ) ).second )
         throw std::runtime_error ( "Index failed to insert replacement key \"" + def->idString ( ) +
                                    "\", collision occurred" );
+
+    // The old node is left in the trie, without a definition
+    refptr<identifier> oldname ( identifier::createFromString ( *oldid, "." ) );
+    const size_t oldnode ( findNode ( 0, *oldname ) );
+    if ( oldnode != npos )
+        m_scopeNodes [ oldnode ] = 0;
+    addScoped ( def->id ( ), def );
+}
+
+const definition * astindex::findScoped ( const identifier & id, const identifier & scope ) const
+{
+    // Collect the node of each enclosing scope, which will all exist if the
+    // scope is itself indexed
+    std::vector<size_t> scopes ( 1, 0 );
+    scopes.reserve ( scope.size ( ) + 1 );
+    for ( size_t index ( 0 ); index < scope.size ( ); ++index )
+    {
+        const size_t node ( findChild ( scopes.back ( ), scope.symbolAt ( index ) ) );
+        if ( node == npos )
+            break;
+        scopes.push_back ( node );
+    }
+
+    // Absolute names take precedence, then the innermost scope
+    const definition * result ( 0 );
+    size_t node ( findNode ( 0, id ) );
+    if ( node != npos )
+        result = m_scopeNodes [ node ];
+    for ( size_t index ( scopes.size ( ) - 1 ); ! result && index > 0; --index )
+    {
+        if ( ( node = findNode ( scopes [ index ], id ) ) != npos )
+            result = m_scopeNodes [ node ];
+    }
+
+    refcounted::inc ( result );
+    return result;
+}
+
+void astindex::addScoped ( const identifier & id, const definition * def )
+{
+    size_t node ( 0 );
+    for ( size_t index ( 0 ); index < id.size ( ); ++index )
+    {
+        size_t child ( findChild ( node, id.symbolAt ( index ) ) );
+        if ( child == npos )
+        {
+            // Keep the table at most half full
+            if ( ( m_numScopeEdges + 1 ) * 2 > m_scopeEdges.size ( ) )
+                growEdges ( );
+
+            child = m_scopeNodes.size ( );
+            m_scopeNodes.push_back ( 0 );
+            scopeedge & edge ( m_scopeEdges [ edgeSlot ( node, id.symbolAt ( index ) ) ] );
+            edge.parent = node;
+            edge.element = id.symbolAt ( index );
+            edge.child = child;
+            ++m_numScopeEdges;
+        }
+        node = child;
+    }
+    m_scopeNodes [ node ] = def;
+}
+
+size_t astindex::findChild ( size_t parent, symbol element ) const
+{
+    if ( m_scopeEdges.empty ( ) )
+        return npos;
+    return m_scopeEdges [ edgeSlot ( parent, element ) ].child;
+}
+
+size_t astindex::findNode ( size_t parent, const identifier & id ) const
+{
+    for ( size_t index ( 0 ); index < id.size ( ) && parent != npos; ++index )
+        parent = findChild ( parent, id.symbolAt ( index ) );
+    return parent;
+}
+
+// Returns the slot holding the edge, or the empty slot it would go in
+size_t astindex::edgeSlot ( size_t parent, symbol element ) const
+{
+    const size_t mask ( m_scopeEdges.size ( ) - 1 );
+    size_t slot ( ( reinterpret_cast<size_t> ( element ) / sizeof ( void * ) + parent * 0x9e3779b9u ) & mask );
+    while ( m_scopeEdges [ slot ].element &&
+            ( m_scopeEdges [ slot ].parent != parent || m_scopeEdges [ slot ].element != element ) )
+        slot = ( slot + 1 ) & mask;
+    return slot;
+}
+
+void astindex::growEdges ( )
+{
+    std::vector<scopeedge> old;
+    old.swap ( m_scopeEdges );
+
+    const scopeedge empty = { 0, 0, npos };
+    m_scopeEdges.assign ( old.empty ( ) ? 64 : old.size ( ) * 2, empty );
+    for ( std::vector<scopeedge>::const_iterator it ( old.begin ( ) ); it != old.end ( ); ++it )
+        if ( it->element )
+            m_scopeEdges [ edgeSlot ( it->parent, it->element ) ] = *it;
 }
 
 void astindex::decrementMap ( definitionmap & map )
@@ -87,3 +195,9 @@ void astindex::decrementMap ( definitionmap & map )
     map.clear ( );
 }
 
+void astindex::sortByName ( const definitionmap & map, sortedmap & sorted )
+{
+    for ( definitionmapcit it ( map.begin ( ) ); it != map.end ( ); ++it )
+        sorted [ *it->first ] = it->second;
+}
+
@@ -19,25 +19,39 @@
 
 #include "ast.hpp"
 #include <set>
+#include <vector>
 
 namespace fudgeproto {
 
 class astindex
 {
     public:
-        typedef std::map<std::string, definition *> definitionmap;
+        // Keyed by the interned dotted name of each definition
+        typedef std::map<symbol, definition *> definitionmap;
         typedef definitionmap::iterator definitionmapit;
         typedef definitionmap::const_iterator definitionmapcit;
 
+        // The maps are ordered by symbol address, which can differ between
+        // runs, so anything whose output must be stable sorts by name
+        typedef std::map<std::string, definition *> sortedmap;
+        typedef sortedmap::const_iterator sortedmapcit;
+
         astindex ( );
         ~astindex ( );
 
         void load ( const definitionmap & source );
         void reset ( );
 
-        const definition * find ( const std::string & id ) const;
+        const definition * find ( symbol id ) const;
+        inline const definition * find ( const identifier & id ) const { return find ( id.key ( ) ); }
+        inline const definition * find ( const std::string & id ) const { return find ( symboltable::find ( id ) ); }
+
+        // Resolves a name as written within a scope. The name is tried as
+        // absolute first, then relative to each enclosing scope from the
+        // innermost outwards.
+        const definition * findScoped ( const identifier & id, const identifier & scope ) const;
 
-        void replace ( const std::string & oldid, definition * def );
+        void replace ( symbol oldid, definition * def );
 
         inline size_t numEnums ( ) const { return m_enums.size ( ); }
         inline size_t numMessages ( ) const { return m_messages.size ( ); }
@@ -46,10 +60,32 @@ class astindex
         inline const definitionmap & messageMap ( ) const { return m_messages; }
 
         static void decrementMap ( definitionmap & map );
+        static void sortByName ( const definitionmap & map, sortedmap & sorted );
 
     private:
+        // Every indexed name, and every prefix of one, is a node in a trie.
+        // The edges from all nodes are held in a single open addressing
+        // hash table keyed on the parent node and the element's symbol.
+        struct scopeedge
+        {
+            size_t parent;
+            symbol element;
+            size_t child;
+        };
+
         definitionmap m_enums,
                       m_messages;
+        std::vector<const definition *> m_scopeNodes;
+        std::vector<scopeedge> m_scopeEdges;
+        size_t m_numScopeEdges;
+
+        void addScoped ( const identifier & id, const definition * def );
+        size_t findChild ( size_t parent, symbol element ) const;
+        size_t findNode ( size_t parent, const identifier & id ) const;
+        size_t edgeSlot ( size_t parent, symbol element ) const;
+        void growEdges ( );
+
+        static const size_t npos;
 };
 
 }
@@ -26,15 +26,17 @@ astindexer::astindexer ( astindex & index )
 {
 }
 
+astindexer::~astindexer ( )
+{
+    astindex::decrementMap ( m_types );
+}
+
 void astindexer::walk ( definition * node )
 {
     astwalker::walk ( node );
 
     if ( ! peekStack ( ) )
-    {
-        m_index.load ( m_types );
-        checkFieldSet ( m_index );
-    }
+        commit ( );
 }
 
 void astindexer::reset ( )
@@ -46,11 +48,7 @@ void astindexer::reset ( )
 
 void astindexer::walk ( enumdef & node )
 {
-    std::pair<astindex::definitionmapit, bool> result ( m_types.insert ( std::make_pair ( node.idString ( ),
-                                                                                          &node ) ) );
-    if ( ! result.second )
-        throw std::runtime_error ( "Cannot add enum \"" + node.idString ( ) + "\" - type name already used" );
-    refcounted::inc ( &node );
+    addEnum ( node );
 }
 
 void astindexer::walk ( fielddef & node )
@@ -60,7 +58,33 @@ void astindexer::walk ( fielddef & node )
 
 void astindexer::walk ( messagedef & node )
 {
-    std::pair<astindex::definitionmapit, bool> result ( m_types.insert ( std::make_pair ( node.idString ( ),
+    if ( addMessage ( node ) )
+    {
+        walkCollection ( node.enums ( ) );
+        walkCollection ( node.messages ( ) );
+    }
+}
+
+void astindexer::walk ( namespacedef & node )
+{
+    if ( peekStack ( 1 ) || node.hasId ( ) )
+        throw std::runtime_error ( "AST indexer should only be passed an anonymous namespace at the top-level" );
+
+    walkCollection ( node.content ( ) );
+}
+
+void astindexer::addEnum ( enumdef & node )
+{
+    std::pair<astindex::definitionmapit, bool> result ( m_types.insert ( std::make_pair ( node.id ( ).key ( ),
+                                                                                          &node ) ) );
+    if ( ! result.second )
+        throw std::runtime_error ( "Cannot add enum \"" + node.idString ( ) + "\" - type name already used" );
+    refcounted::inc ( &node );
+}
+
+bool astindexer::addMessage ( messagedef & node )
+{
+    std::pair<astindex::definitionmapit, bool> result ( m_types.insert ( std::make_pair ( node.id ( ).key ( ),
                                                                                           &node ) ) );
     if ( result.second )
     {
@@ -75,7 +99,7 @@ void astindexer::walk ( messagedef & node )
         // If the collision is a message and this is an extern, bail out now. The current node is of no better
         // than equal importance to that already in the map and cannot contain any child nodes.
         if ( node.isExtern ( ) )
-            return;
+            return false;
 
         messagedef * collision ( dynamic_cast<messagedef *> ( result.first->second ) );
         if ( ! collision->isExtern ( ) )
@@ -88,24 +112,22 @@ void astindexer::walk ( messagedef & node )
         refcounted::dec ( collision );
         result.first->second = &node;
     }
-
-    walkCollection ( node.enums ( ) );
-    walkCollection ( node.messages ( ) );
+    return true;
 }
 
-void astindexer::walk ( namespacedef & node )
+void astindexer::commit ( )
 {
-    if ( peekStack ( 1 ) || node.hasId ( ) )
-        throw std::runtime_error ( "AST indexer should only be passed an anonymous namespace at the top-level" );
-
-    walkCollection ( node.content ( ) );
+    m_index.load ( m_types );
+    checkFieldSet ( m_index );
 }
 
 void astindexer::checkFieldSet ( const astindex & index )
 {
-    // Populate the message->field name/ordinal mappings and check for local collisions
-    for ( astindex::definitionmapcit messageit ( index.messageMap ( ).begin ( ) ),
-                                     messageend ( index.messageMap ( ).end ( ) );
+    // Populate the message->field name/ordinal mappings and check for local
+    // collisions, in name order so the first collision reported is stable
+    astindex::sortedmap messages;
+    astindex::sortByName ( index.messageMap ( ), messages );
+    for ( astindex::sortedmapcit messageit ( messages.begin ( ) ), messageend ( messages.end ( ) );
           messageit != messageend;
           ++messageit )
     {
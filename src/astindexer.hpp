@@ -27,10 +27,18 @@ class astindexer : public astwalker
 {
     public:
         astindexer ( astindex & index );
+        ~astindexer ( );
 
         void walk ( definition * node );
         void reset ( );
 
+        // Index single definitions, for walkers that index as they go. Once
+        // the whole tree has been added commit loads the index. addMessage
+        // returns false if the message's contents should not be indexed.
+        void addEnum ( enumdef & node );
+        bool addMessage ( messagedef & node );
+        void commit ( );
+
     private:
         astindex & m_index;
         astindex::definitionmap m_types;
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "astpreparer.hpp"
+#include <stdexcept>
+#include <typeinfo>
+
+using namespace fudgeproto;
+
+namespace
+{
+    bool isDefinitionNamespace ( const definition & def )
+    {
+        return typeid ( def ) == typeid ( namespacedef );
+    }
+}
+
+astpreparer::astpreparer ( astindex & index )
+    : m_indexer ( index )
+    , m_indexing ( true )
+{
+}
+
+void astpreparer::walk ( definition * node )
+{
+    if ( node && ( node->hasId ( ) ^ ( peekStack ( ) != 0 ) ) )
+        throw std::runtime_error ( "Cannot flatten an id-less node below the top-level" );
+
+    astwalker::walk ( node );
+
+    if ( ! peekStack ( ) )
+        m_indexer.commit ( );
+}
+
+void astpreparer::reset ( )
+{
+    astwalker::reset ( );
+    m_indexer.reset ( );
+    m_scopes.clear ( );
+    m_indexing = true;
+}
+
+void astpreparer::walk ( enumdef & node )
+{
+    rename ( node );
+    if ( m_indexing )
+        m_indexer.addEnum ( node );
+}
+
+void astpreparer::walk ( fielddef & node )
+{
+    throw std::runtime_error ( "Field walker not implemented in preparer" );
+}
+
+void astpreparer::walk ( messagedef & node )
+{
+    rename ( node );
+
+    // The contents of an extern that has been replaced aren't indexed
+    const bool indexing ( m_indexing );
+    if ( m_indexing )
+        m_indexing = m_indexer.addMessage ( node );
+
+    m_scopes.push_back ( refptr<identifier> ( node.id ( ).clone ( ) ) );
+    walkCollection ( node.enums ( ) );
+    walkCollection ( node.messages ( ) );
+    m_scopes.pop_back ( );
+
+    m_indexing = indexing;
+}
+
+void astpreparer::walk ( namespacedef & node )
+{
+    if ( node.hasId ( ) )
+    {
+        refptr<identifier> scope ( m_scopes.empty ( ) ? node.id ( ).clone ( ) : m_scopes.back ( )->clone ( ) );
+        if ( ! m_scopes.empty ( ) )
+            scope->extend ( node.id ( ) );
+        m_scopes.push_back ( scope );
+    }
+
+    // Flattening adds to the content of the parent, so walk a copy
+    const std::list<definition *> content ( node.content ( ) );
+    walkCollection ( content );
+
+    if ( node.hasId ( ) )
+        m_scopes.pop_back ( );
+
+    node.removeContentIf ( isDefinitionNamespace );
+
+    definition * parent ( peekStack ( 1 ) );
+    if ( parent )
+        for ( std::list<definition *>::const_iterator it ( node.content ( ).begin ( ) );
+              it != node.content ( ).end ( );
+              ++it )
+            parent->addContent ( *it );
+}
+
+void astpreparer::rename ( definition & node )
+{
+    refptr<identifier> id ( m_scopes.empty ( ) ? node.id ( ).clone ( ) : m_scopes.back ( )->clone ( ) );
+    if ( ! m_scopes.empty ( ) )
+        id->extend ( node.id ( ) );
+    node.resetIdentifier ( id.get ( ) );
+}
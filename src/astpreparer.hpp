@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_ASTPREPARER
+#define INC_FUDGEPROTO_ASTPREPARER
+
+#include "astindexer.hpp"
+#include "astwalker.hpp"
+#include <vector>
+
+namespace fudgeproto {
+
+// Does the work of the renamer, flattener and indexer in a single walk of
+// the tree. Definitions are given their fully qualified names on the way
+// down, so they can be indexed straight away, and namespaces are flattened
+// on the way back up.
+class astpreparer : public astwalker
+{
+    public:
+        astpreparer ( astindex & index );
+
+        void walk ( definition * node );
+        void reset ( );
+
+    private:
+        astindexer m_indexer;
+        std::vector<refptr<identifier> > m_scopes;
+        bool m_indexing;
+
+        void walk ( enumdef & node );
+        void walk ( fielddef & node );
+        void walk ( messagedef & node );
+        void walk ( namespacedef & node );
+
+        void rename ( definition & node );
+};
+
+}
+
+#endif
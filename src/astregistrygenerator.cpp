@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "astregistrygenerator.hpp"
+#include "outputfile.hpp"
+#include <memory>
+#include <stdexcept>
+
+using namespace fudgeproto;
+
+astregistrygenerator::astregistrygenerator ( const identifier & name,
+                                             const codewriterfactory & factory,
+                                             const filenamegenerator & filenamegen )
+    : m_name ( name.clone ( ) )
+    , m_factory ( factory )
+    , m_filenamegen ( filenamegen )
+{
+}
+
+astregistrygenerator::~astregistrygenerator ( )
+{
+    refcounted::dec ( m_name );
+}
+
+void astregistrygenerator::walk ( enumdef & )
+{
+    // Enums are not registered
+}
+
+void astregistrygenerator::walk ( fielddef & )
+{
+    throw std::logic_error ( "Field walker not implemented in registry generator" );
+}
+
+void astregistrygenerator::walk ( messagedef & node )
+{
+    m_messages.push_back ( &node );
+    walkCollection ( node.messages ( ) );
+}
+
+void astregistrygenerator::walk ( namespacedef & node )
+{
+    if ( peekStack ( 1 ) )
+        throw std::invalid_argument ( "AST registry generator only accepts a namespace at the top-level" );
+
+    // Collect the generated messages, nested messages included, along with the
+    // top-level messages whose headers declare them
+    m_toplevel.clear ( );
+    m_messages.clear ( );
+    for ( std::list<definition *>::const_iterator it ( node.content ( ).begin ( ) );
+          it != node.content ( ).end ( );
+          ++it )
+    {
+        if ( typeid ( **it ) != typeid ( messagedef ) )
+            continue;
+        const messagedef & message ( dynamic_cast<const messagedef &> ( **it ) );
+
+        if ( ! message.isExtern ( ) )
+        {
+            m_toplevel.push_back ( &message );
+            astwalker::walk ( *it );
+        }
+    }
+
+    if ( m_messages.empty ( ) )
+        throw std::runtime_error ( "Cannot generate registry \"" + m_name->asString ( "." ) + "\" without any messages" );
+
+    // Messages are keyed on their wire type strings, so aliases don't matter
+    std::vector<std::string> keys;
+    for ( std::vector<const messagedef *>::const_iterator it ( m_messages.begin ( ) ); it != m_messages.end ( ); ++it )
+        keys.push_back ( ( *it )->originalIdString ( ) );
+    const perfecthash hash ( keys );
+
+    const std::string filename ( m_name->asString ( "_" ) );
+
+    if ( m_factory.hasHeaderFile ( ) )
+    {
+        outputfile output ( m_filenamegen.generate ( filename, true, false ) );
+        std::auto_ptr<codewriter> writer ( m_factory.headerWriter ( output.stream ( ) ) );
+        generateFile ( *writer, hash );
+        output.commit ( );
+    }
+
+    outputfile output ( m_filenamegen.generate ( filename, false, false ) );
+    std::auto_ptr<codewriter> writer ( m_factory.implWriter ( output.stream ( ) ) );
+    generateFile ( *writer, hash );
+    output.commit ( );
+}
+
+void astregistrygenerator::generateFile ( codewriter & writer, const perfecthash & hash )
+{
+    writer.registryFileHeader ( *m_name, m_filenamegen );
+    for ( std::vector<const messagedef *>::const_iterator it ( m_toplevel.begin ( ) ); it != m_toplevel.end ( ); ++it )
+        writer.includeExternal ( **it, m_filenamegen );
+    writer.endOfExternals ( m_toplevel.size ( ) );
+    writer.includeStandard ( );
+
+    refptr<identifier> ns ( m_name->clone ( ) );
+    ns->pop ( );
+    writer.startNamespace ( *ns );
+    writer.registryClass ( *m_name, m_messages, hash );
+    writer.endNamespace ( *ns );
+
+    writer.fileFooter ( *m_name );
+}
+
@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INC_FUDGEPROTO_ASTREGISTRYGENERATOR
+#define INC_FUDGEPROTO_ASTREGISTRYGENERATOR
+
+#include "astwalker.hpp"
+#include "codewriterfactory.hpp"
+#include "filenamegenerator.hpp"
+#include <vector>
+
+namespace fudgeproto {
+
+class astregistrygenerator : public astwalker
+{
+    public:
+        astregistrygenerator ( const identifier & name,
+                               const codewriterfactory & factory,
+                               const filenamegenerator & filenamegen );
+        ~astregistrygenerator ( );
+
+    private:
+        identifier * m_name;
+        const codewriterfactory & m_factory;
+        const filenamegenerator & m_filenamegen;
+
+        std::vector<const messagedef *> m_toplevel,
+                                        m_messages;
+
+        void walk ( enumdef & node );
+        void walk ( fielddef & node );
+        void walk ( messagedef & node );
+        void walk ( namespacedef & node );
+
+        void generateFile ( codewriter & writer, const perfecthash & hash );
+};
+
+}
+
+#endif
+
@@ -80,6 +80,7 @@ void astresolver::walk ( messagedef & node )
     for ( size_t index ( 0 ); index < parents.size ( ); ++index )
     {
         node.replaceParent ( index, &( parents [ index ]->id ( ) ) );
+        node.setParentDef ( index, dynamic_cast<const messagedef *> ( parents [ index ] ) );
         refcounted::dec ( parents [ index ] );
     }
 
@@ -112,19 +113,6 @@ const definition * astresolver::findType ( const identifier & type, const defini
     if ( ! scope )
         throw std::invalid_argument ( "AST resolver cannot find type in a NULL scope" );
 
-    const definition * result ( m_index.find ( type.asString ( "." ) ) );
-    if ( result )
-        return result;
-
-    identifier * id ( scope->id ( ).clone ( ) );
-    for ( ; id->size ( ) && ! result; id->pop ( ) )
-    {
-        identifier * copy ( id->clone ( ) );
-        copy->extend ( type );
-        result = m_index.find ( copy->asString ( "." ) );
-        refcounted::dec ( copy );
-    }
-    refcounted::dec ( id );
-    return result;
+    return m_index.findScoped ( type, scope->id ( ) );
 }
 
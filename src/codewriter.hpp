@@ -18,7 +18,9 @@
 #define INC_FUDGEPROTO_CODEWRITER
 
 #include "filenamegenerator.hpp"
+#include "perfecthash.hpp"
 #include <ostream>
+#include <vector>
 
 namespace fudgeproto {
 
@@ -33,6 +35,12 @@ class codewriter
         virtual void fileFooter ( const identifier & id ) = 0;
         virtual void includeExternal ( const messagedef & ref,
                                        const filenamegenerator & filenamegen ) = 0;
+
+        // An external message that is only used through pointers, or in the
+        // implementation; direct if the message's own fields refer to it
+        virtual void declareExternal ( const messagedef & ref,
+                                       const filenamegenerator & filenamegen,
+                                       bool direct ) = 0;
         virtual void endOfExternals ( size_t count ) = 0;
         virtual void includeStandard ( ) = 0;
         virtual void startNamespace ( const identifier & ns ) = 0;
@@ -41,6 +49,17 @@ class codewriter
         virtual void startClass ( const messagedef & message ) = 0;
         virtual void endClass ( const messagedef & message ) = 0;
         virtual void classFields ( const messagedef & message ) = 0;
+        virtual void registryFileHeader ( const identifier & name,
+                                          const filenamegenerator & filenamegen ) = 0;
+        virtual void registryClass ( const identifier & name,
+                                     const std::vector<const messagedef *> & messages,
+                                     const perfecthash & hash ) = 0;
+
+        // Starts a file holding the code for several top-level messages. The
+        // externals and standard includes follow, then each message is written
+        // between startNamespace and endNamespace calls.
+        virtual void amalgamationHeader ( const std::vector<const messagedef *> & messages,
+                                          const filenamegenerator & filenamegen ) = 0;
 
     protected:
         std::ostream & m_output;
@@ -50,6 +50,16 @@ namespace
         FUDGEPROTO_MODIFIER_REQUIRED    = 0x10
     };
 
+    enum fudgeproto_option
+    {
+        FUDGEPROTO_OPTION_NONE      = 0x00,
+        FUDGEPROTO_OPTION_INLINE    = 0x01,
+        FUDGEPROTO_OPTION_LAZY      = 0x02,
+        FUDGEPROTO_OPTION_PACKED    = 0x04,
+        FUDGEPROTO_OPTION_POOLED    = 0x08,
+        FUDGEPROTO_OPTION_FLAT      = 0x10
+    };
+
     enum fudgeproto_constraint_constants
     {
         FUDGEPROTO_CONSTRAINT_UNBOUNDED  = -1
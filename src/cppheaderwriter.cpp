@@ -18,11 +18,14 @@
 #include <algorithm>
 #include <ctype.h>
 #include <iostream>
+#include <stdexcept>
 
 using namespace fudgeproto;
 
 cppheaderwriter::cppheaderwriter ( std::ostream & output, bool unsafe )
     : cppwriter ( output, unsafe )
+    , m_numincludes ( 0 )
+    , m_numdeclarations ( 0 )
 {
 }
 
@@ -47,11 +50,31 @@ void cppheaderwriter::includeExternal ( const messagedef & ref,
                                         const filenamegenerator & filenamegen )
 {
     m_output << "#include \"" << filenamegen.generate ( ref, true, true ) << "\"" << std::endl;
+    ++m_numincludes;
 }
 
-void cppheaderwriter::endOfExternals ( size_t count )
+void cppheaderwriter::declareExternal ( const messagedef & ref,
+                                        const filenamegenerator &,
+                                        bool direct )
 {
-    if ( count ) m_output << std::endl;
+    // The implementation includes the messages that are only declared here
+    if ( ! direct )
+        return;
+    if ( ! m_numdeclarations++ && m_numincludes )
+        m_output << std::endl;
+
+    const identifier & id ( ref.id ( ) );
+    for ( size_t index ( 0 ); index + 1 < id.size ( ); ++index )
+        m_output << "namespace " << id [ index ] << " { ";
+    m_output << "class " << id [ id.size ( ) - 1 ] << ";";
+    for ( size_t index ( 0 ); index + 1 < id.size ( ); ++index )
+        m_output << " }";
+    m_output << std::endl;
+}
+
+void cppheaderwriter::endOfExternals ( size_t )
+{
+    if ( m_numincludes || m_numdeclarations ) m_output << std::endl;
 }
 
 void cppheaderwriter::includeStandard ( )
@@ -81,12 +104,12 @@ void cppheaderwriter::endNamespace ( const identifier & ns )
 
 void cppheaderwriter::enumDefinition ( const enumdef & def )
 {
-    const std::string outerIndent ( generateIndent ( ) );
+    const std::string & outerIndent ( generateIndent ( ) );
     m_output << outerIndent << "enum " << def.id ( ) [ def.id ( ).size ( ) - 1 ] << std::endl
              << outerIndent << "{" << std::endl;
     ++m_depth;
 
-    const std::string innerIndent ( generateIndent ( ) );
+    const std::string & innerIndent ( generateIndent ( ) );
     for ( size_t index ( 0 ); index < def.size ( ); ++index )
         m_output << innerIndent << def [ index ].first << " = "
                                 << def [ index ].second << "," << std::endl;
@@ -99,7 +122,7 @@ void cppheaderwriter::enumDefinition ( const enumdef & def )
 void cppheaderwriter::startClass ( const messagedef & message )
 {
     // Output class name and inherited types
-    std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
     m_output << indent << "class " << getIdLeaf ( message ) << std::endl;
 
     if ( ! message.parents ( ).empty ( ) )
@@ -129,7 +152,7 @@ void cppheaderwriter::classFields ( const messagedef & message )
 {
     // Output constructors
     const std::string & name ( getIdLeaf ( message ) );
-    std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
     m_output << indent << name << " ( );" << std::endl
              << indent << name << " (const ::fudge::message & source);" << std::endl
              << indent << "virtual ~" << name << " ( );" << std::endl
@@ -140,6 +163,11 @@ void cppheaderwriter::classFields ( const messagedef & message )
              << indent << "void fromFudgeMessage (const ::fudge::message & source);" << std::endl
              << std::endl;
 
+    // Output structural validators - these don't construct an instance
+    m_output << indent << "static bool validate (const ::fudge::message & source);" << std::endl
+             << indent << "static bool validate (const fudge_byte * bytes, fudge_i32 numbytes);" << std::endl
+             << std::endl;
+
     // Output field accessors
     std::for_each ( message.fields ( ).begin ( ),
                     message.fields ( ).end ( ),
@@ -158,6 +186,7 @@ void cppheaderwriter::classFields ( const messagedef & message )
     // The real encoding/decoding is done in here
     m_output << indent << "void toFudgeMessage (::fudge::message & message) const;" << std::endl
              << indent << "void fromAnonFudgeMessage (const ::fudge::message & message);" << std::endl
+             << indent << "static bool validateAnon (const ::fudge::message & source);" << std::endl
              << std::endl;
 
     // Output field members
@@ -177,6 +206,82 @@ void cppheaderwriter::classFields ( const messagedef & message )
              << indent << name << "& operator= (const " << name << "& );" << std::endl;
 }
 
+void cppheaderwriter::registryFileHeader ( const identifier & name,
+                                          const filenamegenerator & )
+{
+    m_output << generateHeader ( ) << std::endl;
+
+    const std::string guard ( generateGuardSymbol ( name ) );
+    m_output << "#ifndef " << guard << std::endl
+             << "#define " << guard << std::endl
+             << std::endl;
+}
+
+void cppheaderwriter::registryClass ( const identifier & name,
+                                      const std::vector<const messagedef *> & messages,
+                                      const perfecthash & )
+{
+    const std::string & leaf ( name [ name.size ( ) - 1 ] );
+    const std::string & outerIndent ( generateIndent ( ) );
+    m_output << outerIndent << "class " << leaf << std::endl
+             << outerIndent << "{" << std::endl;
+    ++m_depth;
+    m_output << generateIndent ( ) << "public:" << std::endl;
+    ++m_depth;
+    const std::string & indent ( generateIndent ( ) );
+
+    // Type identifiers, zero is reserved for unrecognised messages
+    m_output << indent << "enum TypeId" << std::endl
+             << indent << "{" << std::endl
+             << indent << s_indent << "UnknownType = 0," << std::endl;
+    for ( std::vector<const messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        m_output << indent << s_indent << generateTypeIdName ( **it ) << "," << std::endl;
+    m_output << indent << "};" << std::endl
+             << std::endl;
+
+    // Handler receives decoded messages, taking ownership of them
+    m_output << indent << "class Handler" << std::endl
+             << indent << "{" << std::endl;
+    ++m_depth;
+    m_output << generateIndent ( ) << "public:" << std::endl;
+    ++m_depth;
+    const std::string & innerIndent ( generateIndent ( ) );
+    m_output << innerIndent << "virtual ~Handler ( );" << std::endl
+             << std::endl;
+    for ( std::vector<const messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        m_output << innerIndent << "virtual void on (" << generateIdString ( ( *it )->id ( ) ) << " * message);" << std::endl;
+    m_depth -= 2;
+    m_output << indent << "};" << std::endl
+             << std::endl;
+
+    m_output << indent << "static TypeId typeOf (const ::fudge::message & source);" << std::endl
+             << indent << "static TypeId typeOf (const ::fudge::string & typestr);" << std::endl
+             << indent << "static const char * typeName (TypeId type);" << std::endl
+             << std::endl
+             << indent << "static TypeId decodeAny (const ::fudge::message & source, Handler & handler);" << std::endl
+             << indent << "static TypeId decodeAny (const fudge_byte * bytes, fudge_i32 numbytes, Handler & handler);" << std::endl;
+
+    // Enter private section
+    --m_depth;
+    m_output << std::endl
+             << generateIndent ( ) << "private:" << std::endl;
+    ++m_depth;
+
+    m_output << indent << "// Not implemented - registry cannot be instantiated" << std::endl
+             << indent << leaf << " ( );" << std::endl;
+
+    m_depth -= 2;
+    m_output << outerIndent << "};" << std::endl
+             << std::endl;
+}
+
+void cppheaderwriter::amalgamationHeader ( const std::vector<const messagedef *> &,
+                                           const filenamegenerator & )
+{
+    // Each message keeps its own header, so other code can include it
+    throw std::logic_error ( "C++ Header writer does not amalgamate messages" );
+}
+
 void cppheaderwriter::outputFieldGetter ( const fielddef * field )
 {
     m_output << generateIndent ( ) << "inline " << generateArgType ( *field )
@@ -186,8 +291,14 @@ void cppheaderwriter::outputFieldGetter ( const fielddef * field )
 
 void cppheaderwriter::outputFieldSetter ( const fielddef * field )
 {
-    m_output << generateIndent ( ) << "void set" << getIdLeaf ( *field ) << " ("
-             << generateArgType ( *field ) << " value);" << std::endl;
+    m_output << generateIndent ( ) << ( field->hasOption ( FUDGEPROTO_OPTION_INLINE ) ? "inline " : "" )
+             << "void set" << getIdLeaf ( *field ) << " (" << generateArgType ( *field ) << " value)";
+
+    // Inline fields only hold simple values, so the setter is a plain assignment
+    if ( field->hasOption ( FUDGEPROTO_OPTION_INLINE ) )
+        m_output << " { " << generateMemberName ( *field ) << " = value; }" << std::endl;
+    else
+        m_output << ";" << std::endl;
 }
 
 void cppheaderwriter::outputMemberDef ( const fielddef * field )
@@ -31,6 +31,9 @@ class cppheaderwriter : public cppwriter
         void fileFooter ( const identifier & id );
         void includeExternal ( const messagedef & ref,
                                const filenamegenerator & filenamegen );
+        void declareExternal ( const messagedef & ref,
+                               const filenamegenerator & filenamegen,
+                               bool direct );
         void endOfExternals ( size_t count );
         void includeStandard ( );
         void startNamespace ( const identifier & ns );
@@ -39,8 +42,18 @@ class cppheaderwriter : public cppwriter
         void startClass ( const messagedef & message );
         void endClass ( const messagedef & message );
         void classFields ( const messagedef & message );
+        void registryFileHeader ( const identifier & name,
+                                  const filenamegenerator & filenamegen );
+        void registryClass ( const identifier & name,
+                             const std::vector<const messagedef *> & messages,
+                             const perfecthash & hash );
+        void amalgamationHeader ( const std::vector<const messagedef *> & messages,
+                                  const filenamegenerator & filenamegen );
 
     private:
+        size_t m_numincludes,
+               m_numdeclarations;
+
         void outputFieldGetter ( const fielddef * field );
         void outputFieldSetter ( const fielddef * field );
         void outputMemberDef ( const fielddef * field );
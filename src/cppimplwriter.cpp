@@ -21,6 +21,9 @@ using namespace fudgeproto;
 
 cppimplwriter::cppimplwriter ( std::ostream & output, bool unsafe )
     : cppwriter ( output, unsafe )
+    , m_numslots ( 0 )
+    , m_scoped ( false )
+    , m_numincludes ( 0 )
 {
 }
 
@@ -45,29 +48,65 @@ void cppimplwriter::fileFooter ( const identifier & id )
 
 void cppimplwriter::includeExternal ( const messagedef &, const filenamegenerator & )
 {
-    // Does nothing
+    // Does nothing - already included by the header
+}
+
+void cppimplwriter::declareExternal ( const messagedef & ref,
+                                      const filenamegenerator & filenamegen,
+                                      bool )
+{
+    // The header may only declare the message, but the implementation needs
+    // its definition
+    m_output << "#include \"" << filenamegen.generate ( ref, true, true ) << "\"" << std::endl;
+    ++m_numincludes;
 }
 
 void cppimplwriter::endOfExternals ( size_t )
 {
-    // Does nothing
+    if ( m_numincludes ) m_output << std::endl;
 }
 
 void cppimplwriter::includeStandard ( )
 {
-    // Does nothing
+    m_output << "#include <cstring>" << std::endl
+             << "#include <stdint.h>" << std::endl
+             << std::endl
+             << "#ifndef FUDGEPROTO_HASH_SUPPORT" << std::endl
+             << "#define FUDGEPROTO_HASH_SUPPORT" << std::endl
+             << "namespace" << std::endl
+             << "{" << std::endl;
+    ++m_depth;
+    outputHashFunction ( );
+    --m_depth;
+    m_output << "}" << std::endl
+             << "#endif" << std::endl
+             << std::endl;
 }
 
 void cppimplwriter::startNamespace ( const identifier & ns )
 {
-    if ( ns.size ( ) )
+    if ( ! ns.size ( ) )
+        return;
+
+    if ( m_scoped )
+    {
+        for ( size_t index ( 0 ); index < ns.size ( ); ++index )
+            m_output << ( index ? " " : "" ) << "namespace " << ns [ index ] << " {";
+        m_output << std::endl << std::endl;
+    }
+    else
         m_output << "using namespace " << generateIdString ( ns ) << ";" << std::endl
                  << std::endl;
 }
 
-void cppimplwriter::endNamespace ( const identifier & )
+void cppimplwriter::endNamespace ( const identifier & ns )
 {
-    // Does nothing
+    if ( ! m_scoped || ! ns.size ( ) )
+        return;
+
+    for ( size_t index ( 0 ); index < ns.size ( ); ++index )
+        m_output << ( index ? " " : "" ) << "}";
+    m_output << std::endl << std::endl;
 }
 
 void cppimplwriter::enumDefinition ( const enumdef & )
@@ -92,6 +131,31 @@ void cppimplwriter::classFields ( const messagedef & message )
     const std::string path ( generateIdString ( *id ) );
     const std::string & name ( getIdLeaf ( message ) );
 
+    // Fields are matched by name using a perfect hash over every field name the
+    // message knows of, inherited ones included. Packed fields have no name.
+    std::vector<const fielddef *> allfields;
+    message.collectFields ( allfields );
+    std::vector<std::string> keys;
+    for ( std::vector<const fielddef *>::const_iterator it ( allfields.begin ( ) ); it != allfields.end ( ); ++it )
+        if ( ! ( *it )->hasOption ( FUDGEPROTO_OPTION_PACKED ) )
+            keys.push_back ( generateIdString ( ( *it )->id ( ) ) );
+
+    m_fieldslots.clear ( );
+    m_numslots = 0;
+    if ( ! keys.empty ( ) )
+    {
+        const perfecthash hash ( keys );
+        for ( size_t index ( 0 ); index < keys.size ( ); ++index )
+            m_fieldslots [ keys [ index ] ] = hash.slot ( keys [ index ] );
+        m_numslots = hash.size ( );
+
+        outputFieldLocator ( message, hash );
+    }
+
+    // Where the hierarchy allows, inherited fields are encoded and decoded here
+    // rather than by each parent in turn
+    flattenHierarchy ( message );
+
     // Generate constructors
     m_output << path << "::" << name << " ( )" << std::endl
              << "{" << std::endl;
@@ -139,6 +203,7 @@ void cppimplwriter::classFields ( const messagedef & message )
             << "{" << std::endl;
     ++m_depth;
     outputEncoderParents ( message );
+    outputInheritedFields ( &cppimplwriter::outputEncoderField );
     std::for_each ( message.fields ( ).begin ( ),
                     message.fields ( ).end ( ),
                     std::bind1st ( std::mem_fun ( &cppimplwriter::outputEncoderField ), this ) );
@@ -160,6 +225,8 @@ void cppimplwriter::classFields ( const messagedef & message )
              << "{" << std::endl;
     ++m_depth;
     outputParentDecoder ( message );
+    outputFieldLocatorCall ( message );
+    outputInheritedFields ( &cppimplwriter::outputDecoderField );
     std::for_each ( message.fields ( ).begin ( ),
                     message.fields ( ).end ( ),
                     std::bind1st ( std::mem_fun ( &cppimplwriter::outputDecoderField ), this ) );
@@ -167,11 +234,50 @@ void cppimplwriter::classFields ( const messagedef & message )
     m_output << "}" << std::endl
              << std::endl;
 
-    // Generate setters
+    // Generate the validation methods
+    m_output << "bool " << path << "::validate (const ::fudge::message & source)" << std::endl
+             << "{" << std::endl;
+    ++m_depth;
+    outputValidatorWrapper ( message );
+    --m_depth;
+    m_output << "}" << std::endl
+             << std::endl
+             << "bool " << path << "::validate (const fudge_byte * bytes, fudge_i32 numbytes)" << std::endl
+             << "{" << std::endl
+             << s_indent << "try" << std::endl
+             << s_indent << "{" << std::endl
+             << s_indent << s_indent << "return validate (::fudge::codec ( ).decode (bytes, numbytes).payload ( ));" << std::endl
+             << s_indent << "}" << std::endl
+             << s_indent << "catch (const std::exception &)" << std::endl
+             << s_indent << "{" << std::endl
+             << s_indent << s_indent << "return false;" << std::endl
+             << s_indent << "}" << std::endl
+             << "}" << std::endl
+             << std::endl;
+
+    // Generate the anonymous validation method
+    m_output << "bool " << path << "::validateAnon (const ::fudge::message & source)" << std::endl
+             << "{" << std::endl;
+    ++m_depth;
+    outputParentValidator ( message );
+    outputFieldLocatorCall ( message );
+    outputInheritedFields ( &cppimplwriter::outputValidatorField );
+    std::for_each ( message.fields ( ).begin ( ),
+                    message.fields ( ).end ( ),
+                    std::bind1st ( std::mem_fun ( &cppimplwriter::outputValidatorField ), this ) );
+    m_output << generateIndent ( ) << "return true;" << std::endl;
+    --m_depth;
+    m_output << "}" << std::endl
+             << std::endl;
+
+    // Generate setters, those for inline fields are in the header
     for ( std::list<fielddef *>::const_iterator it ( message.fields ( ).begin ( ) );
           it != message.fields ( ).end ( );
           ++it )
     {
+        if ( ( *it )->hasOption ( FUDGEPROTO_OPTION_INLINE ) )
+            continue;
+
         m_output << "void " << path << "::" << "set" << getIdLeaf ( **it )
                  << " (" << generateArgType ( **it ) << " value)" << std::endl
                  << "{" << std::endl;
@@ -182,6 +288,362 @@ void cppimplwriter::classFields ( const messagedef & message )
     }
 }
 
+void cppimplwriter::registryFileHeader ( const identifier & name,
+                                        const filenamegenerator & filenamegen )
+{
+    m_output << generateHeader ( ) << std::endl;
+
+    m_output << "#include \"" << filenamegen.generate ( name.asString ( "_" ), true, true ) << "\"" << std::endl
+             << "#include <memory>" << std::endl;
+}
+
+void cppimplwriter::registryClass ( const identifier & name,
+                                    const std::vector<const messagedef *> & messages,
+                                    const perfecthash & hash )
+{
+    const std::string & leaf ( name [ name.size ( ) - 1 ] );
+
+    m_output << "namespace" << std::endl
+             << "{" << std::endl;
+    ++m_depth;
+    const std::string & indent ( generateIndent ( ) );
+
+    // Each type has a decoder that constructs the message and passes it to the handler
+    m_output << indent << "typedef void (*decoder) (const ::fudge::message & source, " << leaf << "::Handler & handler);" << std::endl
+             << std::endl
+             << indent << "template<class T>" << std::endl
+             << indent << "void decodeType (const ::fudge::message & source, " << leaf << "::Handler & handler)" << std::endl
+             << indent << "{" << std::endl
+             << indent << s_indent << "std::auto_ptr<T> message (new T);" << std::endl
+             << indent << s_indent << "message->fromFudgeMessage (source);" << std::endl
+             << indent << s_indent << "handler.on (message.release ());" << std::endl
+             << indent << "}" << std::endl
+             << std::endl
+             << indent << "struct entry" << std::endl
+             << indent << "{" << std::endl
+             << indent << s_indent << "const char * name;" << std::endl
+             << indent << s_indent << "size_t size;" << std::endl
+             << indent << s_indent << leaf << "::TypeId type;" << std::endl
+             << indent << s_indent << "decoder decode;" << std::endl
+             << indent << "};" << std::endl
+             << std::endl;
+
+    // Perfect hash tables, generated from the message type strings
+    m_output << indent << "static const size_t numseeds (" << hash.seeds ( ).size ( ) << ");" << std::endl
+             << indent << "static const uint32_t seeds [" << hash.seeds ( ).size ( ) << "] = {";
+    for ( size_t index ( 0 ); index < hash.seeds ( ).size ( ); ++index )
+        m_output << ( index ? ", " : " " ) << hash.seeds ( ) [ index ] << "u";
+    m_output << " };" << std::endl
+             << std::endl
+             << indent << "static const size_t numentries (" << hash.size ( ) << ");" << std::endl
+             << indent << "static const entry entries [" << hash.size ( ) << "] =" << std::endl
+             << indent << "{" << std::endl;
+    for ( size_t slot ( 0 ); slot < hash.size ( ); ++slot )
+    {
+        const size_t index ( hash.slots ( ) [ slot ] );
+        if ( index == perfecthash::npos )
+            m_output << indent << s_indent << "{ 0, 0, " << leaf << "::UnknownType, 0 }," << std::endl;
+        else
+            m_output << indent << s_indent << "{ \"" << escapeString ( hash.keys ( ) [ index ] ) << "\", "
+                                           << hash.keys ( ) [ index ].size ( ) << ", "
+                                           << leaf << "::" << generateTypeIdName ( *messages [ index ] ) << ", "
+                                           << "&decodeType< " << generateIdString ( messages [ index ]->id ( ) ) << " > }," << std::endl;
+    }
+    m_output << indent << "};" << std::endl
+             << std::endl;
+
+    // Type names, indexed by TypeId
+    m_output << indent << "static const size_t numtypes (" << messages.size ( ) + 1 << ");" << std::endl
+             << indent << "static const char * const names [" << messages.size ( ) + 1 << "] =" << std::endl
+             << indent << "{" << std::endl
+             << indent << s_indent << "0," << std::endl;
+    for ( size_t index ( 0 ); index < messages.size ( ); ++index )
+        m_output << indent << s_indent << "\"" << escapeString ( hash.keys ( ) [ index ] ) << "\"," << std::endl;
+    m_output << indent << "};" << std::endl
+             << std::endl;
+
+    // Lookup is two hashes and a single comparison
+    m_output << indent << "const entry * findEntry (const ::fudge::string & typestr)" << std::endl
+             << indent << "{" << std::endl;
+    ++m_depth;
+    const std::string & innerIndent ( generateIndent ( ) );
+    m_output << innerIndent << "const fudge_byte * data (typestr.data ());" << std::endl
+             << innerIndent << "const size_t size (typestr.size ());" << std::endl
+             << innerIndent << "const uint32_t bucket (fudgeproto_hash (data, size, 0) % numseeds);" << std::endl
+             << innerIndent << "const entry & candidate (entries [fudgeproto_hash (data, size, seeds [bucket]) % numentries]);" << std::endl
+             << innerIndent << "if (candidate.name && candidate.size == size && std::memcmp (candidate.name, data, size) == 0)" << std::endl
+             << innerIndent << s_indent << "return &candidate;" << std::endl
+             << innerIndent << "return 0;" << std::endl;
+    --m_depth;
+    m_output << indent << "}" << std::endl;
+    --m_depth;
+    m_output << "}" << std::endl
+             << std::endl;
+
+    // Default handlers discard the message
+    m_output << leaf << "::Handler::~Handler ( )" << std::endl
+             << "{" << std::endl
+             << "}" << std::endl
+             << std::endl;
+    for ( std::vector<const messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        m_output << "void " << leaf << "::Handler::on (" << generateIdString ( ( *it )->id ( ) ) << " * message)" << std::endl
+                 << "{" << std::endl
+                 << s_indent << "delete message;" << std::endl
+                 << "}" << std::endl
+                 << std::endl;
+
+    m_output << leaf << "::TypeId " << leaf << "::typeOf (const ::fudge::message & source)" << std::endl
+             << "{" << std::endl
+             << s_indent << "::fudge::field type;" << std::endl
+             << s_indent << "if (!source.getField (type, static_cast<fudge_i16> (0)) || type.type () != FUDGE_TYPE_STRING)" << std::endl
+             << s_indent << s_indent << "return UnknownType;" << std::endl
+             << s_indent << "return typeOf (type.getString ());" << std::endl
+             << "}" << std::endl
+             << std::endl
+             << leaf << "::TypeId " << leaf << "::typeOf (const ::fudge::string & typestr)" << std::endl
+             << "{" << std::endl
+             << s_indent << "const entry * found (findEntry (typestr));" << std::endl
+             << s_indent << "return found ? found->type : UnknownType;" << std::endl
+             << "}" << std::endl
+             << std::endl
+             << "const char * " << leaf << "::typeName (TypeId type)" << std::endl
+             << "{" << std::endl
+             << s_indent << "return static_cast<size_t> (type) < numtypes ? names [type] : 0;" << std::endl
+             << "}" << std::endl
+             << std::endl
+             << leaf << "::TypeId " << leaf << "::decodeAny (const ::fudge::message & source, Handler & handler)" << std::endl
+             << "{" << std::endl
+             << s_indent << "::fudge::field type;" << std::endl
+             << s_indent << "if (!source.getField (type, static_cast<fudge_i16> (0)) || type.type () != FUDGE_TYPE_STRING)" << std::endl
+             << s_indent << s_indent << "return UnknownType;" << std::endl
+             << std::endl
+             << s_indent << "const entry * found (findEntry (type.getString ()));" << std::endl
+             << s_indent << "if (!found)" << std::endl
+             << s_indent << s_indent << "return UnknownType;" << std::endl
+             << std::endl
+             << s_indent << "found->decode (source, handler);" << std::endl
+             << s_indent << "return found->type;" << std::endl
+             << "}" << std::endl
+             << std::endl
+             << leaf << "::TypeId " << leaf << "::decodeAny (const fudge_byte * bytes, fudge_i32 numbytes, Handler & handler)" << std::endl
+             << "{" << std::endl
+             << s_indent << "return decodeAny (::fudge::codec ( ).decode (bytes, numbytes).payload ( ), handler);" << std::endl
+             << "}" << std::endl;
+}
+
+void cppimplwriter::amalgamationHeader ( const std::vector<const messagedef *> & messages,
+                                         const filenamegenerator & filenamegen )
+{
+    m_output << generateHeader ( ) << std::endl;
+
+    // All of the headers come first, so the externals, standard includes and
+    // the hash function are shared by every message in the file
+    for ( std::vector<const messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+        m_output << "#include \"" << filenamegen.generate ( **it, true, true ) << "\"" << std::endl;
+    m_output << std::endl;
+
+    // The messages can come from different namespaces, so each is written in
+    // its own namespace rather than after a using directive
+    m_scoped = true;
+}
+
+void cppimplwriter::outputFieldLocator ( const messagedef & message, const perfecthash & hash )
+{
+    m_output << "namespace" << std::endl
+             << "{" << std::endl;
+    ++m_depth;
+    const std::string & indent ( generateIndent ( ) );
+
+    m_output << indent << "// Locates the named fields of " << generateIdString ( message.id ( ) ) << " in a single pass" << std::endl
+             << indent << "void " << generateLocatorName ( message ) << " (const ::fudge::message & source, ::fudge::field * fields, bool * present)" << std::endl
+             << indent << "{" << std::endl;
+    ++m_depth;
+    const std::string & innerIndent ( generateIndent ( ) );
+
+    m_output << innerIndent << "static const size_t numseeds (" << hash.seeds ( ).size ( ) << ");" << std::endl
+             << innerIndent << "static const uint32_t seeds [" << hash.seeds ( ).size ( ) << "] = {";
+    for ( size_t index ( 0 ); index < hash.seeds ( ).size ( ); ++index )
+        m_output << ( index ? ", " : " " ) << hash.seeds ( ) [ index ] << "u";
+    m_output << " };" << std::endl
+             << innerIndent << "static const size_t numslots (" << hash.size ( ) << ");" << std::endl
+             << innerIndent << "static const char * const names [" << hash.size ( ) << "] = {";
+    for ( size_t slot ( 0 ); slot < hash.size ( ); ++slot )
+    {
+        const size_t index ( hash.slots ( ) [ slot ] );
+        m_output << ( slot ? ", " : " " );
+        if ( index == perfecthash::npos )
+            m_output << "0";
+        else
+            m_output << "\"" << escapeString ( hash.keys ( ) [ index ] ) << "\"";
+    }
+    m_output << " };" << std::endl
+             << innerIndent << "static const size_t sizes [" << hash.size ( ) << "] = {";
+    for ( size_t slot ( 0 ); slot < hash.size ( ); ++slot )
+    {
+        const size_t index ( hash.slots ( ) [ slot ] );
+        m_output << ( slot ? ", " : " " ) << ( index == perfecthash::npos ? 0 : hash.keys ( ) [ index ].size ( ) );
+    }
+    m_output << " };" << std::endl
+             << std::endl;
+
+    // The first field with a given name wins, as with ::fudge::message::getField
+    m_output << innerIndent << "for (size_t index (0); index < source.size (); ++index)" << std::endl
+             << innerIndent << "{" << std::endl
+             << innerIndent << s_indent << "const ::fudge::field field (source.getFieldAt (index));" << std::endl
+             << innerIndent << s_indent << "if (!field.hasName ())" << std::endl
+             << innerIndent << s_indent << s_indent << "continue;" << std::endl
+             << std::endl
+             << innerIndent << s_indent << "const ::fudge::string name (field.name ());" << std::endl
+             << innerIndent << s_indent << "const fudge_byte * data (name.data ());" << std::endl
+             << innerIndent << s_indent << "const size_t size (name.size ());" << std::endl
+             << innerIndent << s_indent << "const size_t slot (fudgeproto_hash (data, size, seeds [fudgeproto_hash (data, size, 0) % numseeds]) % numslots);" << std::endl
+             << innerIndent << s_indent << "if (!present [slot] && names [slot] && sizes [slot] == size && std::memcmp (names [slot], data, size) == 0)" << std::endl
+             << innerIndent << s_indent << "{" << std::endl
+             << innerIndent << s_indent << s_indent << "fields [slot] = field;" << std::endl
+             << innerIndent << s_indent << s_indent << "present [slot] = true;" << std::endl
+             << innerIndent << s_indent << "}" << std::endl
+             << innerIndent << "}" << std::endl;
+
+    --m_depth;
+    m_output << indent << "}" << std::endl;
+    --m_depth;
+    m_output << "}" << std::endl
+             << std::endl;
+}
+
+void cppimplwriter::outputFieldLocatorCall ( const messagedef & message )
+{
+    if ( ! m_numslots || ( message.fields ( ).empty ( ) && m_inherited.empty ( ) ) )
+        return;
+
+    const std::string & indent ( generateIndent ( ) );
+    m_output << indent << "::fudge::field fields [" << m_numslots << "];" << std::endl
+             << indent << "bool present [" << m_numslots << "] = { false };" << std::endl
+             << indent << generateLocatorName ( message ) << " (source, fields, present);" << std::endl
+             << std::endl;
+}
+
+std::string cppimplwriter::outputFieldLookup ( const fielddef & field )
+{
+    const std::string name ( generateIdString ( field.id ( ) ) );
+    const std::string fieldname ( name + "_field" );
+
+    // Packed fields can only be found by ordinal
+    if ( field.hasOption ( FUDGEPROTO_OPTION_PACKED ) )
+    {
+        m_output << generateIndent ( ) << "::fudge::field " << fieldname << ";" << std::endl
+                 << generateIndent ( ) << "if (source.getField (" << fieldname << ", static_cast<fudge_i16> ("
+                                       << field.ordinal ( ) << ")))" << std::endl;
+        return fieldname;
+    }
+
+    std::map<std::string, size_t>::const_iterator slot ( m_fieldslots.find ( name ) );
+    if ( slot == m_fieldslots.end ( ) )
+        throw std::logic_error ( "C++ Impl writer has no slot for field \"" + name + "\"" );
+
+    m_output << generateIndent ( ) << "const ::fudge::field & " << fieldname << " (fields [" << slot->second << "]);" << std::endl
+             << generateIndent ( ) << "if (present [" << slot->second << "])" << std::endl;
+    return fieldname;
+}
+
+void cppimplwriter::flattenHierarchy ( const messagedef & message )
+{
+    m_delegates.clear ( );
+    m_inherited.clear ( );
+
+    std::set<const messagedef *> visited;
+    std::set<std::string> names, delegates;
+    for ( std::list<fielddef *>::const_iterator it ( message.fields ( ).begin ( ) ); it != message.fields ( ).end ( ); ++it )
+        names.insert ( generateIdString ( ( *it )->id ( ) ) );
+
+    // Repeated ancestors or field names would make the unqualified member names
+    // ambiguous, so those hierarchies fall back on each parent handling itself
+    if ( ! flattenParents ( message, visited, names, delegates ) )
+    {
+        m_delegates = message.parents ( );
+        m_inherited.clear ( );
+    }
+}
+
+bool cppimplwriter::flattenParents ( const messagedef & message,
+                                     std::set<const messagedef *> & visited,
+                                     std::set<std::string> & names,
+                                     std::set<std::string> & delegates )
+{
+    for ( size_t index ( 0 ); index < message.parents ( ).size ( ); ++index )
+    {
+        const identifier * parent ( message.parents ( ) [ index ] );
+        const messagedef * def ( message.parentDef ( index ) );
+        const std::string scope ( generateIdString ( *parent ) );
+
+        // The fields of extern parents are unknown, they have to handle themselves
+        if ( ! def || def->isExtern ( ) )
+        {
+            if ( ! delegates.insert ( scope ).second )
+                return false;
+            m_delegates.push_back ( parent );
+            continue;
+        }
+
+        if ( ! visited.insert ( def ).second || ! flattenParents ( *def, visited, names, delegates ) )
+            return false;
+
+        for ( std::list<fielddef *>::const_iterator it ( def->fields ( ).begin ( ) ); it != def->fields ( ).end ( ); ++it )
+        {
+            if ( ! names.insert ( generateIdString ( ( *it )->id ( ) ) ).second )
+                return false;
+            m_inherited.push_back ( std::make_pair ( scope + "::", *it ) );
+        }
+    }
+    return true;
+}
+
+void cppimplwriter::outputInheritedFields ( void ( cppimplwriter::*writer ) ( const fielddef * ) )
+{
+    for ( size_t index ( 0 ); index < m_inherited.size ( ); ++index )
+    {
+        m_memberScope = m_inherited [ index ].first;
+        ( this->*writer ) ( m_inherited [ index ].second );
+    }
+    m_memberScope.clear ( );
+}
+
+std::string cppimplwriter::generateFlatRowSize ( const fielddef & field )
+{
+    // Number of elements below the outermost dimension, all of which are fixed
+    size_t rowsize ( 1 );
+    for ( size_t index ( 0 ); index + 1 < field.constraints ( ).size ( ); ++index )
+        rowsize *= field.constraints ( ) [ index ];
+
+    return generateNumber ( rowsize );
+}
+
+std::string cppimplwriter::generateLocatorName ( const messagedef & message )
+{
+    return "locate_" + generateTypeIdName ( message );
+}
+
+void cppimplwriter::outputHashFunction ( )
+{
+    // Must match perfecthash::hash exactly
+    const std::string & indent ( generateIndent ( ) );
+    m_output << indent << "inline uint32_t fudgeproto_hash (const fudge_byte * data, size_t size, uint32_t seed)" << std::endl
+             << indent << "{" << std::endl
+             << indent << s_indent << "uint32_t hash (2166136261u ^ seed);" << std::endl
+             << indent << s_indent << "for (size_t index (0); index < size; ++index)" << std::endl
+             << indent << s_indent << "{" << std::endl
+             << indent << s_indent << s_indent << "hash ^= static_cast<unsigned char> (data [index]);" << std::endl
+             << indent << s_indent << s_indent << "hash *= 16777619u;" << std::endl
+             << indent << s_indent << "}" << std::endl
+             << indent << s_indent << "hash ^= hash >> 16;" << std::endl
+             << indent << s_indent << "hash *= 0x85ebca6bu;" << std::endl
+             << indent << s_indent << "hash ^= hash >> 13;" << std::endl
+             << indent << s_indent << "hash *= 0xc2b2ae35u;" << std::endl
+             << indent << s_indent << "hash ^= hash >> 16;" << std::endl
+             << indent << s_indent << "return hash;" << std::endl
+             << indent << "}" << std::endl;
+}
+
 void cppimplwriter::outputMemberInitialiser ( const fielddef * field )
 {
     // Collections don't have constructors - as they're real C++ objects they start empty
@@ -232,23 +694,22 @@ void cppimplwriter::outputCollectionMemberCleanup ( const fielddef & field,
                                                     const std::string & sourcevar,
                                                     size_t index )
 {
-    const std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
     m_output << indent << "for (size_t index" << index << " (0); index" << index << " < "
                        << sourcevar << ".size ( ); ++index" << index << ")" << std::endl
              << indent << "{" << std::endl;
 
     // Build the variable name of the current element
-    std::stringstream namebuf;
-    namebuf << sourcevar << "[index" << index << "]";
+    const std::string elementname ( generateElementName ( sourcevar, index ) );
 
     if ( index )
     {
         ++m_depth;
-        outputCollectionMemberCleanup ( field, namebuf.str ( ), index - 1 );
+        outputCollectionMemberCleanup ( field, elementname, index - 1 );
         --m_depth;
     }
     else
-        m_output << indent << s_indent << "delete " << namebuf.str ( ) << ";" << std::endl;
+        m_output << indent << s_indent << "delete " << elementname << ";" << std::endl;
 
     m_output << indent << "}" << std::endl;
 }
@@ -264,7 +725,7 @@ void cppimplwriter::outputMemberSetterBody ( const fielddef * field )
 
 void cppimplwriter::outputEncoderWrapper ( const messagedef & message )
 {
-    const std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
     m_output << indent << "::fudge::message target;" << std::endl
              << indent << "target.addField (::fudge::string (\"" << message.originalIdString ( )
                        << "\"), ::fudge::message::noname, 0);" << std::endl
@@ -275,20 +736,20 @@ void cppimplwriter::outputEncoderWrapper ( const messagedef & message )
              << generateIndent ( ) << "return target;" << std::endl;
 }
 
-void cppimplwriter::outputEncoderParents ( const messagedef & message )
+void cppimplwriter::outputEncoderParents ( const messagedef & )
 {
-    const std::string indent ( generateIndent ( ) );
-    for ( size_t index ( 0 ); index < message.parents ( ).size ( ); ++index )
-        m_output << indent << generateIdString ( *message.parents ( ) [ index ] )
+    const std::string & indent ( generateIndent ( ) );
+    for ( size_t index ( 0 ); index < m_delegates.size ( ); ++index )
+        m_output << indent << generateIdString ( *m_delegates [ index ] )
                            << "::toFudgeMessage (target);" << std::endl;
 
-    if ( message.parents ( ).size ( ) )
+    if ( m_delegates.size ( ) )
         m_output << std::endl;
 }
 
 void cppimplwriter::outputEncoderField ( const fielddef * field )
 {
-    const std::string membername ( generateMemberName ( *field ) );
+    const std::string membername ( m_memberScope + generateMemberName ( *field ) );
     std::string memberargname;
 
     if ( field->isOptional ( ) )
@@ -308,8 +769,13 @@ void cppimplwriter::outputEncoderField ( const fielddef * field )
         memberargname = membername;
     }
 
-    const std::string indent ( generateIndent ( ) );
-    if ( field->isCollection ( ) )
+    const std::string & indent ( generateIndent ( ) );
+    if ( field->hasOption ( FUDGEPROTO_OPTION_FLAT ) )
+    {
+        outputFlatEncoder ( memberargname, *field );
+        m_output << std::endl;
+    }
+    else if ( field->isCollection ( ) )
     {
         outputCollectionEncoder ( "target", memberargname, *field, field->constraints ( ).size ( ) - 1 );
         m_output << std::endl;
@@ -339,7 +805,10 @@ void cppimplwriter::outputEncoderFieldAdd ( const std::string & targetvar,
 {
     m_output << generateIndent ( ) << targetvar << ".addField (" << sourcevar << ", ";
 
-    m_output << "::fudge::string (\"" << generateIdString ( field.id ( ) ) << "\")";
+    if ( field.hasOption ( FUDGEPROTO_OPTION_PACKED ) )
+        m_output << "::fudge::message::noname";
+    else
+        m_output << "::fudge::string (\"" << generateIdString ( field.id ( ) ) << "\")";
     m_output << ", ";
     if ( field.hasOrdinal ( ) )
         m_output << field.ordinal ( );
@@ -371,9 +840,8 @@ void cppimplwriter::outputCollectionEncoder ( const std::string & targetvar,
     else
     {
         // Create a target message for this submessage
-        std::stringstream targetbuf;
-        targetbuf << getIdLeaf ( field ) << index;
-        m_output << generateIndent ( ) << "::fudge::message " << targetbuf.str ( ) << ";" << std::endl;
+        const std::string targetname ( getIdLeaf ( field ) + generateNumber ( index ) );
+        m_output << generateIndent ( ) << "::fudge::message " << targetname << ";" << std::endl;
 
         // Loop over elements in list, simple elements go in as fields, complex ones as messages
         m_output << generateIndent ( ) << "for (size_t index" << index << " (0); index" << index
@@ -382,38 +850,37 @@ void cppimplwriter::outputCollectionEncoder ( const std::string & targetvar,
         ++m_depth;
 
         // Reference to source element
-        std::stringstream namebuf;
-        namebuf << sourcevar << "[index" << index << "]";
+        const std::string elementname ( generateElementName ( sourcevar, index ) );
 
         if ( index )
         {
             // Recurse in to the next level
-            outputCollectionEncoder ( targetbuf.str ( ), namebuf.str ( ), field, index - 1 );
+            outputCollectionEncoder ( targetname, elementname, field, index - 1 );
         }
         else if ( field.type ( ).isComplex ( ) )
         {
             // Complex element needs to be encoded in to a submessage, which is added to the
             // target. Null pointers are represented as identity values.
-            const std::string subvarname ( "submsg_" + getIdLeaf ( field ) ),
-                              outerindent ( generateIndent ( ) );
+            const std::string subvarname ( "submsg_" + getIdLeaf ( field ) );
+            const std::string & outerindent ( generateIndent ( ) );
             ++m_depth;
-            const std::string innerindent ( generateIndent ( ) );
+            const std::string & innerindent ( generateIndent ( ) );
 
-            m_output << outerindent << "if (" << namebuf.str ( ) << ")" << std::endl
+            m_output << outerindent << "if (" << elementname << ")" << std::endl
                      << outerindent << "{" << std::endl
-                     << innerindent << "::fudge::message " << subvarname << " (" << namebuf.str ( )
+                     << innerindent << "::fudge::message " << subvarname << " (" << elementname
                                     << "->asFudgeMessage ());" << std::endl
-                     << innerindent << targetbuf.str ( ) << ".addField (" << subvarname << ");" << std::endl
+                     << innerindent << targetname << ".addField (" << subvarname << ");" << std::endl
                      << outerindent << "}" << std::endl
                      << outerindent << "else" << std::endl
-                     << innerindent << targetbuf.str ( ) << ".addField ();" << std::endl;
+                     << innerindent << targetname << ".addField ();" << std::endl;
 
             --m_depth;
         }
         else
         {
             // Simple types can be added directly in to the target
-            m_output << generateIndent ( ) << targetbuf.str ( ) << ".addField (" << namebuf.str ( ) << ");"
+            m_output << generateIndent ( ) << targetname << ".addField (" << elementname << ");"
                      << std::endl;
         }
 
@@ -423,14 +890,53 @@ void cppimplwriter::outputCollectionEncoder ( const std::string & targetvar,
 
         // Add the submessage to the target
         if ( index + 1 == field.constraints ( ).size ( ) )
-            outputEncoderFieldAdd ( targetvar, targetbuf.str ( ), field );
+            outputEncoderFieldAdd ( targetvar, targetname, field );
         else
-            m_output << generateIndent ( ) << targetvar << ".addField (" << targetbuf.str ( )
+            m_output << generateIndent ( ) << targetvar << ".addField (" << targetname
                                            << ");" << std::endl;
     }
 
 }
 
+void cppimplwriter::outputFlatEncoder ( const std::string & sourcevar, const fielddef & field )
+{
+    // Flat collections are written as a single native array, outermost row first
+    const std::string flatvar ( getIdLeaf ( field ) + "_flat" );
+    m_output << generateIndent ( ) << "// Encode flat collection " << sourcevar << " (" << field.idString ( ) << ")" << std::endl
+             << generateIndent ( ) << "std::vector<" << generateTypeName ( field.type ( ) ) << "> " << flatvar << ";" << std::endl
+             << generateIndent ( ) << flatvar << ".reserve (" << sourcevar << ".size () * " << generateFlatRowSize ( field ) << ");" << std::endl;
+
+    outputFlatEncoderRows ( flatvar, sourcevar, field, field.constraints ( ).size ( ) - 1 );
+    outputEncoderFieldAdd ( "target", flatvar, field );
+}
+
+void cppimplwriter::outputFlatEncoderRows ( const std::string & flatvar,
+                                            const std::string & sourcevar,
+                                            const fielddef & field,
+                                            size_t index )
+{
+    outputCollectionRowValidation ( field, sourcevar, "size", index );
+
+    if ( index == 0 )
+    {
+        m_output << generateIndent ( ) << flatvar << ".insert (" << flatvar << ".end (), " << sourcevar << ".begin (), "
+                                       << sourcevar << ".end ());" << std::endl;
+    }
+    else
+    {
+        m_output << generateIndent ( ) << "for (size_t index" << index << " (0); index" << index
+                                       << " < " << sourcevar << ".size (); ++index" << index << ")" << std::endl
+                 << generateIndent ( ) << "{" << std::endl;
+        ++m_depth;
+
+        const std::string rowname ( generateElementName ( sourcevar, index ) );
+        outputFlatEncoderRows ( flatvar, rowname, field, index - 1 );
+
+        --m_depth;
+        m_output << generateIndent ( ) << "}" << std::endl;
+    }
+}
+
 void cppimplwriter::outputCollectionRowValidation ( const fielddef & field,
                                                     const std::string & sourcevar,
                                                     const std::string & accessor,
@@ -447,7 +953,7 @@ void cppimplwriter::outputCollectionRowValidation ( const fielddef & field,
 
 void cppimplwriter::outputDecoderWrapper ( const messagedef & message )
 {
-    const std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
 
     if ( m_unsafe )
         m_output << indent << "// Unsafe mode, assume that message is for: " <<  message.originalIdString ( ) << std::endl;
@@ -467,13 +973,13 @@ void cppimplwriter::outputDecoderWrapper ( const messagedef & message )
     m_output << indent << "fromAnonFudgeMessage (source);" << std::endl;
 }
 
-void cppimplwriter::outputParentDecoder ( const messagedef & message )
+void cppimplwriter::outputParentDecoder ( const messagedef & )
 {
-    if ( ! message.parents ( ).empty (  ) )
+    if ( ! m_delegates.empty (  ) )
     {
-        const std::string indent ( generateIndent ( ) );
-        for ( size_t index ( 0 ); index < message.parents ( ).size ( ); ++index )
-            m_output << indent << generateIdString ( *message.parents ( ) [ index ] )
+        const std::string & indent ( generateIndent ( ) );
+        for ( size_t index ( 0 ); index < m_delegates.size ( ); ++index )
+            m_output << indent << generateIdString ( *m_delegates [ index ] )
                      << "::fromAnonFudgeMessage (source);" << std::endl;
         m_output << std::endl;
     }
@@ -481,16 +987,13 @@ void cppimplwriter::outputParentDecoder ( const messagedef & message )
 
 void cppimplwriter::outputDecoderField ( const fielddef * field )
 {
-    // Attempt to retrieve field from message by name
-    const std::string fieldname ( generateIdString ( field->id ( ) ) + "_field" );
-    m_output << generateIndent ( ) << "::fudge::field " << fieldname << ";" << std::endl
-             << generateIndent ( ) << "if (source.getField(" << fieldname << ", ::fudge::string (\""
-                                   << generateIdString ( field->id ( ) ) << "\")))" << std::endl
-             << generateIndent ( ) << "{" << std::endl;
+    // Retrieve the field located by name
+    const std::string fieldname ( outputFieldLookup ( *field ) );
+    m_output << generateIndent ( ) << "{" << std::endl;
     ++m_depth;
-    const std::string indent ( generateIndent ( ) );
+    const std::string & indent ( generateIndent ( ) );
 
-    const std::string membername ( generateMemberName ( *field ) );
+    const std::string membername ( m_memberScope + generateMemberName ( *field ) );
     std::string memberargname;
     if ( field->isOptional ( ) && ( field->isCollection ( ) || ! field->type ( ).isComplex ( ) ) )
         memberargname = "(*" + membername + ")";
@@ -504,14 +1007,16 @@ void cppimplwriter::outputDecoderField ( const fielddef * field )
             m_output << indent << membername << " = " << generateTrueType ( *field ) <<  " ();" << std::endl
                      << std::endl;
 
-        outputCollectionDecoder ( fieldname, memberargname, *field, field->constraints ( ).size ( ) - 1 );
+        if ( field->hasOption ( FUDGEPROTO_OPTION_FLAT ) )
+            outputFlatDecoder ( fieldname, memberargname, *field );
+        else
+            outputCollectionDecoder ( fieldname, memberargname, *field, field->constraints ( ).size ( ) - 1 );
         m_output << std::endl;
     }
     else if ( field->type ( ).isComplex ( ) )
     {
-        const std::string member ( generateMemberName ( *field ) );
-        m_output << indent << "delete " << member << ";" << std::endl
-                 << indent << member << " = new " << generateTypeName ( field->type ( ) ) << ";" << std::endl
+        m_output << indent << "delete " << membername << ";" << std::endl
+                 << indent << membername << " = new " << generateTypeName ( field->type ( ) ) << ";" << std::endl
                  << indent << membername << "->fromFudgeMessage (" << fieldname
                            << ".getMessage ());" << std::endl;
     }
@@ -557,48 +1062,46 @@ void cppimplwriter::outputCollectionDecoder ( const std::string & sourcevar,
     else
     {
         // Retrieve the submessage for this array
-        std::stringstream messagebuf;
-        messagebuf << getIdLeaf ( field ) << index;
-        m_output << generateIndent ( ) << "const ::fudge::message " << messagebuf.str ( ) << " ("
+        const std::string messagename ( getIdLeaf ( field ) + generateNumber ( index ) );
+        m_output << generateIndent ( ) << "const ::fudge::message " << messagename << " ("
                                        << sourcevar << ".getMessage ());" << std::endl;
 
         // Ensure the array has the correct number of elements
-        outputCollectionRowValidation ( field, messagebuf.str ( ), "size", index );
+        outputCollectionRowValidation ( field, messagename, "size", index );
 
         // Make sure the target has sufficient space
-        m_output << generateIndent ( ) << targetvar << ".resize (" << messagebuf.str ( ) << ".size ());" << std::endl;
+        m_output << generateIndent ( ) << targetvar << ".resize (" << messagename << ".size ());" << std::endl;
 
         // Loop over the fields in the submessage
         m_output << generateIndent ( ) << "for (size_t index" << index << " (0); index" << index
-                                       << " < " << messagebuf.str ( ) << ".size (); ++index" << index << ")" << std::endl
+                                       << " < " << messagename << ".size (); ++index" << index << ")" << std::endl
                  << generateIndent ( ) << "{" << std::endl;
         ++m_depth;
 
-        const std::string fieldname ( messagebuf.str ( ) + "_field" );
-        m_output << generateIndent ( ) << "const ::fudge::field " << fieldname << " (" << messagebuf.str ( )
+        const std::string fieldname ( messagename + "_field" );
+        m_output << generateIndent ( ) << "const ::fudge::field " << fieldname << " (" << messagename
                                        << ".getFieldAt (index" << index << "));" << std::endl;
 
         // Reference to target element
-        std::stringstream targetbuf;
-        targetbuf << targetvar << "[index" << index << "]";
+        const std::string targetname ( generateElementName ( targetvar, index ) );
 
         if ( index )
         {
-            outputCollectionDecoder ( fieldname, targetbuf.str ( ), field, index - 1 );
+            outputCollectionDecoder ( fieldname, targetname, field, index - 1 );
         }
         else if ( field.type ( ).isComplex ( ) )
         {
-            const std::string outerindent ( generateIndent ( ) );
+            const std::string & outerindent ( generateIndent ( ) );
             ++m_depth;
-            const std::string innerindent ( generateIndent ( ) );
+            const std::string & innerindent ( generateIndent ( ) );
 
             m_output << outerindent << "if (" << fieldname << ".type () == FUDGE_TYPE_INDICATOR)" << std::endl
-                     << innerindent << targetbuf.str ( ) << " = 0;" << std::endl
+                     << innerindent << targetname << " = 0;" << std::endl
                      << outerindent << "else" << std::endl
                      << outerindent << "{" << std::endl
-                     << innerindent << targetbuf.str ( ) << " = new " << generateTypeName ( field.type ( ) )
+                     << innerindent << targetname << " = new " << generateTypeName ( field.type ( ) )
                                     << ";" << std::endl
-                     << innerindent << targetbuf.str ( ) << "->fromFudgeMessage (" << fieldname
+                     << innerindent << targetname << "->fromFudgeMessage (" << fieldname
                                     << ".getMessage ());" << std::endl
                      << outerindent << "}" << std::endl;
 
@@ -606,7 +1109,7 @@ void cppimplwriter::outputCollectionDecoder ( const std::string & sourcevar,
         }
         else
         {
-            m_output << generateIndent ( ) << targetbuf.str ( ) << " = " << generateFieldAccessorCast ( field )
+            m_output << generateIndent ( ) << targetname << " = " << generateFieldAccessorCast ( field )
                                            << fieldname << "." << generateFieldAccessor ( field ) << ";" << std::endl;
         }
 
@@ -616,6 +1119,254 @@ void cppimplwriter::outputCollectionDecoder ( const std::string & sourcevar,
     }
 }
 
+void cppimplwriter::outputFlatDecoder ( const std::string & sourcevar,
+                                        const std::string & targetvar,
+                                        const fielddef & field )
+{
+    const std::string flatvar ( getIdLeaf ( field ) + "_flat" ),
+                      itvar ( getIdLeaf ( field ) + "_it" ),
+                      rowsize ( generateFlatRowSize ( field ) ),
+                      error ( "throw std::runtime_error ( \"Collection field \\\"" + field.idString ( ) + "\\\" has incorrect dimensions\");" );
+    const std::string elementtype ( generateTypeName ( field.type ( ) ) );
+    const std::string & indent ( generateIndent ( ) );
+    const size_t outer ( field.constraints ( ).size ( ) - 1 );
+
+    // The whole collection arrives as a single native array, which is split in to
+    // rows of the fixed inner dimensions
+    m_output << indent << "// Decode flat collection " << targetvar << " (" << field.idString ( ) << ")" << std::endl
+             << indent << "std::vector<" << elementtype << "> " << flatvar << ";" << std::endl
+             << indent << sourcevar << ".getArray (" << flatvar << ");" << std::endl
+             << indent << "if (" << flatvar << ".size () % " << rowsize << ")" << std::endl
+             << indent << s_indent << error << std::endl;
+    if ( field.constraints ( ) [ outer ] >= 0 )
+        m_output << indent << "if (" << flatvar << ".size () / " << rowsize << " != " << field.constraints ( ) [ outer ] << ")" << std::endl
+                 << indent << s_indent << error << std::endl;
+
+    m_output << indent << "std::vector<" << elementtype << ">::const_iterator " << itvar << " (" << flatvar << ".begin ());" << std::endl
+             << indent << targetvar << ".resize (" << flatvar << ".size () / " << rowsize << ");" << std::endl
+             << indent << "for (size_t index" << outer << " (0); index" << outer << " < " << targetvar
+                       << ".size (); ++index" << outer << ")" << std::endl
+             << indent << "{" << std::endl;
+    ++m_depth;
+
+    const std::string rowname ( generateElementName ( targetvar, outer ) );
+    outputFlatDecoderRows ( itvar, rowname, field, outer - 1 );
+
+    --m_depth;
+    m_output << indent << "}" << std::endl;
+}
+
+void cppimplwriter::outputFlatDecoderRows ( const std::string & itvar,
+                                            const std::string & targetvar,
+                                            const fielddef & field,
+                                            size_t index )
+{
+    const int constraint ( field.constraints ( ) [ index ] );
+
+    if ( index == 0 )
+    {
+        m_output << generateIndent ( ) << targetvar << ".assign (" << itvar << ", " << itvar << " + " << constraint << ");" << std::endl
+                 << generateIndent ( ) << itvar << " += " << constraint << ";" << std::endl;
+    }
+    else
+    {
+        m_output << generateIndent ( ) << targetvar << ".resize (" << constraint << ");" << std::endl
+                 << generateIndent ( ) << "for (size_t index" << index << " (0); index" << index
+                                       << " < " << constraint << "; ++index" << index << ")" << std::endl
+                 << generateIndent ( ) << "{" << std::endl;
+        ++m_depth;
+
+        const std::string rowname ( generateElementName ( targetvar, index ) );
+        outputFlatDecoderRows ( itvar, rowname, field, index - 1 );
+
+        --m_depth;
+        m_output << generateIndent ( ) << "}" << std::endl;
+    }
+}
+
+void cppimplwriter::outputValidatorWrapper ( const messagedef & message )
+{
+    const std::string & indent ( generateIndent ( ) );
+
+    if ( m_unsafe )
+        m_output << indent << "// Unsafe mode, assume that message is for: " <<  message.originalIdString ( ) << std::endl;
+    else
+        m_output << indent << "static const fudge_i16 ordinal (0);" << std::endl
+                 << indent << "static const ::fudge::string expected (\"" << message.originalIdString ( ) << "\");" << std::endl
+                 << std::endl
+                 << indent << "::fudge::field type;" << std::endl
+                 << indent << "if (!source.getField (type, ordinal) || type.type () != FUDGE_TYPE_STRING)" << std::endl
+                 << indent << s_indent << "return false;" << std::endl
+                 << indent << "if (expected != type.getString ())" << std::endl
+                 << indent << s_indent << "return false;" << std::endl
+                 << std::endl;
+
+    m_output << indent << "return validateAnon (source);" << std::endl;
+}
+
+void cppimplwriter::outputParentValidator ( const messagedef & )
+{
+    if ( ! m_delegates.empty ( ) )
+    {
+        const std::string & indent ( generateIndent ( ) );
+        for ( size_t index ( 0 ); index < m_delegates.size ( ); ++index )
+            m_output << indent << "if (!" << generateIdString ( *m_delegates [ index ] )
+                     << "::validateAnon (source))" << std::endl
+                     << indent << s_indent << "return false;" << std::endl;
+        m_output << std::endl;
+    }
+}
+
+void cppimplwriter::outputValidatorField ( const fielddef * field )
+{
+    // Fields are located the same way as the decoder finds them, by name
+    const std::string fieldname ( outputFieldLookup ( *field ) );
+    m_output << generateIndent ( ) << "{" << std::endl;
+    ++m_depth;
+
+    if ( field->hasOption ( FUDGEPROTO_OPTION_FLAT ) )
+        outputFlatValidator ( fieldname, *field );
+    else if ( field->isCollection ( ) )
+        outputCollectionValidator ( fieldname, *field, field->constraints ( ).size ( ) - 1 );
+    else
+        outputValidatorCheck ( generateFieldTypeCheck ( *field, fieldname ) );
+
+    --m_depth;
+    m_output << generateIndent ( ) << "}" << std::endl;
+
+    // Missing required fields fail validation
+    if ( ! field->isOptional ( ) )
+        m_output << generateIndent ( ) << "else" << std::endl
+                 << generateIndent ( ) << s_indent << "return false;" << std::endl;
+
+    m_output << std::endl;
+}
+
+void cppimplwriter::outputCollectionValidator ( const std::string & sourcevar,
+                                                const fielddef & field,
+                                                size_t index )
+{
+    if ( index == 0 && ( field.type ( ).isInteger ( ) || field.type ( ).isFloating ( ) ) )
+    {
+        // Arrays of integers or floats are stored as Fudge native arrays
+        outputValidatorCheck ( generateArrayTypeCheck ( field, sourcevar ) );
+
+        const int constraint ( field.constraints ( ) [ index ] );
+        if ( constraint >= 0 )
+        {
+            outputValidatorCheck ( sourcevar + ".numelements () == " + generateNumber ( constraint ) );
+        }
+    }
+    else
+    {
+        // Everything else is held in a submessage, one field per element
+        outputValidatorCheck ( sourcevar + ".type () == FUDGE_TYPE_FUDGE_MSG" );
+
+        const std::string messagename ( getIdLeaf ( field ) + generateNumber ( index ) );
+        m_output << generateIndent ( ) << "const ::fudge::message " << messagename << " ("
+                                       << sourcevar << ".getMessage ());" << std::endl;
+
+        const int constraint ( field.constraints ( ) [ index ] );
+        if ( constraint >= 0 )
+        {
+            outputValidatorCheck ( messagename + ".size () == " + generateNumber ( constraint ) );
+        }
+
+        // Loop over the fields in the submessage
+        m_output << generateIndent ( ) << "for (size_t index" << index << " (0); index" << index
+                                       << " < " << messagename << ".size (); ++index" << index << ")" << std::endl
+                 << generateIndent ( ) << "{" << std::endl;
+        ++m_depth;
+
+        const std::string fieldname ( messagename + "_field" );
+        m_output << generateIndent ( ) << "const ::fudge::field " << fieldname << " (" << messagename
+                                       << ".getFieldAt (index" << index << "));" << std::endl;
+
+        if ( index )
+            outputCollectionValidator ( fieldname, field, index - 1 );
+        else if ( field.type ( ).isComplex ( ) )
+        {
+            // Null elements are encoded as indicators
+            outputValidatorCheck ( fieldname + ".type () == FUDGE_TYPE_INDICATOR || ("
+                                   + generateFieldTypeCheck ( field, fieldname ) + ")" );
+        }
+        else
+            outputValidatorCheck ( generateFieldTypeCheck ( field, fieldname ) );
+
+        // Finish element loop
+        --m_depth;
+        m_output << generateIndent ( ) << "}" << std::endl;
+    }
+}
+
+void cppimplwriter::outputFlatValidator ( const std::string & sourcevar, const fielddef & field )
+{
+    const std::string rowsize ( generateFlatRowSize ( field ) );
+    const size_t outer ( field.constraints ( ).size ( ) - 1 );
+
+    outputValidatorCheck ( generateArrayTypeCheck ( field, sourcevar ) );
+    outputValidatorCheck ( sourcevar + ".numelements () % " + rowsize + " == 0" );
+    if ( field.constraints ( ) [ outer ] >= 0 )
+    {
+        outputValidatorCheck ( sourcevar + ".numelements () / " + rowsize + " == " + generateNumber ( field.constraints ( ) [ outer ] ) );
+    }
+}
+
+void cppimplwriter::outputValidatorCheck ( const std::string & condition )
+{
+    m_output << generateIndent ( ) << "if (!(" << condition << "))" << std::endl
+             << generateIndent ( ) << s_indent << "return false;" << std::endl;
+}
+
+std::string cppimplwriter::generateFieldTypeCheck ( const fielddef & field, const std::string & fieldvar )
+{
+    const fieldtype & type ( field.type ( ) );
+    const std::string fieldtype ( fieldvar + ".type ()" );
+
+    switch ( type.type ( ) )
+    {
+        case FUDGEPROTO_TYPE_BOOLEAN:   return fieldtype + " == FUDGE_TYPE_BOOLEAN";
+        case FUDGEPROTO_TYPE_BYTE:
+        case FUDGEPROTO_TYPE_SHORT:
+        case FUDGEPROTO_TYPE_INT:
+        case FUDGEPROTO_TYPE_LONG:      return fieldtype + " >= FUDGE_TYPE_BYTE && " + fieldtype + " <= FUDGE_TYPE_LONG";
+        case FUDGEPROTO_TYPE_FLOAT:
+        case FUDGEPROTO_TYPE_DOUBLE:    return fieldtype + " == FUDGE_TYPE_FLOAT || " + fieldtype + " == FUDGE_TYPE_DOUBLE";
+        case FUDGEPROTO_TYPE_STRING:    return fieldtype + " == FUDGE_TYPE_STRING";
+        case FUDGEPROTO_TYPE_MESSAGE:   return fieldtype + " == FUDGE_TYPE_FUDGE_MSG";
+        case FUDGEPROTO_TYPE_DATE:      return fieldtype + " == FUDGE_TYPE_DATE";
+        case FUDGEPROTO_TYPE_TIME:      return fieldtype + " == FUDGE_TYPE_TIME";
+        case FUDGEPROTO_TYPE_DATETIME:  return fieldtype + " == FUDGE_TYPE_DATETIME";
+        case FUDGEPROTO_TYPE_USER:
+            if ( typeid ( type.def ( ) ) == typeid ( enumdef ) )
+                return fieldtype + " >= FUDGE_TYPE_BYTE && " + fieldtype + " <= FUDGE_TYPE_LONG";
+            else
+                return fieldtype + " == FUDGE_TYPE_FUDGE_MSG && " + generateTypeName ( type )
+                                 + "::validate (" + fieldvar + ".getMessage ())";
+        default:
+            throw std::invalid_argument ( "No type check for field type in C++ Impl writer" );
+    }
+}
+
+std::string cppimplwriter::generateArrayTypeCheck ( const fielddef & field, const std::string & fieldvar )
+{
+    const std::string fieldtype ( fieldvar + ".type ()" );
+
+    switch ( field.type ( ).type ( ) )
+    {
+        case FUDGEPROTO_TYPE_BYTE:      return fieldtype + " == FUDGE_TYPE_BYTE_ARRAY || ("
+                                             + fieldtype + " >= FUDGE_TYPE_BYTE_ARRAY_4 && "
+                                             + fieldtype + " <= FUDGE_TYPE_BYTE_ARRAY_512)";
+        case FUDGEPROTO_TYPE_SHORT:     return fieldtype + " == FUDGE_TYPE_SHORT_ARRAY";
+        case FUDGEPROTO_TYPE_INT:       return fieldtype + " == FUDGE_TYPE_INT_ARRAY";
+        case FUDGEPROTO_TYPE_LONG:      return fieldtype + " == FUDGE_TYPE_LONG_ARRAY";
+        case FUDGEPROTO_TYPE_FLOAT:     return fieldtype + " == FUDGE_TYPE_FLOAT_ARRAY";
+        case FUDGEPROTO_TYPE_DOUBLE:    return fieldtype + " == FUDGE_TYPE_DOUBLE_ARRAY";
+        default:
+            throw std::invalid_argument ( "No native array type for field type in C++ Impl writer" );
+    }
+}
+
 std::string cppimplwriter::generateFieldAccessor ( const fielddef & field )
 {
     const fieldtype & type ( field.type ( ) );
@@ -19,6 +19,8 @@
 
 #include "cppwriter.hpp"
 #include <deque>
+#include <map>
+#include <set>
 
 namespace fudgeproto {
 
@@ -33,6 +35,9 @@ class cppimplwriter : public cppwriter
         void fileFooter ( const identifier & id );
         void includeExternal ( const messagedef & ref,
                                const filenamegenerator & filenamegen );
+        void declareExternal ( const messagedef & ref,
+                               const filenamegenerator & filenamegen,
+                               bool direct );
         void endOfExternals ( size_t count );
         void includeStandard ( );
         void startNamespace ( const identifier & ns );
@@ -41,9 +46,35 @@ class cppimplwriter : public cppwriter
         void startClass ( const messagedef & message );
         void endClass ( const messagedef & message );
         void classFields ( const messagedef & message );
+        void registryFileHeader ( const identifier & name,
+                                  const filenamegenerator & filenamegen );
+        void registryClass ( const identifier & name,
+                             const std::vector<const messagedef *> & messages,
+                             const perfecthash & hash );
+        void amalgamationHeader ( const std::vector<const messagedef *> & messages,
+                                  const filenamegenerator & filenamegen );
 
     private:
         std::deque<std::string> m_stack;
+        std::map<std::string, size_t> m_fieldslots;
+        size_t m_numslots;
+        std::vector<const identifier *> m_delegates;
+        std::vector<std::pair<std::string, const fielddef *> > m_inherited;
+        std::string m_memberScope;
+        bool m_scoped;
+        size_t m_numincludes;
+
+        void flattenHierarchy ( const messagedef & message );
+        bool flattenParents ( const messagedef & message,
+                              std::set<const messagedef *> & visited,
+                              std::set<std::string> & names,
+                              std::set<std::string> & delegates );
+        void outputInheritedFields ( void ( cppimplwriter::*writer ) ( const fielddef * ) );
+
+        void outputHashFunction ( );
+        void outputFieldLocator ( const messagedef & message, const perfecthash & hash );
+        void outputFieldLocatorCall ( const messagedef & message );
+        std::string outputFieldLookup ( const fielddef & field );
 
         void outputMemberInitialiser ( const fielddef * field );
         void outputMemberCleanup ( const fielddef * field );
@@ -61,6 +92,11 @@ class cppimplwriter : public cppwriter
                                        const std::string & sourcevar,
                                        const fielddef & field,
                                        size_t index );
+        void outputFlatEncoder ( const std::string & sourcevar, const fielddef & field );
+        void outputFlatEncoderRows ( const std::string & flatvar,
+                                     const std::string & sourcevar,
+                                     const fielddef & field,
+                                     size_t index );
         void outputCollectionRowValidation ( const fielddef & field,
                                              const std::string & sourcevar,
                                              const std::string & accessor,
@@ -75,9 +111,28 @@ class cppimplwriter : public cppwriter
         void outputCollectionFieldValidation ( const fielddef & field,
                                                const std::string & sourcevar,
                                                size_t index );
+        void outputFlatDecoder ( const std::string & sourcevar,
+                                 const std::string & targetvar,
+                                 const fielddef & field );
+        void outputFlatDecoderRows ( const std::string & itvar,
+                                     const std::string & targetvar,
+                                     const fielddef & field,
+                                     size_t index );
+        void outputValidatorWrapper ( const messagedef & message );
+        void outputParentValidator ( const messagedef & message );
+        void outputValidatorField ( const fielddef * field );
+        void outputCollectionValidator ( const std::string & sourcevar,
+                                         const fielddef & field,
+                                         size_t index );
+        void outputFlatValidator ( const std::string & sourcevar, const fielddef & field );
+        void outputValidatorCheck ( const std::string & condition );
 
+        std::string generateFlatRowSize ( const fielddef & field );
+        std::string generateLocatorName ( const messagedef & message );
         std::string generateFieldAccessor ( const fielddef & field );
         std::string generateFieldAccessorCast ( const fielddef & field );
+        std::string generateFieldTypeCheck ( const fielddef & field, const std::string & fieldvar );
+        std::string generateArrayTypeCheck ( const fielddef & field, const std::string & fieldvar );
         std::string generateDefaultValue ( const fielddef & field );
         std::string generateLiteralValue ( const literalvalue & value );
 
@@ -54,12 +54,13 @@ std::string cppwriter::generateTypeName ( const fieldtype & type )
     }
 }
 
-std::string cppwriter::generateIndent ( ) const
+const std::string & cppwriter::generateIndent ( ) const
 {
-    std::string indent;
-    for ( size_t index ( 0 ); index < m_depth; ++index )
-        indent += s_indent;
-    return indent;
+    // Each depth's indent is built once. Growing a deque leaves the existing
+    // elements in place, so references returned earlier stay valid.
+    while ( m_indents.size ( ) <= m_depth )
+        m_indents.push_back ( m_indents.empty ( ) ? std::string ( ) : m_indents.back ( ) + s_indent );
+    return m_indents [ m_depth ];
 }
 
 std::string cppwriter::generateHeader ( ) const
@@ -95,7 +96,7 @@ std::string cppwriter::generateHeader ( ) const
 
 std::string cppwriter::generateIdString ( const identifier & id )
 {
-    return id.asString ( "::" );
+    return id.scoped ( );
 }
 
 std::string cppwriter::generateMemberName ( const fielddef & field )
@@ -163,6 +164,27 @@ std::string cppwriter::generateArgType ( const fielddef & field )
     return type;
 }
 
+std::string cppwriter::generateTypeIdName ( const messagedef & message )
+{
+    // The elements are joined with underscores, and each underscore within an
+    // element is followed by a 1. As no element can start with a digit, two
+    // different names, such as a_b.C and a.b_C, can never give the same result.
+    std::string name;
+    for ( size_t index ( 0 ); index < message.id ( ).size ( ); ++index )
+    {
+        if ( index )
+            name += '_';
+        const std::string & element ( message.id ( ) [ index ] );
+        for ( std::string::const_iterator it ( element.begin ( ) ); it != element.end ( ); ++it )
+        {
+            name += *it;
+            if ( *it == '_' )
+                name += '1';
+        }
+    }
+    return name;
+}
+
 std::string cppwriter::escapeString ( const std::string & string )
 {
     std::string newstring;
@@ -190,6 +212,29 @@ std::string cppwriter::escapeString ( const std::string & string )
     return newstring;
 }
 
+std::string cppwriter::generateNumber ( long value )
+{
+    // Formatted by hand rather than through a stream, as the writers need a
+    // great many of these for the collection loops
+    char buffer [ 24 ];
+    char * start ( buffer + sizeof ( buffer ) );
+    unsigned long magnitude ( value < 0 ? 0ul - static_cast<unsigned long> ( value ) : value );
+    do
+    {
+        *--start = static_cast<char> ( '0' + magnitude % 10 );
+        magnitude /= 10;
+    }
+    while ( magnitude );
+    if ( value < 0 )
+        *--start = '-';
+    return std::string ( start, buffer + sizeof ( buffer ) );
+}
+
+std::string cppwriter::generateElementName ( const std::string & collection, size_t index )
+{
+    return collection + "[index" + generateNumber ( index ) + "]";
+}
+
 std::string cppwriter::generateStorageType ( const fielddef & field )
 {
     std::string name ( generateTypeName ( field.type ( ) ) );
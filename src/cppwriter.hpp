@@ -18,6 +18,7 @@
 #define INC_FUDGEPROTO_CPPWRITER
 
 #include "codewriter.hpp"
+#include <deque>
 
 namespace fudgeproto {
 
@@ -34,17 +35,23 @@ class cppwriter : public codewriter
         const std::string & getIdLeaf ( const definition & def );
 
         std::string generateTypeName ( const fieldtype & type );
-        std::string generateIndent ( ) const;
+        const std::string & generateIndent ( ) const;
         std::string generateHeader ( ) const;
         std::string generateIdString ( const identifier & id );
         std::string generateMemberName ( const fielddef & field );
         std::string generateTrueType ( const fielddef & field );
         std::string generateMemberType ( const fielddef & field );
         std::string generateArgType ( const fielddef & field );
+        std::string generateTypeIdName ( const messagedef & message );
 
         std::string escapeString ( const std::string & string );
 
+        static std::string generateNumber ( long value );
+        static std::string generateElementName ( const std::string & collection, size_t index );
+
     private:
+        mutable std::deque<std::string> m_indents;
+
         std::string generateStorageType ( const fielddef & field );
 };
 
@@ -31,6 +31,7 @@ filenamegenerator::filenamegenerator ( const std::string & path,
     , m_headerext ( headerext )
     , m_implext ( implext )
     , m_lowercase ( lowercase )
+    , m_amalgamated ( false )
 {
 }
 
@@ -55,3 +56,20 @@ std::string filenamegenerator::generate ( const messagedef & message,
     return generate ( message.id ( ).asString ( "_" ), header, local );
 }
 
+void filenamegenerator::setAmalgamation ( const std::string & name )
+{
+    m_amalgamated = true;
+    m_amalgamation = name;
+}
+
+std::string filenamegenerator::amalgamation ( const messagedef & message ) const
+{
+    if ( ! m_amalgamation.empty ( ) )
+        return m_amalgamation;
+
+    // Suffixed to keep it apart from the files of a message with the same
+    // name as the namespace
+    refptr<identifier> ns ( message.id ( ).clone ( ) );
+    ns->pop ( );
+    return ns->size ( ) ? ns->asString ( "_" ) + "_amalgamated" : "amalgamated";
+}
@@ -36,11 +36,21 @@ class filenamegenerator
                                bool header,
                                bool local ) const;
 
+        // Implementation files can be amalgamated, either in to one per
+        // namespace or, if a name is given, in to a single file
+        void setAmalgamation ( const std::string & name );
+        inline bool isAmalgamated ( ) const { return m_amalgamated; }
+
+        // Name of the amalgamated file containing a top-level message
+        std::string amalgamation ( const messagedef & message ) const;
+
     private:
         std::string m_path,
                     m_headerext,
-                    m_implext;
-        bool m_lowercase;
+                    m_implext,
+                    m_amalgamation;
+        bool m_lowercase,
+             m_amalgamated;
 
         static const std::string s_pathsep,
                                  s_extsep;
@@ -15,6 +15,9 @@
  */
 
 #include "memoryutil.hpp"
+#include "config.h"
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
@@ -33,25 +36,199 @@ char * strdup ( const char * string )
     return strdup ( string, strlen ( string ) );
 }
 
+arena * arena::s_current ( 0 );
+arena::leakhandler arena::s_leakHandler ( arena::reportLeak );
+
+arena::arena ( )
+    : m_next ( 0 )
+    , m_end ( 0 )
+    , m_live ( 0 )
+    , m_lock ( 0 )
+{
+    std::fill ( m_free, m_free + s_maxSize / s_granularity, static_cast<freenode *> ( 0 ) );
+}
+
+arena::~arena ( )
+{
+    // Freeing the blocks would leave the live allocations dangling
+    if ( m_live )
+    {
+        s_leakHandler ( m_live );
+        return;
+    }
+
+    // Everything allocated from the arena is released in one go
+    for ( std::vector<char *>::iterator it ( m_blocks.begin ( ) ); it != m_blocks.end ( ); ++it )
+        ::operator delete ( *it );
+}
+
+void * arena::allocate ( size_t size )
+{
+    if ( ! size || size > s_maxSize )
+    {
+        void * pointer ( ::operator new ( size ) );
+        lock ( );
+        ++m_live;
+        unlock ( );
+        return pointer;
+    }
+
+    const size_t index ( ( size - 1 ) / s_granularity );
+    const size_t rounded ( ( index + 1 ) * s_granularity );
+
+    lock ( );
+    void * pointer ( m_free [ index ] );
+    if ( pointer )
+        m_free [ index ] = m_free [ index ]->next;
+    else
+    {
+        if ( m_next + rounded > m_end )
+        {
+            try
+            {
+                m_blocks.reserve ( m_blocks.size ( ) + 1 );
+                m_blocks.push_back ( static_cast<char *> ( ::operator new ( s_blockSize ) ) );
+            }
+            catch ( ... )
+            {
+                unlock ( );
+                throw;
+            }
+            m_next = m_blocks.back ( );
+            m_end = m_next + s_blockSize;
+        }
+        pointer = m_next;
+        m_next += rounded;
+    }
+    ++m_live;
+    unlock ( );
+    return pointer;
+}
+
+void arena::deallocate ( void * pointer, size_t size )
+{
+    if ( ! size || size > s_maxSize )
+    {
+        ::operator delete ( pointer );
+        lock ( );
+        --m_live;
+        unlock ( );
+        return;
+    }
+
+    freenode * node ( static_cast<freenode *> ( pointer ) );
+    const size_t index ( ( size - 1 ) / s_granularity );
+    lock ( );
+    --m_live;
+    node->next = m_free [ index ];
+    m_free [ index ] = node;
+    unlock ( );
+}
+
+// The lock is only held for a few instructions, so spin rather than sleep
+void arena::lock ( )
+{
+#ifdef HAS_ATOMIC_BUILTINS
+    while ( __sync_lock_test_and_set ( &m_lock, 1 ) )
+        while ( m_lock ) { }
+#endif
+}
+
+void arena::unlock ( )
+{
+#ifdef HAS_ATOMIC_BUILTINS
+    __sync_lock_release ( &m_lock );
+#endif
+}
+
+arena::leakhandler arena::setLeakHandler ( leakhandler handler )
+{
+    const leakhandler previous ( s_leakHandler );
+    s_leakHandler = handler;
+    return previous;
+}
+
+void arena::reportLeak ( size_t live )
+{
+    std::cerr << "WARNING: arena destroyed with " << live << " allocations still live, its memory is kept" << std::endl;
+}
+
+void arena::abortOnLeak ( size_t live )
+{
+    std::cerr << "FATAL: arena destroyed with " << live << " allocations still live" << std::endl;
+    std::abort ( );
+}
+
+arena::scope::scope ( arena & target )
+    : m_previous ( s_current )
+{
+    s_current = &target;
+}
+
+arena::scope::~scope ( )
+{
+    s_current = m_previous;
+}
+
+namespace
+{
+    // Prefixed to each refcounted object, recording where it was allocated
+    union allocheader
+    {
+        arena * owner;
+        double alignment;
+    };
+}
+
 refcounted::refcounted ( )
-    : m_refcount ( new refcount_type )
+    : m_refcount ( 1 )
 {
-    *m_refcount = 1;
 }
 
 refcounted::~refcounted ( )
 {
-    delete m_refcount;
 }
 
+void * refcounted::operator new ( size_t size )
+{
+    arena * owner ( arena::current ( ) );
+    const size_t total ( size + sizeof ( allocheader ) );
+    allocheader * header ( static_cast<allocheader *> ( owner ? owner->allocate ( total ) : ::operator new ( total ) ) );
+    header->owner = owner;
+    return header + 1;
+}
+
+// The destructor is virtual, so size is that of the most derived type
+void refcounted::operator delete ( void * pointer, size_t size )
+{
+    if ( ! pointer )
+        return;
+
+    allocheader * header ( static_cast<allocheader *> ( pointer ) - 1 );
+    if ( header->owner )
+        header->owner->deallocate ( header, size + sizeof ( allocheader ) );
+    else
+        ::operator delete ( header );
+}
+
+// The AST is shared between code generation threads, so where possible the
+// reference counts are updated atomically
 void refcounted::increment ( ) const
 {
-    ( *m_refcount ) += 1;
+#ifdef HAS_ATOMIC_BUILTINS
+    __sync_add_and_fetch ( &m_refcount, 1 );
+#else
+    m_refcount += 1;
+#endif
 }
 
 bool refcounted::decrement ( ) const
 {
-    return ( ( *m_refcount ) -= 1 ) < 1;
+#ifdef HAS_ATOMIC_BUILTINS
+    return __sync_sub_and_fetch ( &m_refcount, 1 ) < 1;
+#else
+    return ( m_refcount -= 1 ) < 1;
+#endif
 }
 
 }
@@ -19,17 +19,93 @@
 
 #include <cstddef>
 #include <typeinfo>
+#include <vector>
 
 namespace fudgeproto {
 
 char * strdup ( const char * string, size_t numchars );
 char * strdup ( const char * string );
 
+// Allocates small objects from large blocks, which are only returned to the
+// heap when the arena is destroyed. Freed objects are kept on per-size free
+// lists and reused. Safe to use from several threads.
+class arena
+{
+    public:
+        // Called when an arena is destroyed while some of its allocations are
+        // still live. The arena's memory is then kept, so they aren't left
+        // dangling.
+        typedef void ( *leakhandler ) ( size_t live );
+
+        arena ( );
+        ~arena ( );
+
+        void * allocate ( size_t size );
+        void deallocate ( void * pointer, size_t size );
+
+        inline size_t blocks ( ) const { return m_blocks.size ( ); }
+        inline size_t live ( ) const { return m_live; }
+
+        // Replaces the leak handler, returning the previous one. The default
+        // is reportLeak, tests use abortOnLeak so that a leak fails loudly.
+        static leakhandler setLeakHandler ( leakhandler handler );
+        static void reportLeak ( size_t live );
+        static void abortOnLeak ( size_t live );
+
+        // The arena that new refcounted objects are allocated from, if any
+        static inline arena * current ( ) { return s_current; }
+
+        // Makes an arena current for the lifetime of the scope
+        class scope
+        {
+            public:
+                scope ( arena & target );
+                ~scope ( );
+
+            private:
+                arena * m_previous;
+
+                scope ( const scope & source );
+                scope & operator= ( const scope & source );
+        };
+
+    private:
+        struct freenode
+        {
+            freenode * next;
+        };
+
+        static const size_t s_granularity = 16;
+        static const size_t s_maxSize = 512;
+        static const size_t s_blockSize = 65536;
+
+        std::vector<char *> m_blocks;
+        char * m_next;
+        char * m_end;
+        freenode * m_free [ s_maxSize / s_granularity ];
+        size_t m_live;
+        volatile int m_lock;
+
+        static arena * s_current;
+        static leakhandler s_leakHandler;
+
+        void lock ( );
+        void unlock ( );
+
+        // Don't allow copying - the blocks belong to a single arena
+        arena ( const arena & source );
+        arena & operator= ( const arena & source );
+};
+
 class refcounted
 {
     public:
         refcounted ( );
 
+        // Nodes are allocated from the current arena, if there is one
+        static void * operator new ( size_t size );
+        static void operator delete ( void * pointer, size_t size );
+
         static inline void inc ( const refcounted * object )
         {
             if ( object )
@@ -42,7 +118,7 @@ class refcounted
                 delete object;
         }
 
-        inline int refcount ( ) const { return *m_refcount; }
+        inline int refcount ( ) const { return m_refcount; }
 
     protected:
         virtual ~refcounted ( );
@@ -53,7 +129,7 @@ class refcounted
     private:
         typedef int refcount_type;
 
-        mutable refcount_type * m_refcount;
+        mutable refcount_type m_refcount;
 
         // Don't allow copying - use the reference counting!
         refcounted ( const refcounted & source );
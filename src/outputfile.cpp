@@ -0,0 +1,161 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "outputfile.hpp"
+#include "config.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef HAS_GETPID
+#include <unistd.h>
+#endif
+
+using namespace fudgeproto;
+
+const uint64_t outputfile::s_hashBasis ( 14695981039346656037ull );
+const size_t outputfile::s_initialCapacity ( 16384 );
+
+emitbuffer::emitbuffer ( size_t capacity )
+    : m_storage ( capacity ? capacity : 1 )
+{
+    setp ( &m_storage [ 0 ], &m_storage [ 0 ] + m_storage.size ( ) );
+}
+
+emitbuffer::int_type emitbuffer::overflow ( int_type value )
+{
+    if ( traits_type::eq_int_type ( value, traits_type::eof ( ) ) )
+        return traits_type::not_eof ( value );
+
+    reserve ( size ( ) + 1 );
+    *pptr ( ) = traits_type::to_char_type ( value );
+    pbump ( 1 );
+    return value;
+}
+
+std::streamsize emitbuffer::xsputn ( const char * data, std::streamsize size )
+{
+    if ( size > epptr ( ) - pptr ( ) )
+        reserve ( this->size ( ) + size );
+    std::memcpy ( pptr ( ), data, size );
+    pbump ( static_cast<int> ( size ) );
+    return size;
+}
+
+void emitbuffer::reserve ( size_t size )
+{
+    // Doubling keeps the number of copies low however the file grows
+    const size_t used ( this->size ( ) );
+    m_storage.resize ( std::max ( size, m_storage.size ( ) * 2 ) );
+    setp ( &m_storage [ 0 ], &m_storage [ 0 ] + m_storage.size ( ) );
+    pbump ( static_cast<int> ( used ) );
+}
+
+outputfile::outputfile ( const std::string & filename, bool generated )
+    : m_filename ( filename )
+    , m_buffer ( s_initialCapacity )
+    , m_stream ( &m_buffer )
+    , m_timer ( true )
+    , m_generated ( generated )
+{
+}
+
+bool outputfile::commit ( )
+{
+    const bool changed ( ! matchesExisting ( ) );
+    if ( changed )
+        replaceExisting ( );
+
+    if ( statistics * stats = m_generated ? statistics::current ( ) : 0 )
+    {
+        statistics::record file ( m_filename );
+        m_timer.stop ( file );
+        file.bytes = m_buffer.size ( );
+        file.written = changed;
+        stats->addFile ( file );
+    }
+    return changed;
+}
+
+uint64_t outputfile::hash ( const char * data, size_t size, uint64_t state )
+{
+    // 64-bit FNV-1a, the state can be carried over to hash data in chunks
+    for ( size_t index ( 0 ); index < size; ++index )
+    {
+        state ^= static_cast<unsigned char> ( data [ index ] );
+        state *= 1099511628211ull;
+    }
+    return state;
+}
+
+bool outputfile::matchesExisting ( ) const
+{
+    std::FILE * existing ( std::fopen ( m_filename.c_str ( ), "rb" ) );
+    if ( ! existing )
+        return false;
+
+    // Differing sizes can be rejected without reading the file, otherwise it
+    // is read with a single unbuffered call and compared directly
+    const size_t size ( m_buffer.size ( ) );
+    bool matches ( false );
+    std::setvbuf ( existing, 0, _IONBF, 0 );
+    if ( ! std::fseek ( existing, 0, SEEK_END ) &&
+         std::ftell ( existing ) == static_cast<long> ( size ) &&
+         ! std::fseek ( existing, 0, SEEK_SET ) )
+    {
+        std::vector<char> content ( size + 1 );
+        matches = std::fread ( &content [ 0 ], 1, size, existing ) == size &&
+                  ! std::memcmp ( &content [ 0 ], m_buffer.data ( ), size );
+    }
+    std::fclose ( existing );
+    return matches;
+}
+
+void outputfile::replaceExisting ( ) const
+{
+    // The temporary file is created in the target directory, so the rename
+    // never has to cross filesystems
+    std::ostringstream tempname;
+    tempname << m_filename << ".tmp";
+#ifdef HAS_GETPID
+    tempname << "." << getpid ( );
+#endif
+    const std::string temp ( tempname.str ( ) );
+
+    // Unbuffered, so the whole file goes out in one write
+    std::FILE * output ( std::fopen ( temp.c_str ( ), "wb" ) );
+    bool written ( output );
+    if ( output )
+    {
+        std::setvbuf ( output, 0, _IONBF, 0 );
+        written = std::fwrite ( m_buffer.data ( ), 1, m_buffer.size ( ), output ) == m_buffer.size ( );
+        written = ! std::fclose ( output ) && written;
+    }
+    if ( ! written )
+    {
+        std::remove ( temp.c_str ( ) );
+        throw std::runtime_error ( "Failed to write output file \"" + temp + "\"" );
+    }
+
+    if ( std::rename ( temp.c_str ( ), m_filename.c_str ( ) ) )
+    {
+        std::remove ( temp.c_str ( ) );
+        throw std::runtime_error ( "Failed to replace output file \"" + m_filename + "\"" );
+    }
+}
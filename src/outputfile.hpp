@@ -0,0 +1,88 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_OUTPUTFILE
+#define INC_FUDGEPROTO_OUTPUTFILE
+
+#include "statistics.hpp"
+#include <ostream>
+#include <stdint.h>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace fudgeproto {
+
+// Stream buffer that appends in to a single block of memory, grown only when
+// full. The content can be compared and written out without being copied.
+class emitbuffer : public std::streambuf
+{
+    public:
+        emitbuffer ( size_t capacity );
+
+        inline const char * data ( ) const { return pbase ( ); }
+        inline size_t size ( ) const { return pptr ( ) - pbase ( ); }
+
+    protected:
+        int_type overflow ( int_type value );
+        std::streamsize xsputn ( const char * data, std::streamsize size );
+
+    private:
+        std::vector<char> m_storage;
+
+        void reserve ( size_t size );
+};
+
+// Generated file that is rendered in to memory and only written to disk if
+// its content differs from the existing file. Leaving unchanged files alone
+// preserves their modification times, so dependent code isn't rebuilt. A
+// changed file is written alongside the original and renamed over it, so the
+// target is never left half written. Generated files report to the current
+// statistics collector, if there is one, when committed.
+class outputfile
+{
+    public:
+        outputfile ( const std::string & filename, bool generated = true );
+
+        inline const std::string & filename ( ) const { return m_filename; }
+        inline std::ostream & stream ( ) { return m_stream; }
+
+        bool commit ( );
+
+        static uint64_t hash ( const char * data, size_t size, uint64_t state = s_hashBasis );
+
+        static const uint64_t s_hashBasis;
+        static const size_t s_initialCapacity;
+
+    private:
+        std::string m_filename;
+        emitbuffer m_buffer;
+        std::ostream m_stream;
+        statistics::timer m_timer;
+        bool m_generated;
+
+        bool matchesExisting ( ) const;
+        void replaceExisting ( ) const;
+
+        outputfile ( const outputfile & );              // Not implemented
+        outputfile & operator= ( const outputfile & );  // Not implemented
+};
+
+}
+
+#endif
+
@@ -15,49 +15,436 @@
  */
 
 #include "parser.hpp"
+#include "config.h"
+#include "outputfile.hpp"
+#include "parserstate.hpp"
 #include <cerrno>
+#include <climits>
 #include <cstdio>
+#include <map>
+#include <set>
 #include <sstream>
 #include <cstring>
 #include <stdexcept>
+#include <typeinfo>
 
-using namespace fudgeproto;
+#include <sys/stat.h>
 
-// Include the various global symbols defined by the lexer/parser
-extern int protolexer_linecount;
-extern void yyrestart ( FILE * input );
-extern int yyparse ( );
-extern std::string protoparser_error;
-extern fudgeproto::namespacedef protoparser_root;
+#ifdef HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
-namespacedef * parser::parse ( const std::string & filename )
+// Parallel parsing relies on the AST reference counts being atomic
+#if defined(HAS_PTHREADS) && defined(HAS_ATOMIC_BUILTINS)
+#define FUDGEPROTO_PARALLEL_PARSER
+#include <pthread.h>
+#endif
+
+using namespace fudgeproto;
+
+namespace
 {
-    // Open the file
-    FILE * handle ( fopen ( filename.c_str ( ), "rb" ) );
-    if ( ! handle )
+    void setSourceFile ( messagedef & message, const std::string & filename )
+    {
+        // Extern messages are only declared here, their source is unknown
+        if ( ! message.isExtern ( ) )
+            message.setSourceFile ( filename );
+
+        const std::list<messagedef *> messages ( message.messages ( ) );
+        for ( std::list<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+            setSourceFile ( **it, filename );
+    }
+
+    void setSourceFile ( namespacedef & ns, const std::string & filename )
+    {
+        for ( std::list<definition *>::const_iterator it ( ns.content ( ).begin ( ) ); it != ns.content ( ).end ( ); ++it )
+        {
+            if ( typeid ( **it ) == typeid ( messagedef ) )
+                setSourceFile ( dynamic_cast<messagedef &> ( **it ), filename );
+            else if ( typeid ( **it ) == typeid ( namespacedef ) )
+                setSourceFile ( dynamic_cast<namespacedef &> ( **it ), filename );
+        }
+    }
+
+    std::string resolveImport ( const std::string & importer, const std::string & target )
+    {
+        // Relative imports are found alongside the importing file
+        if ( target.empty ( ) || target [ 0 ] == '/' )
+            return target;
+        const size_t separator ( importer.rfind ( '/' ) );
+        return separator == std::string::npos ? target : importer.substr ( 0, separator + 1 ) + target;
+    }
+
+    bool hashFile ( const std::string & filename, uint64_t & result )
+    {
+        FILE * handle ( fopen ( filename.c_str ( ), "rb" ) );
+        if ( ! handle )
+            return false;
+
+        result = outputfile::s_hashBasis;
+        char buffer [ 8192 ];
+        size_t count;
+        while ( ( count = fread ( buffer, 1, sizeof ( buffer ), handle ) ) )
+            result = outputfile::hash ( buffer, count, result );
+        const bool success ( ! ferror ( handle ) );
+        fclose ( handle );
+        return success;
+    }
+
+    std::runtime_error openError ( const std::string & filename )
     {
         char buffer [ 256 ];
         strerror_r ( errno, buffer, sizeof ( buffer ) );
-        throw std::runtime_error ( "Failed to open \"" + filename + "\": " + buffer );
+        return std::runtime_error ( "Failed to open \"" + filename + "\": " + buffer );
+    }
+
+    void parseFile ( const std::string & filename, parsecache::file & result )
+    {
+        std::vector<std::string> imports;
+#ifdef HAS_MMAP
+        // Map the file rather than reading it, the lexer takes its own copy
+        const int handle ( open ( filename.c_str ( ), O_RDONLY ) );
+        struct stat status;
+        if ( handle < 0 || fstat ( handle, &status ) )
+        {
+            const std::runtime_error error ( openError ( filename ) );
+            if ( handle >= 0 )
+                close ( handle );
+            throw error;
+        }
+
+        const size_t size ( status.st_size );
+        void * data ( size ? mmap ( 0, size, PROT_READ, MAP_PRIVATE, handle, 0 ) : 0 );
+        close ( handle );
+        if ( data == MAP_FAILED )
+            throw openError ( filename );
+
+        try
+        {
+            result.root = parser::parse ( static_cast<const char *> ( data ), size, filename, imports );
+            result.hash = outputfile::hash ( static_cast<const char *> ( data ), size );
+        }
+        catch ( ... )
+        {
+            if ( size ) munmap ( data, size );
+            throw;
+        }
+        if ( size ) munmap ( data, size );
+#else
+        FILE * handle ( fopen ( filename.c_str ( ), "rb" ) );
+        if ( ! handle )
+            throw openError ( filename );
+
+        std::string content;
+        char buffer [ 8192 ];
+        size_t count;
+        while ( ( count = fread ( buffer, 1, sizeof ( buffer ), handle ) ) )
+            content.append ( buffer, count );
+        fclose ( handle );
+
+        result.root = parser::parse ( content.data ( ), content.size ( ), filename, imports );
+        result.hash = outputfile::hash ( content.data ( ), content.size ( ) );
+#endif
+
+        for ( std::vector<std::string>::const_iterator it ( imports.begin ( ) ); it != imports.end ( ); ++it )
+            result.imports.push_back ( resolveImport ( filename, *it ) );
+    }
+
+#ifdef FUDGEPROTO_PARALLEL_PARSER
+    struct parsequeue
+    {
+        parsequeue ( const std::vector<std::string> & filenames,
+                     std::vector<parsecache::file> & results,
+                     std::vector<std::string> & errors )
+            : filenames ( filenames )
+            , results ( results )
+            , errors ( errors )
+            , next ( 0 )
+        {
+            pthread_mutex_init ( &mutex, 0 );
+        }
+
+        ~parsequeue ( )
+        {
+            pthread_mutex_destroy ( &mutex );
+        }
+
+        size_t pop ( )
+        {
+            pthread_mutex_lock ( &mutex );
+            const size_t index ( next < filenames.size ( ) ? next++ : filenames.size ( ) );
+            pthread_mutex_unlock ( &mutex );
+            return index;
+        }
+
+        const std::vector<std::string> & filenames;
+        std::vector<parsecache::file> & results;
+        std::vector<std::string> & errors;
+        size_t next;
+        pthread_mutex_t mutex;
+    };
+
+    void * parseWorker ( void * queue )
+    {
+        // Each file has its own result and error slots, so only the queue is shared
+        parsequeue & work ( *static_cast<parsequeue *> ( queue ) );
+        for ( size_t index ( work.pop ( ) ); index < work.filenames.size ( ); index = work.pop ( ) )
+        {
+            try
+            {
+                parseFile ( work.filenames [ index ], work.results [ index ] );
+            }
+            catch ( const std::exception & exception )
+            {
+                work.errors [ index ] = exception.what ( );
+            }
+            catch ( ... )
+            {
+                work.errors [ index ] = "Unknown error parsing \"" + work.filenames [ index ] + "\"";
+            }
+        }
+        return 0;
+    }
+#endif
+
+    void parseFiles ( parsecache & cache, const std::vector<std::string> & filenames, size_t jobs )
+    {
+        // Only parse each file once
+        std::vector<std::string> pending;
+        std::set<std::string> unique;
+        for ( std::vector<std::string>::const_iterator it ( filenames.begin ( ) ); it != filenames.end ( ); ++it )
+            if ( ! cache.files ( ).count ( *it ) && unique.insert ( *it ).second )
+            {
+                cache.stamp ( *it );
+                pending.push_back ( *it );
+            }
+
+        std::vector<parsecache::file> results ( pending.size ( ) );
+#ifdef FUDGEPROTO_PARALLEL_PARSER
+        if ( jobs > 1 && pending.size ( ) > 1 )
+        {
+            std::vector<std::string> errors ( pending.size ( ) );
+            parsequeue queue ( pending, results, errors );
+            std::vector<pthread_t> threads;
+            const size_t numthreads ( std::min ( jobs, pending.size ( ) ) );
+            for ( size_t index ( 0 ); index < numthreads; ++index )
+            {
+                pthread_t thread;
+                if ( pthread_create ( &thread, 0, parseWorker, &queue ) )
+                    break;
+                threads.push_back ( thread );
+            }
+
+            // If no threads could be started the remaining files are parsed here
+            parseWorker ( &queue );
+            for ( std::vector<pthread_t>::iterator it ( threads.begin ( ) ); it != threads.end ( ); ++it )
+                pthread_join ( *it, 0 );
+
+            // Report the error from the earliest file, as a serial parse would
+            for ( std::vector<std::string>::const_iterator it ( errors.begin ( ) ); it != errors.end ( ); ++it )
+                if ( ! it->empty ( ) )
+                    throw std::runtime_error ( *it );
+        }
+        else
+#endif
+        for ( size_t index ( 0 ); index < pending.size ( ); ++index )
+            parseFile ( pending [ index ], results [ index ] );
+
+        for ( size_t index ( 0 ); index < pending.size ( ); ++index )
+            cache.files ( ) [ pending [ index ] ] = results [ index ];
+    }
+
+    definition * createStub ( const definition & def )
+    {
+        // Imported messages are replaced with extern stubs, keeping only their
+        // names and those of their nested messages
+        refptr<identifier> id ( def.id ( ).clone ( ) );
+        if ( typeid ( def ) == typeid ( messagedef ) )
+        {
+            const messagedef & message ( dynamic_cast<const messagedef &> ( def ) );
+            refptr<messagedef> stub ( new messagedef ( id.get ( ), true ) );
+            stub->setSourceFile ( message.sourceFile ( ) );
+
+            const std::list<messagedef *> messages ( message.messages ( ) );
+            for ( std::list<messagedef *>::const_iterator it ( messages.begin ( ) ); it != messages.end ( ); ++it )
+            {
+                refptr<definition> nested ( createStub ( **it ) );
+                stub->addContent ( nested.get ( ) );
+            }
+            return stub.release ( );
+        }
+        else if ( typeid ( def ) == typeid ( namespacedef ) )
+        {
+            const namespacedef & ns ( dynamic_cast<const namespacedef &> ( def ) );
+            refptr<namespacedef> stub ( new namespacedef ( id.get ( ) ) );
+            for ( std::list<definition *>::const_iterator it ( ns.content ( ).begin ( ) ); it != ns.content ( ).end ( ); ++it )
+            {
+                refptr<definition> nested ( createStub ( **it ) );
+                if ( nested )
+                    stub->addContent ( nested.get ( ) );
+            }
+            return stub.release ( );
+        }
+        return 0;
+    }
+}
+
+namespacedef * parser::parse ( const std::string & filename )
+{
+    return parse ( std::vector<std::string> ( 1, filename ) );
+}
+
+parsecache::filestamp::filestamp ( )
+    : exists ( false )
+    , modified ( 0 )
+    , modifiedNanoseconds ( 0 )
+    , size ( 0 )
+    , recent ( false )
+    , hashed ( false )
+    , content ( 0 )
+{
+}
+
+parsecache::filestamp::filestamp ( const std::string & filename, bool hashContent )
+    : exists ( false )
+    , modified ( 0 )
+    , modifiedNanoseconds ( 0 )
+    , size ( 0 )
+    , recent ( false )
+    , hashed ( false )
+    , content ( 0 )
+{
+    struct stat status;
+    if ( stat ( filename.c_str ( ), &status ) )
+        return;
+
+    exists = true;
+    modified = status.st_mtime;
+#ifdef HAS_ST_MTIM
+    modifiedNanoseconds = status.st_mtim.tv_nsec;
+#endif
+    size = static_cast<unsigned long> ( status.st_size );
+
+    recent = modified >= time ( 0 );
+    if ( recent || hashContent )
+        hashed = hashFile ( filename, content );
+}
+
+bool parsecache::filestamp::operator== ( const filestamp & other ) const
+{
+    return exists == other.exists
+        && modified == other.modified
+        && modifiedNanoseconds == other.modifiedNanoseconds
+        && size == other.size
+        && ( ! hashed || ! other.hashed || content == other.content );
+}
+
+void parsecache::invalidate ( std::set<std::string> & changed )
+{
+    for ( std::map<std::string, filestamp>::iterator it ( m_stamps.begin ( ) ); it != m_stamps.end ( ); ++it )
+    {
+        // A recent stamp may match a file that has since been rewritten, only
+        // its content will tell
+        const filestamp current ( it->first, it->second.recent );
+        const bool unchanged ( current == it->second );
+        it->second = current;
+        if ( unchanged )
+            continue;
+
+        m_files.erase ( it->first );
+        changed.insert ( it->first );
+    }
+}
+
+void parsecache::stamp ( const std::string & filename )
+{
+    m_stamps [ filename ] = filestamp ( filename );
+}
+
+namespacedef * parser::parse ( const std::vector<std::string> & filenames, size_t jobs, parsecache * cache )
+{
+    // Each file is parsed once, then their contents are merged in to a single
+    // root. The indexer replaces extern messages with any matching definition
+    // so references between the files are resolved directly. The stages that
+    // follow modify the tree, so a persistent cache's trees are copied.
+    refptr<namespacedef> root ( new namespacedef ( ) );
+    parsecache local;
+    parsecache & files ( cache ? *cache : local );
+    parseFiles ( files, filenames, jobs );
+
+    std::vector<std::string> imports;
+    std::set<std::string> merged;
+    for ( std::vector<std::string>::const_iterator it ( filenames.begin ( ) ); it != filenames.end ( ); ++it )
+    {
+        if ( ! merged.insert ( *it ).second )
+            continue;
+
+        const parsecache::file & parsed ( files.files ( ) [ *it ] );
+        for ( std::list<definition *>::const_iterator content ( parsed.root->content ( ).begin ( ) );
+              content != parsed.root->content ( ).end ( );
+              ++content )
+        {
+            if ( cache )
+            {
+                refptr<definition> copy ( ( *content )->clone ( ) );
+                root->addContent ( copy.get ( ) );
+            }
+            else
+                root->addContent ( *content );
+        }
+        imports.insert ( imports.end ( ), parsed.imports.begin ( ), parsed.imports.end ( ) );
     }
 
-    // Reset the parser
-    protolexer_linecount = 1;
-    protoparser_root.clear ( );
-    yyrestart ( handle );
-    
-    // Do the parse
-    if ( yyparse ( ) )
+    // Imported files contribute extern stubs for their messages, so nothing is
+    // generated for them. Each is parsed once however many files import it, and
+    // inputs aren't parsed again. Imports are not followed any further, as the
+    // stubs don't refer to anything.
+    parseFiles ( files, imports, jobs );
+    std::set<std::string> imported;
+    for ( std::vector<std::string>::const_iterator it ( imports.begin ( ) ); it != imports.end ( ); ++it )
+    {
+        if ( ! imported.insert ( *it ).second )
+            continue;
+
+        const parsecache::file & parsed ( files.files ( ) [ *it ] );
+        for ( std::list<definition *>::const_iterator content ( parsed.root->content ( ).begin ( ) );
+              content != parsed.root->content ( ).end ( );
+              ++content )
+        {
+            refptr<definition> stub ( createStub ( **content ) );
+            if ( stub )
+                root->addContent ( stub.get ( ) );
+        }
+    }
+    return root.release ( );
+}
+
+namespacedef * parser::parse ( const char * data,
+                               size_t size,
+                               const std::string & filename,
+                               std::vector<std::string> & imports )
+{
+    if ( size > static_cast<size_t> ( INT_MAX ) )
+        throw std::runtime_error ( "Cannot parse \"" + filename + "\": file is too large" );
+
+    // All of the parser's state is local, so this can run on any thread
+    parserstate state;
+    if ( parseBuffer ( state, data, size ) )
     {
         std::ostringstream error;
-        error << "Error at line " << protolexer_linecount << ": " << protoparser_error;
+        error << "Error in \"" << filename << "\" at line " << state.linecount << ": " << state.error;
         throw std::runtime_error ( error.str ( ) );
     }
 
-    // Copy the root node (not a deep copy) and clear the parser
+    // Copy the root node (not a deep copy)
     refptr<namespacedef> root ( new namespacedef ( ) );
-    *root = protoparser_root;
-    protoparser_root.clear ( );
+    *root = state.root;
+    imports.insert ( imports.end ( ), state.imports.begin ( ), state.imports.end ( ) );
+
+    // Record where each message came from, so that outputs can be traced back
+    // to their inputs when several files are processed together
+    setSourceFile ( *root, filename );
     return root.release ( );
 }
-
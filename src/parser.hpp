@@ -18,13 +18,77 @@
 #define INC_FUDGEPROTO_PARSER
 
 #include "ast.hpp"
+#include <ctime>
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
 
 namespace fudgeproto {
 
+// Parsed files kept between parses, so that only files which have changed
+// since are parsed again. The cached trees are never modified, a parse that
+// uses the cache merges copies of them.
+class parsecache
+{
+    public:
+        struct file
+        {
+            file ( ) : hash ( 0 ) { }
+
+            refptr<namespacedef> root;
+            std::vector<std::string> imports;
+            uint64_t hash;              // Of the content that was parsed
+        };
+
+        typedef std::map<std::string, file> filemap;
+
+        // Forgets every file that has changed on disk since it was last
+        // parsed, returning their names. This includes files that failed to
+        // parse.
+        void invalidate ( std::set<std::string> & changed );
+
+        // Records the state of a file on disk as it is about to be parsed
+        void stamp ( const std::string & filename );
+
+        inline filemap & files ( ) { return m_files; }
+        inline const filemap & files ( ) const { return m_files; }
+
+    private:
+        // Times and sizes can't tell apart edits made in the same clock tick,
+        // so a file modified around the time it was stamped also has its
+        // content hashed until it has been left alone for a while.
+        struct filestamp
+        {
+            filestamp ( );
+            filestamp ( const std::string & filename, bool hashContent = false );
+
+            bool operator== ( const filestamp & other ) const;
+
+            bool exists;
+            time_t modified;
+            long modifiedNanoseconds;   // Zero where stat doesn't provide them
+            unsigned long size;
+            bool recent;                // Modified in the second it was stamped
+            bool hashed;
+            uint64_t content;
+        };
+
+        filemap m_files;
+        std::map<std::string, filestamp> m_stamps;
+};
+
 class parser
 {
     public:
         static namespacedef * parse ( const std::string & filename );
+        static namespacedef * parse ( const std::vector<std::string> & filenames,
+                                      size_t jobs = 1,
+                                      parsecache * cache = 0 );
+        static namespacedef * parse ( const char * data,
+                                      size_t size,
+                                      const std::string & filename,
+                                      std::vector<std::string> & imports );
 
     private:
         // Not implemented - class should not be instantiated
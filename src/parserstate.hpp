@@ -0,0 +1,51 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_PARSERSTATE
+#define INC_FUDGEPROTO_PARSERSTATE
+
+#include "ast.hpp"
+#include <string>
+#include <vector>
+
+namespace fudgeproto {
+
+// Everything produced or consumed while parsing a single file. The lexer and
+// parser are reentrant and keep their state in here, so several files can be
+// parsed at once on different threads.
+struct parserstate
+{
+    parserstate ( )
+        : linecount ( 1 )
+    {
+    }
+
+    namespacedef root;                  // The file-level namespace
+    std::vector<std::string> imports;   // Files named by import statements
+    std::string error;                  // Error message if the parse failed
+    std::string literal;                // String literal being lexed
+    int linecount;
+};
+
+// Runs the reentrant lexer and parser over a buffer, which doesn't need to be
+// null terminated. Returns zero on success. Defined with the lexer.
+int parseBuffer ( parserstate & state, const char * data, size_t size );
+
+}
+
+#endif
+
@@ -0,0 +1,145 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfecthash.hpp"
+#include <algorithm>
+#include <set>
+#include <stdexcept>
+
+using namespace fudgeproto;
+
+namespace
+{
+    class largerbucket
+    {
+        public:
+            largerbucket ( const std::vector< std::vector<size_t> > & buckets )
+                : m_buckets ( buckets )
+            {
+            }
+
+            bool operator() ( size_t x, size_t y ) const
+            {
+                return m_buckets [ x ].size ( ) > m_buckets [ y ].size ( );
+            }
+
+        private:
+            const std::vector< std::vector<size_t> > & m_buckets;
+    };
+}
+
+const size_t perfecthash::npos ( static_cast<size_t> ( -1 ) );
+const uint32_t perfecthash::s_maxSeed ( 1 << 16 );
+
+perfecthash::perfecthash ( const std::vector<std::string> & keys )
+    : m_keys ( keys )
+{
+    if ( keys.empty ( ) )
+        throw std::invalid_argument ( "Cannot build a perfect hash without any keys" );
+
+    std::set<std::string> unique;
+    for ( std::vector<std::string>::const_iterator it ( keys.begin ( ) ); it != keys.end ( ); ++it )
+        if ( ! unique.insert ( *it ).second )
+            throw std::invalid_argument ( "Duplicate key \"" + *it + "\" in perfect hash" );
+
+    // Start with a minimal table, only growing it if a bucket cannot be placed
+    size_t tablesize ( keys.size ( ) );
+    while ( ! build ( tablesize ) )
+        ++tablesize;
+}
+
+size_t perfecthash::slot ( const std::string & key ) const
+{
+    const uint32_t bucket ( hash ( key.data ( ), key.size ( ), 0 ) % m_seeds.size ( ) );
+    return hash ( key.data ( ), key.size ( ), m_seeds [ bucket ] ) % m_slots.size ( );
+}
+
+size_t perfecthash::find ( const std::string & key ) const
+{
+    const size_t index ( m_slots [ slot ( key ) ] );
+    return index != npos && m_keys [ index ] == key ? index : npos;
+}
+
+uint32_t perfecthash::hash ( const char * data, size_t size, uint32_t seed )
+{
+    // FNV-1a over the seeded offset basis, finished with the MurmurHash3
+    // avalanche so that the low bits are usable as a table index
+    uint32_t hash ( 2166136261u ^ seed );
+    for ( size_t index ( 0 ); index < size; ++index )
+    {
+        hash ^= static_cast<unsigned char> ( data [ index ] );
+        hash *= 16777619u;
+    }
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+bool perfecthash::build ( size_t tablesize )
+{
+    // Distribute keys in to buckets, averaging two keys per bucket
+    const size_t numbuckets ( ( m_keys.size ( ) + 1 ) / 2 );
+    std::vector< std::vector<size_t> > buckets ( numbuckets );
+    for ( size_t index ( 0 ); index < m_keys.size ( ); ++index )
+        buckets [ hash ( m_keys [ index ].data ( ), m_keys [ index ].size ( ), 0 ) % numbuckets ].push_back ( index );
+
+    // Place the largest buckets first, while the table is still sparse
+    std::vector<size_t> order;
+    for ( size_t index ( 0 ); index < numbuckets; ++index )
+        order.push_back ( index );
+    std::stable_sort ( order.begin ( ), order.end ( ), largerbucket ( buckets ) );
+
+    m_seeds.assign ( numbuckets, 0 );
+    m_slots.assign ( tablesize, npos );
+
+    std::vector<size_t> placed;
+    for ( std::vector<size_t>::const_iterator it ( order.begin ( ) ); it != order.end ( ); ++it )
+    {
+        const std::vector<size_t> & bucket ( buckets [ *it ] );
+        if ( bucket.empty ( ) )
+            break;
+
+        uint32_t seed ( 1 );
+        for ( ; seed < s_maxSeed; ++seed )
+        {
+            placed.clear ( );
+            for ( std::vector<size_t>::const_iterator key ( bucket.begin ( ) ); key != bucket.end ( ); ++key )
+            {
+                const size_t slot ( hash ( m_keys [ *key ].data ( ), m_keys [ *key ].size ( ), seed ) % tablesize );
+                if ( m_slots [ slot ] != npos || std::find ( placed.begin ( ), placed.end ( ), slot ) != placed.end ( ) )
+                    break;
+                placed.push_back ( slot );
+            }
+
+            if ( placed.size ( ) == bucket.size ( ) )
+                break;
+        }
+
+        if ( seed == s_maxSeed )
+            return false;
+
+        m_seeds [ *it ] = seed;
+        for ( size_t index ( 0 ); index < bucket.size ( ); ++index )
+            m_slots [ placed [ index ] ] = bucket [ index ];
+    }
+
+    return true;
+}
+
@@ -0,0 +1,61 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INC_FUDGEPROTO_PERFECTHASH
+#define INC_FUDGEPROTO_PERFECTHASH
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace fudgeproto {
+
+// Minimal perfect hash over a fixed set of strings, built using hash and
+// displace: keys are split in to buckets by an unseeded hash, then each
+// bucket is given the first seed that places all of its keys in to free
+// slots. A lookup is two hashes, a table read and a single comparison. The
+// hash function is duplicated in the generated code, so it must not change.
+class perfecthash
+{
+    public:
+        perfecthash ( const std::vector<std::string> & keys );
+
+        inline size_t size ( ) const { return m_slots.size ( ); }
+        inline const std::vector<uint32_t> & seeds ( ) const { return m_seeds; }
+        inline const std::vector<size_t> & slots ( ) const { return m_slots; }
+        inline const std::vector<std::string> & keys ( ) const { return m_keys; }
+
+        size_t slot ( const std::string & key ) const;
+        size_t find ( const std::string & key ) const;
+
+        static uint32_t hash ( const char * data, size_t size, uint32_t seed );
+
+        static const size_t npos;
+
+    private:
+        std::vector<std::string> m_keys;
+        std::vector<uint32_t> m_seeds;
+        std::vector<size_t> m_slots;
+
+        bool build ( size_t tablesize );
+
+        static const uint32_t s_maxSeed;
+};
+
+}
+
+#endif
+
@@ -1,20 +1,16 @@
 %{
     #include "ast.hpp"
+    #include "parserstate.hpp"
     #include "protoparser.hh"
     #include "memoryutil.hpp"
     #include <list>
     #include <cstdio>
-
-    extern int protolexer_linecount;
-
-    static const size_t protolexer_strmaxsize ( 1024 );
-    static char protolexer_strbuffer [ protolexer_strmaxsize ];
-    static size_t protolexer_stroffset;
-
-    extern void protolexer_addToStringBuffer ( const char * string, size_t size );
+    #include <stdexcept>
 %}
 
-%option never-interactive nounput
+%option never-interactive nounput noyywrap
+%option reentrant bison-bridge
+%option extra-type="fudgeproto::parserstate *"
 %x COMMENT_M
 %x STRING_M
 
@@ -32,13 +28,13 @@ newline     [\n]
 
 {whitespace}+           { }
 
-{newline}               protolexer_linecount++;
+{newline}               yyextra->linecount++;
 
 "//".*$                 { }
 "/*"                    BEGIN( COMMENT_M );
 
 "\""                    {
-                            protolexer_stroffset = 0;
+                            yyextra->literal.clear ( );
                             BEGIN( STRING_M );
                         }
 
@@ -55,27 +51,27 @@ newline     [\n]
 
 <COMMENT_M>"*"+[^*/\n]* { }
 <COMMENT_M>[^*\n]*      { }
-<COMMENT_M>{newline}    protolexer_linecount++;
+<COMMENT_M>{newline}    yyextra->linecount++;
 <COMMENT_M>"*/"         BEGIN( INITIAL );
 
 <STRING_M>"\""          {
-                            const size_t size ( std::min ( protolexer_stroffset, protolexer_strmaxsize ) );
-                            yylval.string = fudgeproto::strdup ( protolexer_strbuffer, size );
+                            yylval->string = fudgeproto::strdup ( yyextra->literal.data ( ), yyextra->literal.size ( ) );
                             BEGIN( INITIAL );
                             return STRINGLITERAL;
                         }
-<STRING_M>"\\b"         protolexer_addToStringBuffer ( "\b", 1 );
-<STRING_M>"\\n"         protolexer_addToStringBuffer ( "\n", 1 );
-<STRING_M>"\\r"         protolexer_addToStringBuffer ( "\r", 1 );
-<STRING_M>"\\t"         protolexer_addToStringBuffer ( "\t", 1 );
-<STRING_M>"\\".         protolexer_addToStringBuffer ( yytext + 1, 1 );
-<STRING_M>[^\\\"]+      protolexer_addToStringBuffer ( yytext, strlen ( yytext ) );
+<STRING_M>"\\b"         yyextra->literal += '\b';
+<STRING_M>"\\n"         yyextra->literal += '\n';
+<STRING_M>"\\r"         yyextra->literal += '\r';
+<STRING_M>"\\t"         yyextra->literal += '\t';
+<STRING_M>"\\".         yyextra->literal += yytext [ 1 ];
+<STRING_M>[^\\\"]+      yyextra->literal.append ( yytext, yyleng );
 
 
 default                 return DEFAULT;
 enum                    return ENUM;
 extends                 return EXTENDS;
 extern                  return EXTERN;
+import                  return IMPORT;
 message                 return MESSAGE;
 namespace               return NAMESPACE;
 
@@ -104,26 +100,26 @@ time                    return TIME;
 datetime                return DATETIME;
 
 true                    {
-                            yylval.boolean = true;
+                            yylval->boolean = true;
                             return BOOLLITERAL;
                         }
 false                   {
-                            yylval.boolean = false;
+                            yylval->boolean = false;
                             return BOOLLITERAL;
                         }
 
 {identifier}            {
-                            yylval.string = fudgeproto::strdup ( yytext );
+                            yylval->string = fudgeproto::strdup ( yytext );
                             return IDENTIFIER;
                         }
 
 {natural}               {
-                            yylval.integer = atoi ( yytext );
+                            yylval->integer = atoi ( yytext );
                             return NATURALNUMBER;
                         }
 
 {float}                 {
-                            yylval.floating = strtod ( yytext, 0 );
+                            yylval->floating = strtod ( yytext, 0 );
                             return FLOATNUMBER;
                         }
 
@@ -133,17 +129,27 @@ false                   {
 
 %%
 
-void protolexer_addToStringBuffer ( const char * string, size_t size )
+int fudgeproto::parseBuffer ( fudgeproto::parserstate & state, const char * data, size_t size )
 {
-    if ( protolexer_stroffset + size < protolexer_strmaxsize )
+    yyscan_t scanner;
+    if ( yylex_init_extra ( &state, &scanner ) )
+        throw std::runtime_error ( "Failed to initialise the lexer" );
+
+    // The buffer is copied by the lexer, which needs it to be null terminated
+    YY_BUFFER_STATE buffer ( yy_scan_bytes ( data, static_cast<int> ( size ), scanner ) );
+    int result;
+    try
     {
-        memcpy ( protolexer_strbuffer + protolexer_stroffset, string, size );
-        protolexer_stroffset += size;
+        result = yyparse ( &state, scanner );
+    }
+    catch ( ... )
+    {
+        yy_delete_buffer ( buffer, scanner );
+        yylex_destroy ( scanner );
+        throw;
     }
-    else
-        fprintf ( stderr, "%s:%d - lexer string buffer size exceeded %lu (max is %lu)\n",
-                          __FILE__, __LINE__,
-                          static_cast<unsigned long> ( protolexer_stroffset + size ),
-                          static_cast<unsigned long> ( protolexer_strmaxsize ) );
-}
 
+    yy_delete_buffer ( buffer, scanner );
+    yylex_destroy ( scanner );
+    return result;
+}
@@ -1,17 +1,14 @@
 %{
     #include <stdio.h>
     #include <string>
+    #include <vector>
     #include "ast.hpp"
+    #include "parserstate.hpp"
 
-    // The file-level namespace that parsed file contents are loaded in to
-    fudgeproto::namespacedef protoparser_root;
-
-    // Will be populated with the error message in the event of an error
-    std::string protoparser_error;
-
-    extern int yylex ( );
-    extern void yyerror ( const char * );
-    extern "C" int yywrap ( );
+    // Errors found while building the tree abort the parse rather than
+    // unwinding through it, so that the values left on the stack are
+    // released. The failing action must already have released its own.
+    #define GUARDED( action ) try { action; } catch ( const std::exception & exception ) { state->error = exception.what ( ); YYABORT; }
 %}
 
 // The "message" token is used both as a type and to mark the start of a message block.
@@ -19,10 +16,16 @@
 
 %error-verbose
 
+// Reentrant, all state is held in the parserstate and the scanner
+%define api.pure
+%parse-param { fudgeproto::parserstate * state }
+%parse-param { void * scanner }
+%lex-param { void * scanner }
+
 %token IDENTIFIER
 %token FLOATNUMBER NATURALNUMBER
 %token BOOLLITERAL STRINGLITERAL
-%token DEFAULT ENUM EXTENDS EXTERN MESSAGE NAMESPACE
+%token DEFAULT ENUM EXTENDS EXTERN IMPORT MESSAGE NAMESPACE
 %token MUTABLE OPTIONAL READONLY REPEATED REQUIRED
 %token INDICATOR BOOLEAN BYTE SHORT INT LONG FLOAT DOUBLE STRING
 %token DATE TIME DATETIME
@@ -41,6 +44,12 @@
         bool has_value;
     } enumrow;
 
+    struct
+    {
+        fudgeproto::literalvalue * defvalue;
+        int flags;
+    } options;
+
     fudgeproto::definition * definition;
     fudgeproto::enumdef * enumdef;
     fudgeproto::fieldconstraint * constraint;
@@ -66,23 +75,48 @@
 %type <fieldtype>       field_type
 %type <identifier>      fqname
 %type <identifier_list> fqname_list
-%type <literal>         field_default literal
+%type <literal>         literal
+%type <options>         field_options field_option_list field_option
 %type <messagedef>      message_def extern_message_def message_contents
 %type <namespacedef>    namespace_contents namespace_def
 
+%{
+    extern int yylex ( YYSTYPE * value, void * scanner );
+    extern void yyerror ( fudgeproto::parserstate * state, void * scanner, const char * error );
+%}
+
 %type <boolean>         BOOLLITERAL
 %type <integer>         NATURALNUMBER
 %type <floating>        FLOATNUMBER
 %type <string>          STRINGLITERAL IDENTIFIER
 
+// Values discarded when a parse fails
+%destructor { delete [] $$; } <string>
+%destructor { delete [] $$.key; } <enumrow>
+%destructor { fudgeproto::refcounted::dec ( $$.defvalue ); } <options>
+%destructor { delete $$; } <constraint> <fieldtype>
+%destructor { fudgeproto::refcounted::dec ( $$ ); } <definition> <enumdef> <fielddef> <identifier> <identifier_list> <literal> <messagedef> <namespacedef>
+
 %start root
 
 %%
 
-root: namespace_contents   { fudgeproto::namespacedef::assignAndConsume ( protoparser_root, $1 ); }
-    |                      { }
+root: imports namespace_contents   { fudgeproto::namespacedef::assignAndConsume ( state->root, $2 ); }
+    | namespace_contents           { fudgeproto::namespacedef::assignAndConsume ( state->root, $1 ); }
+    | imports                      { }
+    |                              { }
     ;
 
+imports:    import
+       |    imports import
+       ;
+
+import: IMPORT STRINGLITERAL ';'   {
+                                       state->imports.push_back ( $2 );
+                                       delete [] $2;
+                                   }
+      ;
+
 namespace_def:  NAMESPACE fqname '{' '}'                    { $$ = fudgeproto::namespacedef::createAndConsume ( $2 ); }
              |  NAMESPACE fqname '{' namespace_contents '}' { $$ = ( fudgeproto::namespacedef * ) fudgeproto::definition::setIdentifierAndConsume ( $4, $2 ); }
              ;
@@ -96,12 +130,12 @@ namespace_content:  namespace_def                               { $$ = $1; }
                  |  extern_message_def                          { $$ = $1; }
                  ;
 
-extern_message_def: EXTERN MESSAGE IDENTIFIER ';'               { $$ = new fudgeproto::messagedef ( fudgeproto::identifier::createAndConsume ( $3 ), true ); }
+extern_message_def: EXTERN MESSAGE IDENTIFIER ';'               { $$ = fudgeproto::messagedef::createAndConsume ( $3, true ); }
                   ;
 
-message_def:    MESSAGE IDENTIFIER '{' '}'                                      { $$ = new fudgeproto::messagedef ( fudgeproto::identifier::createAndConsume ( $2 ) ); }
+message_def:    MESSAGE IDENTIFIER '{' '}'                                      { $$ = fudgeproto::messagedef::createAndConsume ( $2 ); }
            |    MESSAGE IDENTIFIER EXTENDS fqname_list '{' '}'                  {
-                                                                                    $$ = new fudgeproto::messagedef ( fudgeproto::identifier::createAndConsume ( $2 ) );
+                                                                                    $$ = fudgeproto::messagedef::createAndConsume ( $2 );
                                                                                     fudgeproto::messagedef::addParentsAndConsume ( $$, $4 );
                                                                                 }
            |    MESSAGE IDENTIFIER '{' message_contents '}'                     { $$ = ( fudgeproto::messagedef * ) fudgeproto::definition::setIdentifierAndConsume ( $4, $2 ); }
@@ -120,10 +154,10 @@ message_content:    field_def ';'                           { $$ = $1; }
                |    enum_def                                { $$ = $1; }
                ;
 
-field_def:  field_modifiers field_type field_constraints IDENTIFIER field_ordinal field_default { $$ = fudgeproto::fielddef::createAndConsume ( $4, $2, $1, $3, $5, $6 ); }
-         |  field_modifiers field_type IDENTIFIER field_ordinal field_default                   { $$ = fudgeproto::fielddef::createAndConsume ( $3, $2, $1, 0, $4, $5 ); }
-         |  field_type field_constraints IDENTIFIER field_ordinal field_default                 { $$ = fudgeproto::fielddef::createAndConsume ( $3, $1, FUDGEPROTO_MODIFIER_NONE, $2, $4, $5 ); }
-         |  field_type IDENTIFIER field_ordinal field_default                                   { $$ = fudgeproto::fielddef::createAndConsume ( $2, $1, FUDGEPROTO_MODIFIER_NONE, 0, $3, $4 ); }
+field_def:  field_modifiers field_type field_constraints IDENTIFIER field_ordinal field_options { GUARDED( $$ = fudgeproto::fielddef::createAndConsume ( $4, $2, $1, $3, $5, $6.defvalue, $6.flags ) ) }
+         |  field_modifiers field_type IDENTIFIER field_ordinal field_options                   { GUARDED( $$ = fudgeproto::fielddef::createAndConsume ( $3, $2, $1, 0, $4, $5.defvalue, $5.flags ) ) }
+         |  field_type field_constraints IDENTIFIER field_ordinal field_options                 { GUARDED( $$ = fudgeproto::fielddef::createAndConsume ( $3, $1, FUDGEPROTO_MODIFIER_NONE, $2, $4, $5.defvalue, $5.flags ) ) }
+         |  field_type IDENTIFIER field_ordinal field_options                                   { GUARDED( $$ = fudgeproto::fielddef::createAndConsume ( $2, $1, FUDGEPROTO_MODIFIER_NONE, 0, $3, $4.defvalue, $4.flags ) ) }
          ;
 
 field_modifiers:    field_modifier                      { $$ = $1; }
@@ -150,11 +184,11 @@ field_type: INDICATOR       { $$ = new fudgeproto::fieldtype ( FUDGEPROTO_TYPE_I
           | DATE            { $$ = new fudgeproto::fieldtype ( FUDGEPROTO_TYPE_DATE ); }
           | TIME            { $$ = new fudgeproto::fieldtype ( FUDGEPROTO_TYPE_TIME ); }
           | DATETIME        { $$ = new fudgeproto::fieldtype ( FUDGEPROTO_TYPE_DATETIME ); }
-          | fqname          { $$ = new fudgeproto::fieldtype ( $1 ); }
+          | fqname          { $$ = fudgeproto::fieldtype::createAndConsume ( $1 ); }
           ;
 
 field_constraints: field_constraint                     { $$ = new fudgeproto::fieldconstraint ( $1 ); }
-                 | field_constraints field_constraint   { $$->append ( $2 ); }
+                 | field_constraints field_constraint   { $$ = $1; $$->append ( $2 ); }
                  ;
 
 field_constraint: '[' ']'               { $$ = FUDGEPROTO_CONSTRAINT_UNBOUNDED; }
@@ -165,11 +199,38 @@ field_ordinal:                      { $$ = FUDGEPROTO_ORDINAL_NONE; }
              | '=' NATURALNUMBER    { $$ = $2; }
              ;
 
-field_default:                                  { $$ = 0; }
-             |  '[' DEFAULT '=' literal ']'     { $$ = $4; }
+field_options:                                  {
+                                                    $$.defvalue = 0;
+                                                    $$.flags = FUDGEPROTO_OPTION_NONE;
+                                                }
+             |  '[' field_option_list ']'       { $$ = $2; }
              ;
 
-enum_def:   ENUM IDENTIFIER '{' '}'             { $$ = new fudgeproto::enumdef ( fudgeproto::identifier::createAndConsume ( $2 ) ); }
+field_option_list:  field_option                        { $$ = $1; }
+                 |  field_option_list ',' field_option  {
+                                                            if ( ( $1.defvalue && $3.defvalue ) || ( $1.flags & $3.flags ) )
+                                                            {
+                                                                fudgeproto::refcounted::dec ( $1.defvalue );
+                                                                fudgeproto::refcounted::dec ( $3.defvalue );
+                                                                state->error = "Field option specified more than once";
+                                                                YYABORT;
+                                                            }
+                                                            $$.defvalue = $1.defvalue ? $1.defvalue : $3.defvalue;
+                                                            $$.flags = $1.flags | $3.flags;
+                                                        }
+                 ;
+
+field_option:   DEFAULT '=' literal     {
+                                            $$.defvalue = $3;
+                                            $$.flags = FUDGEPROTO_OPTION_NONE;
+                                        }
+            |   IDENTIFIER              {
+                                            $$.defvalue = 0;
+                                            GUARDED( $$.flags = fudgeproto::fielddef::optionFromStringAndConsume ( $1 ) )
+                                        }
+            ;
+
+enum_def:   ENUM IDENTIFIER '{' '}'             { $$ = fudgeproto::enumdef::createAndConsume ( $2 ); }
         |   ENUM IDENTIFIER '{' enum_rows '}'   { $$ = ( fudgeproto::enumdef * ) fudgeproto::definition::setIdentifierAndConsume ( $4, $2 ); }
         ;
 
@@ -213,17 +274,9 @@ fqname: IDENTIFIER              { $$ = fudgeproto::identifier::createAndConsume
 
 %%
 
-// Global variables
-int protolexer_linecount;
-
 // Global function definitions
-void yyerror ( const char * error )
-{
-    protoparser_error = error;
-}
-
-int yywrap ( )
+void yyerror ( fudgeproto::parserstate * state, void *, const char * error )
 {
-    return 1;
+    state->error = error;
 }
 
@@ -15,9 +15,14 @@
  */
 
 #include "astaliaser.hpp"
+#include "astcache.hpp"
+#include "astdependencies.hpp"
 #include "astextresolver.hpp"
+#include "astfinaliser.hpp"
 #include "astflattener.hpp"
 #include "astgenerator.hpp"
+#include "astpreparer.hpp"
+#include "astregistrygenerator.hpp"
 #include "astrenamer.hpp"
 #include "astresolver.hpp"
 #include "cppwriterfactory.hpp"
@@ -25,11 +30,17 @@
 #include "filenamegenerator.hpp"
 #include "parser.hpp"
 #include "stage.hpp"
+#include "statistics.hpp"
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
 #include <getopt.h>
+#include <unistd.h>
 
 namespace
 {
@@ -43,14 +54,27 @@ namespace
         { "language", required_argument, NULL,   'l' },
         { "target",   optional_argument, NULL,   't' },
         { "alias",    optional_argument, NULL,   'a' },
-        { "unsafe",   no_argument,       NULL,   'u' }
+        { "unsafe",   no_argument,       NULL,   'u' },
+        { "registry", required_argument, NULL,   'r' },
+        { "jobs",     required_argument, NULL,   'j' },
+        { "depfile",  required_argument, NULL,   'd' },
+        { "manifest", required_argument, NULL,   'm' },
+        { "stats",    optional_argument, NULL,   's' },
+        { "watch",    optional_argument, NULL,   'w' },
+        { "cache",    required_argument, NULL,   'c' },
+        { "amalgamate", optional_argument, NULL, 'A' },
+        { "output",   required_argument, NULL,   'o' },
+        { 0,          0,                 0,      0   }
     };
 
     static void usage ( bool error, const char * errstr = 0 )
     {
         if ( errstr ) std::cerr << programname << ": " << errstr << std::endl;
         if ( error ) std::cout << std::endl;
-        std::cout << "Usage: " << programname << " [-hvVu] [-t dir] [-a ns1:ns2] [-p ns] -l language file" << std::endl
+        std::cout << "Usage: " << programname << " [-hvVu] [-t dir] [-a ns1:ns2] [-p ns] [-r name] [-j jobs]" << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " [-d file] [-m file] [-s[json]] [-w[secs]] [-c file]" << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " [-A[name]] [-o output]..." << std::endl
+                  << "       " << std::string ( programname.size ( ), ' ' ) << " -l language file..." << std::endl
                   << "  -h,--help          : print this help message" << std::endl
                   << "  -v,--version       : display version information then exit" << std::endl
                   << "  -V,--verbose       : generate debug output" << std::endl
@@ -64,7 +88,34 @@ namespace
                   << "                       provided; the wire encoding is not affected." << std::endl
                   << "  -u,--unsafe        : disable the type field check when decoding" << std::endl
                   << "                       messages; the field is still included when" << std::endl
-                  << "                       encoding message." << std::endl;
+                  << "                       encoding message." << std::endl
+                  << "  -r,--registry=NAME : also generate a registry type, with the given" << std::endl
+                  << "                       qualified name, that decodes any message" << std::endl
+                  << "                       defined in the files." << std::endl
+                  << "  -j,--jobs=N        : parse up to N files and generate code for up" << std::endl
+                  << "                       to N top-level messages in parallel." << std::endl
+                  << "  -d,--depfile=FILE  : write a Make rule listing the generated files" << std::endl
+                  << "                       and the files they depend on." << std::endl
+                  << "  -m,--manifest=FILE : write the names of the generated files, one" << std::endl
+                  << "                       per line." << std::endl
+                  << "  -s,--stats[=FORMAT]: report the time, allocations and peak memory" << std::endl
+                  << "                       of each stage and generated file. FORMAT is" << std::endl
+                  << "                       text (the default) or json." << std::endl
+                  << "  -w,--watch[=SECS]  : keep running, checking the input files every" << std::endl
+                  << "                       SECS seconds (default 1) and regenerating the" << std::endl
+                  << "                       code affected by any that change." << std::endl
+                  << "  -c,--cache=FILE    : save the resolved types to FILE and reuse them" << std::endl
+                  << "                       on later runs if no input file has changed." << std::endl
+                  << "  -A,--amalgamate[=NAME]" << std::endl
+                  << "                     : write the implementations of every message in" << std::endl
+                  << "                       a namespace to one file, or of every message to" << std::endl
+                  << "                       the file with the given qualified name." << std::endl
+                  << "  -o,--output=SPEC   : also generate another set of code, from the" << std::endl
+                  << "                       same parse. SPEC is a comma separated list of" << std::endl
+                  << "                       language=LANG, target=DIR, unsafe," << std::endl
+                  << "                       alias=NS1:NS2 and prefix=NS, with the same" << std::endl
+                  << "                       meanings as the options. -l is not needed if" << std::endl
+                  << "                       this is given." << std::endl;
         exit ( error ? 1 : 0 );
     }
 
@@ -76,6 +127,17 @@ namespace
         exit ( 0 );
     }
 
+    // The options for one set of generated code
+    struct outputconfig
+    {
+        outputconfig ( ) : target ( "." ), unsafe ( false ) { }
+
+        std::string language,
+                    target;
+        bool unsafe;
+        std::vector<std::pair<char, std::string> > renames;     // Aliases and prefixes, in order
+    };
+
     static fudgeproto::codewriterfactory * createCodeWriterFactory ( const std::string & language )
     {
         if ( language == "cpp" ) return new fudgeproto::cppwriterfactory;
@@ -88,6 +150,21 @@ namespace
         else throw std::runtime_error ( "No file extensions found for language \"" + language + "\"" );
     }
 
+    static void waitForChanges ( fudgeproto::parsecache & cache,
+                                 std::set<std::string> & changed,
+                                 unsigned int interval )
+    {
+        changed.clear ( );
+        while ( changed.empty ( ) )
+        {
+            sleep ( interval );
+            cache.invalidate ( changed );
+        }
+
+        for ( std::set<std::string>::const_iterator it ( changed.begin ( ) ); it != changed.end ( ); ++it )
+            std::cerr << programname << ": \"" << *it << "\" changed" << std::endl;
+    }
+
     static bool splitAliasString ( std::string & ns1,
                                    std::string & ns2,
                                    const std::string & string )
@@ -99,24 +176,75 @@ namespace
         ns2 = string.substr ( pivot + 1 );
         return true;
     }
+
+    static bool parseOutputSpec ( outputconfig & config, const std::string & spec )
+    {
+        std::istringstream buffer ( spec );
+        std::string item;
+        while ( std::getline ( buffer, item, ',' ) )
+        {
+            const size_t pivot ( item.find ( '=' ) );
+            const std::string key ( item.substr ( 0, pivot ) ),
+                              value ( pivot == std::string::npos ? "" : item.substr ( pivot + 1 ) );
+            if ( key == "unsafe" && pivot == std::string::npos )
+                config.unsafe = true;
+            else if ( value.empty ( ) )
+                return false;
+            else if ( key == "language" )
+                config.language = value;
+            else if ( key == "target" )
+                config.target = value;
+            else if ( key == "alias" || key == "prefix" )
+                config.renames.push_back ( std::make_pair ( key [ 0 ], value ) );
+            else
+                return false;
+        }
+        return ! config.language.empty ( );
+    }
+
+    static void configureMutator ( fudgeproto::identifiermutator & mutator, const outputconfig & config )
+    {
+        std::string ns1, ns2;
+        fudgeproto::refptr<fudgeproto::identifier> id1, id2;
+        for ( std::vector<std::pair<char, std::string> >::const_iterator it ( config.renames.begin ( ) ); it != config.renames.end ( ); ++it )
+        {
+            if ( it->first == 'p' )
+                mutator.add ( *( id1 = fudgeproto::identifier::createFromString ( it->second, "." ) ) );
+            else if ( ! splitAliasString ( ns1, ns2, it->second ) )
+                throw std::invalid_argument ( "alias must be of the format NS1:NS2" );
+            else if ( mutator.add ( *( id1 = fudgeproto::identifier::createFromString ( ns1, "." ) ),
+                                    *( id2 = fudgeproto::identifier::createFromString ( ns2, "." ) ) ) != std::string::npos )
+                throw std::invalid_argument ( "alias \"" + ns1 + "\" clashes with existing alias" );
+        }
+    }
 }
 
 int main ( int argc, char * argv [ ] )
 {
-    // Parse command-line options
-    fudgeproto::identifiermutator mutator;
-    std::string language,
-                target ( "." );
+    // Parse command-line options. The language, target, safety and renaming
+    // options make up the first output, any others are given in full.
+    outputconfig defaults;
+    std::vector<outputconfig> outputs;
+    std::string depfile,
+                manifest,
+                cachefile,
+                cachekey,
+                amalgamation;
     bool verbose ( false ),
-         unsafe ( false );
+         customised ( false ),
+         showstats ( false ),
+         statsjson ( false ),
+         watch ( false ),
+         amalgamate ( false );
+    size_t jobs ( 1 );
+    unsigned int interval ( 1 );
 
-    std::string ns1, ns2;
-    fudgeproto::refptr<fudgeproto::identifier> id1, id2;
+    fudgeproto::refptr<fudgeproto::identifier> id1, registry;
 
     try
     {
         char option;
-        while ( ( option = getopt_long ( argc, argv, "hvVul:t:a:p:", longopts, 0 ) ) >= 0 )
+        while ( ( option = getopt_long ( argc, argv, "hvVul:t:a:p:r:j:d:m:s::w::c:A::o:", longopts, 0 ) ) >= 0 )
             switch ( option )
             {
                 case 'v':   version ( );
@@ -128,29 +256,87 @@ int main ( int argc, char * argv [ ] )
                     break;
 
                 case 'l':
-                    if ( ! language.empty ( ) )
+                    if ( ! defaults.language.empty ( ) )
                         usage ( true, "must specify output language once and only once" );
-                    language = optarg;
+                    defaults.language = optarg;
                     break;
 
                 case 't':
-                    target = optarg;
+                    defaults.target = optarg;
+                    customised = true;
                     break;
 
                 case 'a':
-                    if ( ! splitAliasString ( ns1, ns2, optarg ) )
-                        usage ( true, "alias must be of the format NS1:NS2" );
-                    if ( mutator.add ( *( id1 = fudgeproto::identifier::createFromString ( ns1, "." ) ),
-                                       *( id2 = fudgeproto::identifier::createFromString ( ns2, "." ) ) ) != std::string::npos )
-                        usage ( true, ( "alias \"" + ns1 + "\" clashes with existing alias" ).c_str ( ) );
-                    break;
-
                 case 'p':
-                    mutator.add ( *( id1 = fudgeproto::identifier::createFromString ( optarg, "." ) ) );
+                    defaults.renames.push_back ( std::make_pair ( option, std::string ( optarg ) ) );
+                    customised = true;
                     break;
 
                 case 'u':
-                    unsafe = true;
+                    defaults.unsafe = true;
+                    customised = true;
+                    break;
+
+                case 'r':
+                    if ( registry )
+                        usage ( true, "must specify the registry name at most once" );
+                    registry = fudgeproto::identifier::createFromString ( optarg, "." );
+                    if ( ( *registry ) [ registry->size ( ) - 1 ].empty ( ) )
+                        usage ( true, "registry name cannot be empty" );
+                    break;
+
+                case 'j':
+                {
+                    std::istringstream buffer ( optarg );
+                    if ( ! ( buffer >> jobs ) || ! buffer.eof ( ) || ! jobs )
+                        usage ( true, "number of jobs must be a positive integer" );
+                    break;
+                }
+
+                case 'd':
+                    depfile = optarg;
+                    break;
+
+                case 'm':
+                    manifest = optarg;
+                    break;
+
+                case 's':
+                    showstats = true;
+                    if ( optarg && std::string ( optarg ) == "json" )
+                        statsjson = true;
+                    else if ( optarg && std::string ( optarg ) != "text" )
+                        usage ( true, "statistics format must be text or json" );
+                    break;
+
+                case 'w':
+                {
+                    watch = true;
+                    std::istringstream buffer ( optarg ? optarg : "1" );
+                    if ( ! ( buffer >> interval ) || ! buffer.eof ( ) || ! interval )
+                        usage ( true, "watch interval must be a positive number of seconds" );
+                    break;
+                }
+
+                case 'c':
+                    cachefile = optarg;
+                    break;
+
+                case 'o':
+                    outputs.push_back ( outputconfig ( ) );
+                    if ( ! parseOutputSpec ( outputs.back ( ), optarg ) )
+                        usage ( true, "output must be a list of language=LANG, target=DIR, unsafe, alias=NS1:NS2 and prefix=NS" );
+                    break;
+
+                case 'A':
+                    amalgamate = true;
+                    if ( optarg )
+                    {
+                        id1 = fudgeproto::identifier::createFromString ( optarg, "." );
+                        if ( ! id1->size ( ) || ( *id1 ) [ id1->size ( ) - 1 ].empty ( ) )
+                            usage ( true, "amalgamation name cannot be empty" );
+                        amalgamation = id1->asString ( "_" );
+                    }
                     break;
             }
         argv += optind;
@@ -160,59 +346,236 @@ int main ( int argc, char * argv [ ] )
         usage ( true, exception.what ( ) );
     }
 
-    if ( language.empty ( ) )
+    if ( ! defaults.language.empty ( ) )
+        outputs.insert ( outputs.begin ( ), defaults );
+    else if ( outputs.empty ( ) || customised )
         usage ( true, "must specify the output language" );
-    if ( ( argc -= optind ) != 1 )
-        usage ( true, "must provide the filename of a single FudgeProto file" );
-
-    try
+    for ( std::vector<outputconfig>::const_iterator it ( outputs.begin ( ) ); it != outputs.end ( ); ++it )
     {
-        // Create the correct code writer factory for the chosen language
-        std::auto_ptr<fudgeproto::codewriterfactory> factory ( createCodeWriterFactory ( language ) );
-        if ( ! factory.get ( ) )
-            usage ( true, ( "Unrecognised language name \"" + language + "\"" ).c_str ( ) );
-
-        // Configure the factory
-        factory->setUnsafe ( unsafe );
-
-        // The language must exist, so it's safe to create the filename generator
-        const std::pair<std::string, std::string> fileexts ( getFileExts ( language ) );
-        std::auto_ptr<fudgeproto::filenamegenerator> filenamegen ( new fudgeproto::filenamegenerator ( target, fileexts.first, fileexts.second, true ) );
-
-        // Construct the dumper and state objects that will be used during parsing/post-processing
-        fudgeproto::astdumper dumper ( std::cout );
-        fudgeproto::astindex index;
-        fudgeproto::astextrefs extrefs;
-
-        // Parse the proto file in to an AST
-        fudgeproto::refptr<fudgeproto::namespacedef> root ( fudgeproto::parser::parse ( argv [ 0 ] ) );
-        if ( verbose )
+        try
         {
-            std::cout << "--- RAW AST ---" << std::endl;
-            fudgeproto::Stage::defaultDump ( dumper, root );
+            fudgeproto::identifiermutator mutator;
+            configureMutator ( mutator, *it );
+        }
+        catch ( const std::exception & exception )
+        {
+            usage ( true, exception.what ( ) );
         }
-
-        // Construct the post-parser processing stages
-        fudgeproto::Stage * stages [ 7 ];
-        stages [ 0 ] = new fudgeproto::Stage ( new fudgeproto::astrenamer, dumper, "RENAME STAGE" );
-        stages [ 1 ] = new fudgeproto::Stage ( new fudgeproto::astflattener, dumper, "TREE FLATTEN STAGE" );
-        stages [ 2 ] = new fudgeproto::IndexStage ( new fudgeproto::astindexer ( index ), dumper, index );
-        stages [ 3 ] = new fudgeproto::Stage ( new fudgeproto::astresolver ( index ), dumper, "INTERNAL TYPE RESOLVER STAGE" );
-        stages [ 4 ] = new fudgeproto::Stage ( new fudgeproto::astaliaser ( index, mutator ), dumper, "NAME ALIASER STAGE" );
-        stages [ 5 ] = new fudgeproto::ResolverStage ( new fudgeproto::astextresolver ( extrefs, index ), dumper, extrefs );
-        stages [ 6 ] = new fudgeproto::Stage ( new fudgeproto::astgenerator ( extrefs, index, *factory, *filenamegen ), dumper, "CODE GENERATOR STAGE" );
-
-        // Run the post-parser stages
-        for ( size_t index ( 0 ); index < 7; ++index )
-            stages [ index ]->run ( root, verbose );
-
-        // Clean up
-        std::for_each ( stages, stages + 7, fudgeproto::Stage::destroy );
     }
-    catch ( const std::exception & exception )
+    if ( ( argc -= optind ) < 1 )
+        usage ( true, "must provide the filename of at least one FudgeProto file" );
+    const std::vector<std::string> inputs ( argv, argv + argc );
+    if ( jobs > 1 && ! fudgeproto::astgenerator::isParallel ( ) )
+        std::cerr << programname << ": built without thread support, ignoring number of jobs" << std::endl;
+
+    if ( showstats )
+        fudgeproto::statistics::enableCounting ( );
+
+    // The cached tree depends on which files were asked for, as well as on
+    // the content of those files. It's saved before aliasing, so each output
+    // can use it.
+    for ( std::vector<std::string>::const_iterator it ( inputs.begin ( ) ); it != inputs.end ( ); ++it )
+        cachekey += *it + '\n';
+    std::auto_ptr<fudgeproto::astcache> treecache ( cachefile.empty ( ) ? 0 : new fudgeproto::astcache ( cachefile, cachekey ) );
+
+    // Every AST node created comes from the arena, which is declared first so
+    // that it outlives them all. In watch mode the parse cache keeps the trees
+    // of unchanged files between runs; it also records the content of each
+    // file for the cache of the resolved tree.
+    fudgeproto::arena nodes;
+    fudgeproto::arena::scope nodescope ( nodes );
+    fudgeproto::parsecache cache;
+    std::set<std::string> changed;
+    bool incremental ( false );
+
+    for ( ;; )
     {
-        std::cerr << "FATAL: " << exception.what ( ) << std::endl;
-        return 1;
+        try
+        {
+            // Statistics are only collected if requested, but the timer for the
+            // whole run starts before anything else
+            fudgeproto::statistics stats;
+            std::auto_ptr<fudgeproto::statistics::scope> statsscope ( showstats ? new fudgeproto::statistics::scope ( stats ) : 0 );
+            const fudgeproto::statistics::timer totaltimer;
+
+            // Construct the dumper and state objects that will be used during parsing/post-processing
+            fudgeproto::astdumper dumper ( std::cout );
+            fudgeproto::astindex index;
+            fudgeproto::astextrefs extrefs;
+
+            // Load the resolved tree from the cache if it's up to date,
+            // otherwise parse the proto files in to a single AST
+            fudgeproto::refptr<fudgeproto::namespacedef> root;
+            const fudgeproto::statistics::timer parsetimer;
+            const bool cached ( treecache.get ( ) && treecache->load ( root, index ) );
+            if ( cached )
+            {
+                // The load doesn't go through the parse cache, so watch the
+                // files that the cached tree was built from
+                if ( watch )
+                    for ( std::vector<std::string>::const_iterator it ( treecache->files ( ).begin ( ) ); it != treecache->files ( ).end ( ); ++it )
+                        cache.stamp ( *it );
+            }
+            else
+                root = fudgeproto::parser::parse ( inputs, jobs, watch || treecache.get ( ) ? &cache : 0 );
+            if ( showstats )
+            {
+                fudgeproto::statistics::record parse ( cached ? "CACHE LOADER STAGE" : "PARSER STAGE" );
+                parsetimer.stop ( parse );
+                stats.addStage ( parse );
+            }
+            if ( verbose )
+            {
+                std::cout << ( cached ? "--- CACHED AST ---" : "--- RAW AST ---" ) << std::endl;
+                fudgeproto::Stage::defaultDump ( dumper, root );
+            }
+
+            // Construct the post-parser processing stages that are shared by
+            // every output. Unless each stage is being dumped, compatible stages
+            // are fused to save walking the tree. A cached tree has already been
+            // resolved, and is saved before being aliased for any output.
+            fudgeproto::Stage * stages [ 10 ];
+            size_t numstages ( 0 );
+            if ( ! cached )
+            {
+                if ( verbose )
+                {
+                    stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astrenamer, dumper, "RENAME STAGE" );
+                    stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astflattener, dumper, "TREE FLATTEN STAGE" );
+                    stages [ numstages++ ] = new fudgeproto::IndexStage ( new fudgeproto::astindexer ( index ), dumper, index );
+                }
+                else
+                    stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astpreparer ( index ), dumper, "PREPARATION STAGE" );
+                stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astresolver ( index ), dumper, "INTERNAL TYPE RESOLVER STAGE" );
+                if ( treecache.get ( ) )
+                    stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astcachewriter ( *treecache, index, cache ), dumper, "CACHE WRITER STAGE" );
+            }
+            try
+            {
+                for ( size_t index ( 0 ); index < numstages; ++index )
+                    stages [ index ]->run ( root, verbose );
+            }
+            catch ( ... )
+            {
+                // The walkers hold references to the nodes they were visiting
+                std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+                throw;
+            }
+            std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+
+            // Each output aliases the tree, generates its code and then restores
+            // the original names for the next one
+            std::ostringstream depinfo, manifestinfo;
+            for ( std::vector<outputconfig>::const_iterator output ( outputs.begin ( ) ); output != outputs.end ( ); ++output )
+            {
+                // Create the correct code writer factory for the chosen language
+                std::auto_ptr<fudgeproto::codewriterfactory> factory ( createCodeWriterFactory ( output->language ) );
+                if ( ! factory.get ( ) )
+                    usage ( true, ( "Unrecognised language name \"" + output->language + "\"" ).c_str ( ) );
+
+                // Configure the factory
+                factory->setUnsafe ( output->unsafe );
+
+                // The language must exist, so it's safe to create the filename generator
+                const std::pair<std::string, std::string> fileexts ( getFileExts ( output->language ) );
+                std::auto_ptr<fudgeproto::filenamegenerator> filenamegen ( new fudgeproto::filenamegenerator ( output->target, fileexts.first, fileexts.second, true ) );
+                if ( amalgamate )
+                    filenamegen->setAmalgamation ( amalgamation );
+
+                fudgeproto::identifiermutator mutator;
+                configureMutator ( mutator, *output );
+
+                numstages = 0;
+                fudgeproto::astaliaser * aliaser;
+                if ( verbose )
+                {
+                    stages [ numstages++ ] = new fudgeproto::Stage ( aliaser = new fudgeproto::astaliaser ( index, mutator ), dumper, "NAME ALIASER STAGE" );
+                    stages [ numstages++ ] = new fudgeproto::ResolverStage ( new fudgeproto::astextresolver ( extrefs, index ), dumper, extrefs );
+                }
+                else
+                    stages [ numstages++ ] = new fudgeproto::Stage ( aliaser = new fudgeproto::astfinaliser ( extrefs, index, mutator ), dumper, "FINALISATION STAGE" );
+                fudgeproto::astgenerator * generator ( new fudgeproto::astgenerator ( extrefs, index, *factory, *filenamegen, jobs ) );
+                if ( incremental )
+                    generator->setChangedFiles ( changed );
+                stages [ numstages++ ] = new fudgeproto::Stage ( generator, dumper, "CODE GENERATOR STAGE" );
+                if ( registry )
+                    stages [ numstages++ ] = new fudgeproto::Stage ( new fudgeproto::astregistrygenerator ( *registry, *factory, *filenamegen ), dumper, "REGISTRY GENERATOR STAGE" );
+                fudgeproto::astdependencies * dependencies ( 0 );
+                if ( ! depfile.empty ( ) || ! manifest.empty ( ) )
+                {
+                    dependencies = new fudgeproto::astdependencies ( extrefs, index, *factory, *filenamegen, inputs, registry.get ( ) );
+                    stages [ numstages++ ] = new fudgeproto::Stage ( dependencies, dumper, "DEPENDENCY STAGE" );
+                }
+
+                // Run the post-parser stages
+                try
+                {
+                    for ( size_t index ( 0 ); index < numstages; ++index )
+                        stages [ index ]->run ( root, verbose );
+
+                    if ( dependencies )
+                    {
+                        dependencies->writeDepfile ( depinfo );
+                        dependencies->writeManifest ( manifestinfo );
+                    }
+                }
+                catch ( ... )
+                {
+                    std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+                    throw;
+                }
+
+                // Clean up
+                aliaser->restore ( );
+                std::for_each ( stages, stages + numstages, fudgeproto::Stage::destroy );
+            }
+
+            // Write out the dependency information. Unlike the generated code these are
+            // always rewritten, so they can double as stamp files for the build.
+            if ( ! depfile.empty ( ) )
+            {
+                std::ofstream output;
+                output.exceptions ( std::ios::failbit | std::ios::badbit );
+                output.open ( depfile.c_str ( ) );
+                output << depinfo.str ( );
+            }
+            if ( ! manifest.empty ( ) )
+            {
+                std::ofstream output;
+                output.exceptions ( std::ios::failbit | std::ios::badbit );
+                output.open ( manifest.c_str ( ) );
+                output << manifestinfo.str ( );
+            }
+
+            if ( showstats )
+            {
+                fudgeproto::statistics::record total;
+                totaltimer.stop ( total );
+                stats.setTotal ( total );
+                if ( verbose )
+                    std::cout << "--- STATISTICS ---" << std::endl;
+                stats.write ( std::cout, statsjson );
+            }
+
+            // Everything is up to date, so next time only the changes need generating
+            incremental = watch;
+        }
+        catch ( const std::exception & exception )
+        {
+            if ( ! watch )
+            {
+                std::cerr << "FATAL: " << exception.what ( ) << std::endl;
+                return 1;
+            }
+
+            // Keep watching, but regenerate everything once the error is fixed
+            std::cerr << "ERROR: " << exception.what ( ) << std::endl;
+            incremental = false;
+        }
+
+        if ( ! watch )
+            break;
+        waitForChanges ( cache, changed, interval );
     }
 }
 
@@ -15,6 +15,7 @@
  */
 
 #include "stage.hpp"
+#include "statistics.hpp"
 #include <iostream>
 
 using namespace fudgeproto;
@@ -36,7 +37,14 @@ Stage::~Stage ( )
 void Stage::run ( fudgeproto::refptr<fudgeproto::namespacedef> root,
                   bool verbose )
 {
+    const statistics::timer timer;
     m_walker->walk ( root.get ( ) );
+    if ( statistics * stats = statistics::current ( ) )
+    {
+        statistics::record stage ( m_name );
+        timer.stop ( stage );
+        stats->addStage ( stage );
+    }
 
     if ( verbose )
     {
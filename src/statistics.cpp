@@ -0,0 +1,334 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "statistics.hpp"
+#include "config.h"
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+#ifdef HAS_GETTIMEOFDAY
+#include <sys/time.h>
+#endif
+#ifdef HAS_GETRUSAGE
+#include <sys/resource.h>
+#endif
+
+using namespace fudgeproto;
+
+namespace
+{
+    volatile int counting ( 0 );
+    volatile unsigned long allocationCount ( 0 );
+#ifdef HAS_THREAD_LOCAL
+    __thread unsigned long threadAllocationCount ( 0 );
+#endif
+
+    bool compareNames ( const statistics::record & left, const statistics::record & right )
+    {
+        return left.name < right.name;
+    }
+
+    std::string quote ( const std::string & string )
+    {
+        std::string result ( "\"" );
+        for ( std::string::const_iterator it ( string.begin ( ) ); it != string.end ( ); ++it )
+            switch ( *it )
+            {
+                case '"':   result += "\\\""; break;
+                case '\\':  result += "\\\\"; break;
+                case '\n':  result += "\\n"; break;
+                case '\t':  result += "\\t"; break;
+                default:
+                    if ( static_cast<unsigned char> ( *it ) < 0x20 )
+                    {
+                        static const char digits [ ] = "0123456789abcdef";
+                        result += "\\u00";
+                        result += digits [ ( *it >> 4 ) & 0xf ];
+                        result += digits [ *it & 0xf ];
+                    }
+                    else
+                        result += *it;
+            }
+        return result + "\"";
+    }
+
+    std::string toString ( unsigned long value )
+    {
+        std::ostringstream buffer;
+        buffer << value;
+        return buffer.str ( );
+    }
+
+    void writeTextRow ( std::ostream & output,
+                        const statistics::record & record,
+                        const std::string & bytes,
+                        const char * suffix = "" )
+    {
+        output << std::setprecision ( 3 ) << std::setw ( 12 ) << record.seconds * 1000.0
+               << std::setw ( 13 ) << record.allocations
+               << std::setw ( 13 ) << record.peakMemory / 1024
+               << std::setw ( 13 ) << bytes
+               << "  " << record.name << suffix << std::endl;
+    }
+
+    void writeJsonRecord ( std::ostream & output, const statistics::record & record )
+    {
+        output << "\"seconds\": " << record.seconds
+               << ", \"allocations\": " << record.allocations
+               << ", \"peak_memory\": " << record.peakMemory;
+    }
+}
+
+struct statistics::mutex
+{
+#ifdef HAS_PTHREADS
+    mutex ( ) { pthread_mutex_init ( &handle, 0 ); }
+    ~mutex ( ) { pthread_mutex_destroy ( &handle ); }
+
+    pthread_mutex_t handle;
+#endif
+
+    class guard
+    {
+        public:
+            guard ( mutex & target )
+                : m_target ( target )
+            {
+#ifdef HAS_PTHREADS
+                pthread_mutex_lock ( &m_target.handle );
+#endif
+            }
+
+            ~guard ( )
+            {
+#ifdef HAS_PTHREADS
+                pthread_mutex_unlock ( &m_target.handle );
+#endif
+            }
+
+        private:
+            mutex & m_target;
+    };
+};
+
+statistics * statistics::s_current ( 0 );
+
+statistics::record::record ( const std::string & name )
+    : name ( name )
+    , seconds ( 0.0 )
+    , allocations ( 0 )
+    , peakMemory ( 0 )
+    , bytes ( 0 )
+    , written ( false )
+{
+}
+
+statistics::timer::timer ( bool perThread )
+    : m_perThread ( perThread )
+    , m_start ( now ( ) )
+    , m_allocations ( perThread ? threadAllocations ( ) : allocations ( ) )
+{
+}
+
+void statistics::timer::stop ( record & target ) const
+{
+    target.seconds = now ( ) - m_start;
+    target.allocations = ( m_perThread ? threadAllocations ( ) : allocations ( ) ) - m_allocations;
+    target.peakMemory = peakMemory ( );
+}
+
+statistics::scope::scope ( statistics & target )
+    : m_previous ( s_current )
+{
+    s_current = &target;
+}
+
+statistics::scope::~scope ( )
+{
+    s_current = m_previous;
+}
+
+statistics::statistics ( )
+    : m_total ( "TOTAL" )
+    , m_mutex ( new mutex )
+{
+}
+
+statistics::~statistics ( )
+{
+    delete m_mutex;
+}
+
+void statistics::addStage ( const record & stage )
+{
+    mutex::guard lock ( *m_mutex );
+    m_stages.push_back ( stage );
+}
+
+void statistics::addFile ( const record & file )
+{
+    mutex::guard lock ( *m_mutex );
+    m_files.push_back ( file );
+}
+
+void statistics::setTotal ( const record & total )
+{
+    mutex::guard lock ( *m_mutex );
+    m_total = total;
+    m_total.name = "TOTAL";
+}
+
+void statistics::write ( std::ostream & output, bool json ) const
+{
+    mutex::guard lock ( *m_mutex );
+
+    const std::ios::fmtflags flags ( output.flags ( ) );
+    const std::streamsize precision ( output.precision ( ) );
+    output << std::fixed;
+
+    if ( json )
+        writeJson ( output );
+    else
+        writeText ( output );
+
+    output.flags ( flags );
+    output.precision ( precision );
+}
+
+void statistics::enableCounting ( )
+{
+    counting = 1;
+}
+
+void statistics::countAllocation ( )
+{
+    if ( ! counting )
+        return;
+
+#ifdef HAS_ATOMIC_BUILTINS
+    __sync_add_and_fetch ( &allocationCount, 1 );
+#else
+    ++allocationCount;
+#endif
+#ifdef HAS_THREAD_LOCAL
+    ++threadAllocationCount;
+#endif
+}
+
+unsigned long statistics::allocations ( )
+{
+    return allocationCount;
+}
+
+unsigned long statistics::threadAllocations ( )
+{
+    // Without thread local storage this is only accurate for a single thread
+#ifdef HAS_THREAD_LOCAL
+    return threadAllocationCount;
+#else
+    return allocationCount;
+#endif
+}
+
+unsigned long statistics::peakMemory ( )
+{
+#ifdef HAS_GETRUSAGE
+    struct rusage usage;
+    if ( getrusage ( RUSAGE_SELF, &usage ) )
+        return 0;
+#ifdef __APPLE__
+    return static_cast<unsigned long> ( usage.ru_maxrss );
+#else
+    return static_cast<unsigned long> ( usage.ru_maxrss ) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+double statistics::now ( )
+{
+#ifdef HAS_GETTIMEOFDAY
+    struct timeval time;
+    gettimeofday ( &time, 0 );
+    return time.tv_sec + time.tv_usec / 1000000.0;
+#else
+    return static_cast<double> ( std::time ( 0 ) );
+#endif
+}
+
+void statistics::writeText ( std::ostream & output ) const
+{
+    std::vector<record> files ( m_files );
+    std::sort ( files.begin ( ), files.end ( ), compareNames );
+
+    output << "   Time (ms)  Allocations   Peak (KiB)        Bytes  Name" << std::endl;
+    for ( std::vector<record>::const_iterator it ( m_stages.begin ( ) ); it != m_stages.end ( ); ++it )
+        writeTextRow ( output, *it, "-" );
+
+    unsigned long bytes ( 0 ), written ( 0 );
+    for ( std::vector<record>::const_iterator it ( files.begin ( ) ); it != files.end ( ); ++it )
+    {
+        bytes += it->bytes;
+        written += it->written;
+        writeTextRow ( output, *it, toString ( it->bytes ), it->written ? "" : " (unchanged)" );
+    }
+
+    writeTextRow ( output, m_total, toString ( bytes ) );
+    output << files.size ( ) << " files generated, " << written << " written" << std::endl;
+}
+
+void statistics::writeJson ( std::ostream & output ) const
+{
+    std::vector<record> files ( m_files );
+    std::sort ( files.begin ( ), files.end ( ), compareNames );
+
+    output << std::setprecision ( 6 ) << "{" << std::endl << "  \"stages\": [";
+    for ( std::vector<record>::const_iterator it ( m_stages.begin ( ) ); it != m_stages.end ( ); ++it )
+    {
+        output << ( it == m_stages.begin ( ) ? "" : "," ) << std::endl
+               << "    { \"name\": " << quote ( it->name ) << ", ";
+        writeJsonRecord ( output, *it );
+        output << " }";
+    }
+    output << std::endl << "  ]," << std::endl << "  \"files\": [";
+
+    unsigned long bytes ( 0 ), written ( 0 );
+    for ( std::vector<record>::const_iterator it ( files.begin ( ) ); it != files.end ( ); ++it )
+    {
+        bytes += it->bytes;
+        written += it->written;
+
+        output << ( it == files.begin ( ) ? "" : "," ) << std::endl
+               << "    { \"name\": " << quote ( it->name ) << ", ";
+        writeJsonRecord ( output, *it );
+        output << ", \"bytes\": " << it->bytes
+               << ", \"written\": " << ( it->written ? "true" : "false" ) << " }";
+    }
+    output << std::endl << "  ]," << std::endl << "  \"total\": { ";
+    writeJsonRecord ( output, m_total );
+    output << ", \"bytes\": " << bytes
+           << ", \"files\": " << files.size ( )
+           << ", \"written\": " << written << " }" << std::endl
+           << "}" << std::endl;
+}
+
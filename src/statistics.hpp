@@ -0,0 +1,122 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_STATISTICS
+#define INC_FUDGEPROTO_STATISTICS
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace fudgeproto {
+
+// Collects timing, allocation and memory figures for a run of the generator:
+// one record for each stage (parsing included) and one for each generated
+// file. Files may be added from several threads at once.
+class statistics
+{
+    public:
+        struct record
+        {
+            record ( const std::string & name = std::string ( ) );
+
+            std::string name;
+            double seconds;
+            unsigned long allocations;
+            unsigned long peakMemory;   // Peak resident size of the process, in bytes
+            unsigned long bytes;        // Generated files only
+            bool written;               // False if the file was left unchanged
+        };
+
+        // Measures the time taken and the allocations made from construction
+        // until stopped. A per-thread timer only counts allocations made by the
+        // calling thread, where the platform supports it.
+        class timer
+        {
+            public:
+                timer ( bool perThread = false );
+
+                void stop ( record & target ) const;
+
+            private:
+                bool m_perThread;
+                double m_start;
+                unsigned long m_allocations;
+        };
+
+        // Makes a statistics collector current for the lifetime of the scope
+        class scope
+        {
+            public:
+                scope ( statistics & target );
+                ~scope ( );
+
+            private:
+                statistics * m_previous;
+
+                scope ( const scope & source );
+                scope & operator= ( const scope & source );
+        };
+
+        statistics ( );
+        ~statistics ( );
+
+        void addStage ( const record & stage );
+        void addFile ( const record & file );
+        void setTotal ( const record & total );
+
+        inline const std::vector<record> & stages ( ) const { return m_stages; }
+        inline const std::vector<record> & files ( ) const { return m_files; }
+        inline const record & total ( ) const { return m_total; }
+
+        void write ( std::ostream & output, bool json ) const;
+
+        // The collector that stages and generated files report to, if any
+        static inline statistics * current ( ) { return s_current; }
+
+        // Allocations are only counted once enabled, so normal runs don't pay
+        // for the atomic update
+        static void enableCounting ( );
+        static void countAllocation ( );
+        static unsigned long allocations ( );
+        static unsigned long threadAllocations ( );
+
+        static unsigned long peakMemory ( );
+        static double now ( );
+
+    private:
+        struct mutex;
+
+        std::vector<record> m_stages;
+        std::vector<record> m_files;
+        record m_total;
+        mutex * m_mutex;
+
+        static statistics * s_current;
+
+        void writeText ( std::ostream & output ) const;
+        void writeJson ( std::ostream & output ) const;
+
+        // Don't allow copying - the mutex belongs to a single collector
+        statistics ( const statistics & source );
+        statistics & operator= ( const statistics & source );
+};
+
+}
+
+#endif
+
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "symboltable.hpp"
+#include "config.h"
+#include <set>
+
+#ifdef HAS_PTHREADS
+#include <pthread.h>
+#endif
+
+using namespace fudgeproto;
+
+namespace
+{
+    // Set nodes never move, so the address of a member is a stable symbol
+    std::set<std::string> symbols;
+
+#ifdef HAS_PTHREADS
+    pthread_mutex_t symbolsMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+    class symbolslock
+    {
+        public:
+            symbolslock ( )
+            {
+#ifdef HAS_PTHREADS
+                pthread_mutex_lock ( &symbolsMutex );
+#endif
+            }
+
+            ~symbolslock ( )
+            {
+#ifdef HAS_PTHREADS
+                pthread_mutex_unlock ( &symbolsMutex );
+#endif
+            }
+    };
+}
+
+symbol symboltable::intern ( const std::string & name )
+{
+    symbolslock lock;
+    return &*symbols.insert ( name ).first;
+}
+
+symbol symboltable::find ( const std::string & name )
+{
+    symbolslock lock;
+    std::set<std::string>::const_iterator it ( symbols.find ( name ) );
+    return it == symbols.end ( ) ? 0 : &*it;
+}
+
+size_t symboltable::size ( )
+{
+    symbolslock lock;
+    return symbols.size ( );
+}
@@ -0,0 +1,48 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef INC_FUDGEPROTO_SYMBOLTABLE
+#define INC_FUDGEPROTO_SYMBOLTABLE
+
+#include <string>
+
+namespace fudgeproto {
+
+// An interned string. Equal strings are always interned to the same symbol,
+// so symbols can be compared, ordered and used as keys without looking at
+// their characters. Symbols remain valid until the process exits.
+typedef const std::string * symbol;
+
+class symboltable
+{
+    public:
+        static symbol intern ( const std::string & name );
+
+        // Returns NULL if the name has never been interned
+        static symbol find ( const std::string & name );
+
+        static size_t size ( );
+
+    private:
+        // Not implemented - class should not be instantiated
+        symboltable ( );
+        ~symboltable ( );
+};
+
+}
+
+#endif
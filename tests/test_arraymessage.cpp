@@ -18,6 +18,7 @@
 #include "simpletest.hpp"
 #include "memoryutil.hpp"
 #include "built_array_arraymessage.hpp"
+#include "built_array_elementmessage.hpp"
 
 using namespace fudgeproto;
 using namespace built::array;
@@ -52,6 +52,52 @@ DEFINE_TEST( EncodeDecode )
 
 END_TEST
 
+DEFINE_TEST( Validate )
+    TopMessage msg;
+    msg.setbasefld ( 100 );
+    msg.setinterfld ( 200 );
+    msg.settopfld ( 300 );
+
+    const fudge::message payload ( msg.asFudgeMessage ( ) );
+    TEST_EQUALS_TRUE( TopMessage::validate ( payload ) );
+    TEST_EQUALS_TRUE( ! BaseMessage::validate ( payload ) );
+
+    // Drop a field inherited from the base message
+    fudge::message broken;
+    broken.addField ( fudge::string ( "built.TopMessage" ), fudge::message::noname, 0 );
+    broken.addField ( static_cast<fudge_i32> ( 200 ), fudge::string ( "interfld" ) );
+    broken.addField ( static_cast<fudge_i32> ( 300 ), fudge::string ( "topfld" ) );
+    TEST_EQUALS_TRUE( ! TopMessage::validate ( broken ) );
+END_TEST
+
+DEFINE_TEST( FlattenedHierarchy )
+    // Inherited fields are encoded base first, ahead of the message's own
+    TopMessage msg;
+    msg.setbasefld ( 100 );
+    msg.setinterfld ( 200 );
+    msg.settopfld ( 300 );
+
+    const fudge::message payload ( msg.asFudgeMessage ( ) );
+    TEST_EQUALS( payload.size ( ), static_cast<size_t> ( 4 ) );
+    TEST_EQUALS( payload.getFieldAt ( 1 ).name ( ).convertToStdString ( ), std::string ( "basefld" ) );
+    TEST_EQUALS( payload.getFieldAt ( 2 ).name ( ).convertToStdString ( ), std::string ( "interfld" ) );
+    TEST_EQUALS( payload.getFieldAt ( 3 ).name ( ).convertToStdString ( ), std::string ( "topfld" ) );
+
+    // All levels decode from a single message regardless of field order
+    fudge::message reversed;
+    reversed.addField ( static_cast<fudge_i32> ( 3 ), fudge::string ( "topfld" ) );
+    reversed.addField ( static_cast<fudge_i32> ( 2 ), fudge::string ( "interfld" ) );
+    reversed.addField ( static_cast<fudge_i32> ( 1 ), fudge::string ( "basefld" ) );
+    reversed.addField ( fudge::string ( "built.TopMessage" ), fudge::message::noname, 0 );
+
+    TopMessage decoded ( reversed );
+    TEST_EQUALS( decoded.basefld ( ), 1 );
+    TEST_EQUALS( decoded.interfld ( ), 2 );
+    TEST_EQUALS( decoded.topfld ( ), 3 );
+END_TEST
+
 DEFINE_TEST_SUITE( DeepInheritance )
     REGISTER_TEST( EncodeDecode )
+    REGISTER_TEST( Validate )
+    REGISTER_TEST( FlattenedHierarchy )
 END_TEST_SUITE
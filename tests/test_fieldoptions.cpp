@@ -0,0 +1,109 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "encoderutils.hpp"
+#include "simpletest.hpp"
+#include "memoryutil.hpp"
+#include "built_fieldoptionsmessage.hpp"
+
+using namespace fudgeproto;
+using namespace built;
+
+namespace
+{
+    typedef std::vector< std::vector< std::vector<float> > > grid_t;
+
+    grid_t createGrid ( size_t rows )
+    {
+        grid_t grid ( rows, std::vector< std::vector<float> > ( 3, std::vector<float> ( 2 ) ) );
+        for ( size_t outer ( 0 ); outer < rows; ++outer )
+            for ( size_t middle ( 0 ); middle < 3; ++middle )
+                for ( size_t inner ( 0 ); inner < 2; ++inner )
+                    grid [ outer ] [ middle ] [ inner ] = outer * 100.0f + middle * 10.0f + inner;
+        return grid;
+    }
+}
+
+DEFINE_TEST( EncodeDecode )
+    std::auto_ptr<FieldOptionsMessage> message ( new FieldOptionsMessage );
+    message->setcounter ( 42 );
+    message->setratio ( 0.25 );
+    message->setgrid ( createGrid ( 4 ) );
+    message->setlabel ( fudge::string ( "Label" ) );
+
+    std::auto_ptr<FieldOptionsMessage> decoded ( decode<FieldOptionsMessage> ( encode ( *message, "fieldoptions.dat" ) ) );
+    TEST_EQUALS( decoded->counter ( ), 42 );
+    TEST_EQUALS_TRUE( decoded->ratio ( ) );
+    TEST_EQUALS_FLOAT( *decoded->ratio ( ), 0.25, 0.0001 );
+    TEST_EQUALS_TRUE( decoded->grid ( ) == createGrid ( 4 ) );
+    TEST_EQUALS_TRUE( decoded->label ( ) );
+    TEST_EQUALS( ( *decoded->label ( ) ).convertToStdString ( ), std::string ( "Label" ) );
+END_TEST
+
+DEFINE_TEST( PackedFields )
+    FieldOptionsMessage message;
+    message.setcounter ( 42 );
+    message.setgrid ( createGrid ( 1 ) );
+
+    // Packed fields are only present by ordinal
+    const fudge::message encoded ( message.asFudgeMessage ( ) );
+    fudge::field field;
+    TEST_EQUALS_TRUE( ! encoded.getField ( field, fudge::string ( "counter" ) ) );
+    TEST_EQUALS_TRUE( encoded.getField ( field, static_cast<fudge_i16> ( 1 ) ) );
+    TEST_EQUALS_TRUE( ! field.hasName ( ) );
+    TEST_EQUALS( field.getAsInt32 ( ), 42 );
+
+    // A named field with the right name is not a packed field
+    fudge::message named;
+    named.addField ( fudge::string ( "built.FieldOptionsMessage" ), fudge::message::noname, 0 );
+    named.addField ( static_cast<fudge_i32> ( 42 ), fudge::string ( "counter" ) );
+    named.addField ( std::vector<fudge_f32> ( 6 ), fudge::string ( "grid" ), 2 );
+    TEST_EQUALS_TRUE( ! FieldOptionsMessage::validate ( named ) );
+END_TEST
+
+DEFINE_TEST( FlatCollections )
+    FieldOptionsMessage message;
+    message.setcounter ( 1 );
+    message.setgrid ( createGrid ( 3 ) );
+
+    // The whole grid is held in a single native array
+    const fudge::message encoded ( message.asFudgeMessage ( ) );
+    fudge::field field;
+    TEST_EQUALS_TRUE( encoded.getField ( field, fudge::string ( "grid" ) ) );
+    TEST_EQUALS_INT( field.type ( ), FUDGE_TYPE_FLOAT_ARRAY );
+    TEST_EQUALS_INT( field.numelements ( ), 18 );
+    TEST_EQUALS_TRUE( FieldOptionsMessage::validate ( encoded ) );
+
+    // Arrays that aren't a whole number of rows are rejected
+    fudge::message partial;
+    partial.addField ( fudge::string ( "built.FieldOptionsMessage" ), fudge::message::noname, 0 );
+    partial.addField ( static_cast<fudge_i32> ( 1 ), fudge::message::noname, 1 );
+    partial.addField ( std::vector<fudge_f32> ( 7 ), fudge::string ( "grid" ), 2 );
+    TEST_EQUALS_TRUE( ! FieldOptionsMessage::validate ( partial ) );
+    TEST_THROWS_EXCEPTION( FieldOptionsMessage rejected ( partial ), std::runtime_error );
+
+    // Rows of the wrong size can't be encoded
+    grid_t broken ( createGrid ( 2 ) );
+    broken [ 1 ] [ 2 ].push_back ( 0.0f );
+    message.setgrid ( broken );
+    TEST_THROWS_EXCEPTION( message.asFudgeMessage ( ), std::runtime_error );
+END_TEST
+
+DEFINE_TEST_SUITE( FieldOptions )
+    REGISTER_TEST( EncodeDecode )
+    REGISTER_TEST( PackedFields )
+    REGISTER_TEST( FlatCollections )
+END_TEST_SUITE
@@ -248,8 +248,81 @@ DEFINE_TEST( CombinedFlatMessage )
     TEST_THROWS_EXCEPTION( encoded = encode ( *message, "combinedflat_broken.dat" ), std::runtime_error );
 END_TEST
 
+DEFINE_TEST( Validate )
+    // Minimal valid FlatMessageOne, the optional description is absent
+    fudge::message valid;
+    valid.addField ( fudge::string ( "built.FlatMessageOne" ), fudge::message::noname, 0 );
+    valid.addField ( static_cast<fudge_i32> ( 42 ), fudge::string ( "identifier" ), 1 );
+    TEST_EQUALS_TRUE( FlatMessageOne::validate ( valid ) );
+    TEST_EQUALS_TRUE( ! FlatMessageTwo::validate ( valid ) );
+
+    // Missing required field
+    fudge::message missing;
+    missing.addField ( fudge::string ( "built.FlatMessageOne" ), fudge::message::noname, 0 );
+    TEST_EQUALS_TRUE( ! FlatMessageOne::validate ( missing ) );
+
+    // Wrong field type
+    fudge::message wrongtype;
+    wrongtype.addField ( fudge::string ( "built.FlatMessageOne" ), fudge::message::noname, 0 );
+    wrongtype.addField ( fudge::string ( "42" ), fudge::string ( "identifier" ), 1 );
+    TEST_EQUALS_TRUE( ! FlatMessageOne::validate ( wrongtype ) );
+
+    // Encoded messages validate, including inherited fields and fixed dimensions
+    std::vector<int> sourceIntegers ( 4 );
+    std::vector< std::vector<float> > sourceMatrix ( 2, std::vector<float> ( 2 ) );
+    std::auto_ptr<Combined::FlatMessage> message ( new Combined::FlatMessage );
+    message->setintegers ( sourceIntegers );
+    message->setmatrix ( sourceMatrix );
+
+    const fudge::message combined ( message->asFudgeMessage ( ) );
+    TEST_EQUALS_TRUE( Combined::FlatMessage::validate ( combined ) );
+    TEST_EQUALS_TRUE( ! FlatMessageOne::validate ( combined ) );
+
+    // Byte buffer variant, including a buffer that cannot be decoded
+    std::pair<fudge_byte *, fudge_i32> encoded ( encode ( *message, "combinedflat_validate.dat" ) );
+    TEST_EQUALS_TRUE( Combined::FlatMessage::validate ( encoded.first, encoded.second ) );
+    TEST_EQUALS_TRUE( ! Combined::FlatMessage::validate ( encoded.first, encoded.second / 2 ) );
+    free ( encoded.first );
+
+    // Incorrect fixed dimensions
+    fudge::message baddims;
+    std::vector<fudge_i32> badIntegers ( 3 );
+    baddims.addField ( fudge::string ( "built.Combined.FlatMessage" ), fudge::message::noname, 0 );
+    baddims.addField ( static_cast<fudge_i32> ( 42 ), fudge::string ( "identifier" ), 1 );
+    baddims.addField ( fudge::message ( ), fudge::string ( "coords" ) );
+    baddims.addField ( badIntegers, fudge::string ( "integers" ) );
+    TEST_EQUALS_TRUE( ! Combined::FlatMessage::validate ( baddims ) );
+END_TEST
+
+DEFINE_TEST( FieldLookup )
+    // Fields are matched by name regardless of order, unknown names and
+    // unnamed fields are ignored and the first of any duplicates is used
+    fudge::message source;
+    source.addField ( fudge::string ( "Second description" ), fudge::string ( "description" ) );
+    source.addField ( static_cast<fudge_i32> ( 7 ), fudge::string ( "unknown" ) );
+    source.addField ( static_cast<fudge_i32> ( 8 ), fudge::message::noname, 3 );
+    source.addField ( static_cast<fudge_i32> ( 42 ), fudge::string ( "identifier" ), 1 );
+    source.addField ( fudge::string ( "Ignored description" ), fudge::string ( "description" ) );
+    source.addField ( fudge::string ( "built.FlatMessageOne" ), fudge::message::noname, 0 );
+
+    TEST_EQUALS_TRUE( FlatMessageOne::validate ( source ) );
+    std::auto_ptr<FlatMessageOne> message ( new FlatMessageOne ( source ) );
+    TEST_EQUALS( message->identifier ( ), 42 );
+    TEST_EQUALS_TRUE( message->description ( ) );
+    TEST_EQUALS( ( *message->description ( ) ).convertToStdString ( ), std::string ( "Second description" ) );
+
+    // Names sharing a length and prefix with a known field are not matched
+    fudge::message nearmiss;
+    nearmiss.addField ( fudge::string ( "built.FlatMessageOne" ), fudge::message::noname, 0 );
+    nearmiss.addField ( static_cast<fudge_i32> ( 42 ), fudge::string ( "identifieR" ) );
+    TEST_EQUALS_TRUE( ! FlatMessageOne::validate ( nearmiss ) );
+    TEST_THROWS_EXCEPTION( FlatMessageOne rejected ( nearmiss ), std::runtime_error );
+END_TEST
+
 DEFINE_TEST_SUITE( FlatMessage )
     REGISTER_TEST( FlatOne )
     REGISTER_TEST( FlatTwo )
     REGISTER_TEST( CombinedFlatMessage )
+    REGISTER_TEST( Validate )
+    REGISTER_TEST( FieldLookup )
 END_TEST_SUITE
@@ -0,0 +1,161 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ast.hpp"
+#include "parser.hpp"
+#include "simpletest.hpp"
+#include <cstring>
+
+using namespace fudgeproto;
+
+namespace
+{
+    // A leaked node should fail the tests, not just be reported
+    const arena::leakhandler defaultLeakHandler ( arena::setLeakHandler ( arena::abortOnLeak ) );
+}
+
+DEFINE_TEST( ReferenceCounts )
+    refptr<identifier> id ( new identifier ( "first" ) );
+    TEST_EQUALS_INT( id->refcount ( ), 1 );
+    {
+        refptr<identifier> copy ( id );
+        TEST_EQUALS_INT( id->refcount ( ), 2 );
+    }
+    TEST_EQUALS_INT( id->refcount ( ), 1 );
+    refcounted::dec ( id.release ( ) );
+    TEST_EQUALS_INT( id->refcount ( ), 1 );
+END_TEST
+
+DEFINE_TEST( ArenaAllocation )
+    arena nodes;
+    TEST_EQUALS_INT( nodes.blocks ( ), 0 );
+
+    // Freed memory is reused for allocations of a similar size
+    void * first ( nodes.allocate ( 40 ) );
+    void * second ( nodes.allocate ( 40 ) );
+    TEST_EQUALS_TRUE( first != second );
+    nodes.deallocate ( first, 40 );
+    void * third ( nodes.allocate ( 33 ) );
+    TEST_EQUALS_TRUE( third == first );
+    TEST_EQUALS_INT( nodes.blocks ( ), 1 );
+
+    // Large allocations come straight from the heap
+    void * large ( nodes.allocate ( 1 << 20 ) );
+    TEST_EQUALS_INT( nodes.blocks ( ), 1 );
+    TEST_EQUALS_INT( nodes.live ( ), 3 );
+    nodes.deallocate ( large, 1 << 20 );
+    nodes.deallocate ( second, 40 );
+    nodes.deallocate ( third, 33 );
+    TEST_EQUALS_INT( nodes.live ( ), 0 );
+END_TEST
+
+namespace
+{
+    size_t leaked ( 0 );
+
+    void recordLeak ( size_t live )
+    {
+        leaked = live;
+    }
+}
+
+DEFINE_TEST( ArenaLeak )
+    // Destroying an arena with live allocations calls the leak handler
+    const arena::leakhandler previous ( arena::setLeakHandler ( recordLeak ) );
+    leaked = 0;
+    {
+        arena nodes;
+        nodes.allocate ( 40 );
+        nodes.deallocate ( nodes.allocate ( 24 ), 24 );
+        TEST_EQUALS_INT( nodes.live ( ), 1 );
+    }
+    TEST_EQUALS_INT( leaked, 1 );
+
+    // An arena whose allocations have all been freed is destroyed quietly
+    leaked = 0;
+    {
+        arena nodes;
+        arena::scope nodescope ( nodes );
+        refptr<identifier> temporary ( new identifier ( "temporary" ) );
+        TEST_EQUALS_INT( nodes.live ( ), 1 );
+    }
+    TEST_EQUALS_INT( leaked, 0 );
+
+    // By default the leak is reported and the memory kept, so the live
+    // allocation is still usable
+    arena::setLeakHandler ( defaultLeakHandler );
+    char * kept ( 0 );
+    {
+        arena nodes;
+        kept = static_cast<char *> ( nodes.allocate ( 40 ) );
+        strcpy ( kept, "kept" );
+    }
+    TEST_EQUALS( std::string ( kept ), std::string ( "kept" ) );
+    arena::setLeakHandler ( previous );
+END_TEST
+
+DEFINE_TEST( ArenaScope )
+    refptr<identifier> outside ( new identifier ( "outside" ) );
+    refptr<identifier> replaced ( new identifier ( "replaced" ) );
+    TEST_EQUALS_TRUE( arena::current ( ) == 0 );
+    {
+        arena nodes;
+        arena::scope nodescope ( nodes );
+        TEST_EQUALS_TRUE( arena::current ( ) == &nodes );
+
+        // Nodes created in the scope come from the arena, those from before can still be freed
+        refptr<namespacedef> root;
+        TEST_THROWS_NOTHING( root = parser::parse ( "./test_files/nested.proto" ) );
+        TEST_EQUALS_TRUE( nodes.blocks ( ) > 0 );
+        TEST_EQUALS_INT( root->refcount ( ), 1 );
+
+        refptr<identifier> inside ( outside->clone ( ) );
+        outside = inside;
+        TEST_EQUALS( outside->asString ( "." ), std::string ( "outside" ) );
+
+        // Anything still referenced after the scope must come from outside the arena
+        outside = replaced;
+    }
+    TEST_EQUALS_TRUE( arena::current ( ) == 0 );
+    TEST_EQUALS( outside->asString ( "." ), std::string ( "replaced" ) );
+END_TEST
+
+DEFINE_TEST( ArenaParseFailure )
+    // Everything built before a parse fails is released
+    arena nodes;
+    arena::scope nodescope ( nodes );
+    refptr<namespacedef> root;
+    TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/wrong_default_type.proto" ), std::runtime_error );
+    TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/clashing_modifiers.proto" ), std::runtime_error );
+    TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/invalid_option.proto" ), std::runtime_error );
+    TEST_EQUALS_INT( nodes.live ( ), 0 );
+
+    const std::string repeated ( "namespace a { message B { optional string c [default=\"d\", default=\"e\"]; } }" );
+    const std::string unterminated ( "namespace a { message B { required int c; optional B d" );
+    std::vector<std::string> imports;
+    TEST_THROWS_EXCEPTION( root = parser::parse ( repeated.data ( ), repeated.size ( ), "repeated.proto", imports ), std::runtime_error );
+    TEST_THROWS_EXCEPTION( root = parser::parse ( unterminated.data ( ), unterminated.size ( ), "unterminated.proto", imports ), std::runtime_error );
+    TEST_EQUALS_INT( nodes.live ( ), 0 );
+END_TEST
+
+DEFINE_TEST_SUITE( MemoryUtil )
+    REGISTER_TEST( ReferenceCounts )
+    REGISTER_TEST( ArenaAllocation )
+    REGISTER_TEST( ArenaScope )
+    REGISTER_TEST( ArenaLeak )
+    REGISTER_TEST( ArenaParseFailure )
+END_TEST_SUITE
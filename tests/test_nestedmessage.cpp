@@ -19,7 +19,11 @@
 #include "encoderutils.hpp"
 #include "simpletest.hpp"
 #include "memoryutil.hpp"
+#include "built_combined_flatmessage.hpp"
 #include "built_complex_nestedmessagetwo.hpp"
+#include "built_flatmessageone.hpp"
+#include "built_flatmessagetwo.hpp"
+#include "built_nestedmessageone.hpp"
 
 using namespace fudgeproto;
 using namespace built;
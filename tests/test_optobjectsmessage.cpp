@@ -17,6 +17,7 @@
 #include "encoderutils.hpp"
 #include "simpletest.hpp"
 #include "memoryutil.hpp"
+#include "built_optobjects_inner.hpp"
 #include "built_optobjects_outer.hpp"
 
 using namespace fudgeproto;
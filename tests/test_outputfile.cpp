@@ -0,0 +1,84 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "outputfile.hpp"
+#include "simpletest.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace fudgeproto;
+
+namespace
+{
+    std::string readFile ( const std::string & filename )
+    {
+        std::ifstream input ( filename.c_str ( ), std::ios::in | std::ios::binary );
+        return std::string ( std::istreambuf_iterator<char> ( input ), std::istreambuf_iterator<char> ( ) );
+    }
+
+    bool writeFile ( const std::string & filename, const std::string & content )
+    {
+        outputfile output ( filename );
+        output.stream ( ) << content;
+        return output.commit ( );
+    }
+}
+
+DEFINE_TEST( WriteIfChanged )
+    const std::string filename ( "outputfile.dat" );
+    std::remove ( filename.c_str ( ) );
+
+    // New files are always written
+    TEST_EQUALS_TRUE( writeFile ( filename, "first version\n" ) );
+    TEST_EQUALS( readFile ( filename ), std::string ( "first version\n" ) );
+
+    // Identical content leaves the file alone
+    TEST_EQUALS_TRUE( ! writeFile ( filename, "first version\n" ) );
+    TEST_EQUALS( readFile ( filename ), std::string ( "first version\n" ) );
+
+    // Changed content of the same size, then of a different size
+    TEST_EQUALS_TRUE( writeFile ( filename, "first versioN\n" ) );
+    TEST_EQUALS( readFile ( filename ), std::string ( "first versioN\n" ) );
+    TEST_EQUALS_TRUE( writeFile ( filename, "second version\n" ) );
+    TEST_EQUALS( readFile ( filename ), std::string ( "second version\n" ) );
+
+    // Empty content is still a valid file
+    TEST_EQUALS_TRUE( writeFile ( filename, "" ) );
+    TEST_EQUALS( readFile ( filename ), std::string ( ) );
+    TEST_EQUALS_TRUE( ! writeFile ( filename, "" ) );
+END_TEST
+
+DEFINE_TEST( UnwritableFile )
+    TEST_THROWS_EXCEPTION( writeFile ( "missing_directory/outputfile.dat", "content" ), std::runtime_error );
+END_TEST
+
+DEFINE_TEST( ContentHash )
+    TEST_EQUALS_TRUE( outputfile::hash ( "", 0 ) == outputfile::s_hashBasis );
+    TEST_EQUALS_TRUE( outputfile::hash ( "abc", 3 ) != outputfile::hash ( "abd", 3 ) );
+
+    // Hashing in chunks matches hashing in one go
+    TEST_EQUALS_TRUE( outputfile::hash ( "c", 1, outputfile::hash ( "ab", 2 ) ) == outputfile::hash ( "abc", 3 ) );
+END_TEST
+
+DEFINE_TEST_SUITE( OutputFile )
+    REGISTER_TEST( WriteIfChanged )
+    REGISTER_TEST( UnwritableFile )
+    REGISTER_TEST( ContentHash )
+END_TEST_SUITE
+
@@ -22,10 +22,25 @@
 #include "astresolver.hpp"
 #include "astextresolver.hpp"
 #include "astaliaser.hpp"
+#include "astcache.hpp"
+#include "astdependencies.hpp"
+#include "astdumper.hpp"
+#include "astfinaliser.hpp"
+#include "astpreparer.hpp"
+#include "cppwriterfactory.hpp"
+#include <cstdio>
+#include <fstream>
 #include <memory>
+#include <sstream>
 
 using namespace fudgeproto;
 
+namespace
+{
+    // A leaked node should fail the tests, not just be reported
+    const arena::leakhandler defaultLeakHandler ( arena::setLeakHandler ( arena::abortOnLeak ) );
+}
+
 DEFINE_TEST( Parsing )
     // Construct the post-parsing processes
     astindex index;
@@ -68,7 +83,7 @@ DEFINE_TEST( Parsing )
     TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
     TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
     TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
-    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 3 );
+    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 4 );
 
     TEST_THROWS_NOTHING( renamer->reset ( ) );
     TEST_THROWS_NOTHING( flattener->reset ( ) );
@@ -87,10 +102,14 @@ DEFINE_TEST( Parsing )
     TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
     TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
     TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
-    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 1 );
+    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 2 );
 END_TEST
 
 DEFINE_TEST( ProcessingFailures )
+    // Nothing may be left behind by the failures
+    arena nodes;
+    arena::scope nodescope ( nodes );
+
     // Construct the post-parsing processes
     astindex index;
     astextrefs extrefs;
@@ -136,16 +155,576 @@ DEFINE_TEST( ProcessingFailures )
     TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
     TEST_THROWS_EXCEPTION( indexer->walk ( root.get ( ) ), std::runtime_error );
 
+    TEST_THROWS_NOTHING( renamer->reset ( ) );
+    TEST_THROWS_NOTHING( flattener->reset ( ) );
+    TEST_THROWS_NOTHING( indexer->reset ( ) );
+
+    // Clashes are reported in name order, not the order messages were read
+    const std::string clashes ( "namespace clash { message Zulu { int a = 1; int a = 2; } message Alpha { int b = 1; int b = 2; } }" );
+    std::vector<std::string> imports;
+    TEST_THROWS_NOTHING( root = parser::parse ( clashes.data ( ), clashes.size ( ), "clash.proto", imports ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    try
+    {
+        indexer->walk ( root.get ( ) );
+        TEST_EQUALS_TRUE( false );
+    }
+    catch ( const std::runtime_error & error )
+    {
+        TEST_EQUALS_TRUE( std::string ( error.what ( ) ).find ( "Alpha" ) != std::string::npos );
+    }
+
     // Field modifiers must not clash
     TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/clashing_modifiers.proto" ), std::runtime_error );
 
     // Field modifiers must be valid
     TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/invalid_modifier.proto" ), std::runtime_error );
 
+    // Field options must be known and applicable to the field
+    TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/invalid_option.proto" ), std::runtime_error );
+    TEST_THROWS_EXCEPTION( root = parser::parse ( "./test_files/invalid_flat_option.proto" ), std::runtime_error );
+
+END_TEST
+
+DEFINE_TEST( Dependencies )
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator mutator;
+    cppwriterfactory factory;
+    filenamegenerator filenamegen ( "out", "hpp", "cpp", true );
+    const std::vector<std::string> inputs ( 1, "./test_files/nested.proto" );
+    std::auto_ptr<astwalker> renamer ( new astrenamer );
+    std::auto_ptr<astflattener> flattener ( new astflattener );
+    std::auto_ptr<astindexer> indexer ( new astindexer ( index ) );
+    std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astaliaser> aliaser ( new astaliaser ( index, mutator ) );
+    std::auto_ptr<astextresolver> extresolver ( new astextresolver ( extrefs, index ) );
+    std::auto_ptr<astdependencies> dependencies ( new astdependencies ( extrefs, index, factory, filenamegen, inputs ) );
+
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs [ 0 ] ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( dependencies->walk ( root.get ( ) ) );
+
+    // Only the non-extern messages produce output files
+    TEST_EQUALS_INT( dependencies->outputs ( ).size ( ), 4 );
+    TEST_EQUALS( dependencies->outputs ( ) [ 0 ], std::string ( "out/built_nestedmessageone.hpp" ) );
+    TEST_EQUALS( dependencies->outputs ( ) [ 1 ], std::string ( "out/built_nestedmessageone.cpp" ) );
+
+    // The extern messages are referenced through their headers
+    TEST_EQUALS_INT( dependencies->externals ( ).size ( ), 2 );
+    TEST_EQUALS_TRUE( dependencies->externals ( ).count ( "out/built_flatmessageone.hpp" ) );
+    TEST_EQUALS_TRUE( dependencies->externals ( ).count ( "out/built_combined_flatmessage.hpp" ) );
+
+    std::ostringstream manifest, depfile;
+    TEST_THROWS_NOTHING( dependencies->writeManifest ( manifest ) );
+    TEST_EQUALS( manifest.str ( ), std::string ( "out/built_nestedmessageone.hpp\n"
+                                                 "out/built_nestedmessageone.cpp\n"
+                                                 "out/built_complex_nestedmessagetwo.hpp\n"
+                                                 "out/built_complex_nestedmessagetwo.cpp\n" ) );
+    TEST_THROWS_NOTHING( dependencies->writeDepfile ( depfile ) );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_complex_nestedmessagetwo.cpp: ./test_files/nested.proto\n" ) != std::string::npos );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "\nout/built_flatmessageone.hpp:\n" ) != std::string::npos );
+
+    TEST_THROWS_NOTHING( dependencies->reset ( ) );
+    TEST_EQUALS_TRUE( dependencies->outputs ( ).empty ( ) );
+END_TEST
+
+DEFINE_TEST( Amalgamation )
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator mutator;
+    cppwriterfactory factory;
+    filenamegenerator filenamegen ( "out", "hpp", "cpp", true );
+    filenamegen.setAmalgamation ( "" );
+    const std::vector<std::string> inputs ( 1, "./test_files/nested.proto" );
+    std::auto_ptr<astwalker> renamer ( new astrenamer );
+    std::auto_ptr<astflattener> flattener ( new astflattener );
+    std::auto_ptr<astindexer> indexer ( new astindexer ( index ) );
+    std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astaliaser> aliaser ( new astaliaser ( index, mutator ) );
+    std::auto_ptr<astextresolver> extresolver ( new astextresolver ( extrefs, index ) );
+    std::auto_ptr<astdependencies> dependencies ( new astdependencies ( extrefs, index, factory, filenamegen, inputs ) );
+
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs [ 0 ] ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( dependencies->walk ( root.get ( ) ) );
+
+    // Headers are still per message, implementations are per namespace
+    std::ostringstream manifest, depfile;
+    TEST_THROWS_NOTHING( dependencies->writeManifest ( manifest ) );
+    TEST_EQUALS( manifest.str ( ), std::string ( "out/built_nestedmessageone.hpp\n"
+                                                 "out/built_complex_nestedmessagetwo.hpp\n"
+                                                 "out/built_complex_amalgamated.cpp\n"
+                                                 "out/built_amalgamated.cpp\n" ) );
+    TEST_THROWS_NOTHING( dependencies->writeDepfile ( depfile ) );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_amalgamated.cpp: ./test_files/nested.proto\n" ) != std::string::npos );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_amalgamated.cpp: | out/built_combined_flatmessage.hpp out/built_flatmessageone.hpp\n" ) != std::string::npos );
+
+    // A named amalgamation holds every message
+    refptr<const definition> message ( index.find ( "built.Complex.NestedMessageTwo" ) );
+    TEST_EQUALS_TRUE( message.istype<messagedef> ( ) );
+    TEST_EQUALS( filenamegen.amalgamation ( dynamic_cast<const messagedef &> ( *message ) ), std::string ( "built_Complex_amalgamated" ) );
+    filenamegen.setAmalgamation ( "everything" );
+    TEST_EQUALS( filenamegen.amalgamation ( dynamic_cast<const messagedef &> ( *message ) ), std::string ( "everything" ) );
+    TEST_THROWS_NOTHING( dependencies->reset ( ) );
+    TEST_THROWS_NOTHING( dependencies->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( dependencies->outputs ( ).size ( ), 3 );
+    TEST_EQUALS( dependencies->outputs ( ) [ 2 ], std::string ( "out/everything.cpp" ) );
+END_TEST
+
+DEFINE_TEST( MultipleFiles )
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator mutator;
+    cppwriterfactory factory;
+    filenamegenerator filenamegen ( "out", "hpp", "cpp", true );
+    std::vector<std::string> inputs;
+    inputs.push_back ( "./test_files/nested.proto" );
+    inputs.push_back ( "./test_files/flat.proto" );
+    inputs.push_back ( "./test_files/nested.proto" );
+    std::auto_ptr<astwalker> renamer ( new astrenamer );
+    std::auto_ptr<astflattener> flattener ( new astflattener );
+    std::auto_ptr<astindexer> indexer ( new astindexer ( index ) );
+    std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astaliaser> aliaser ( new astaliaser ( index, mutator ) );
+    std::auto_ptr<astextresolver> extresolver ( new astextresolver ( extrefs, index ) );
+    std::auto_ptr<astdependencies> dependencies ( new astdependencies ( extrefs, index, factory, filenamegen, inputs ) );
+
+    // Each file is only parsed once and the externs are replaced by the definitions
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( index.numEnums ( ), 1 );
+    TEST_EQUALS_INT( index.numMessages ( ), 5 );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 5 );
+
+    refptr<const definition> message ( index.find ( "built.Combined.FlatMessage" ) );
+    TEST_EQUALS_TRUE( message.istype<messagedef> ( ) );
+    TEST_EQUALS_TRUE( ! dynamic_cast<const messagedef &> ( *message ).isExtern ( ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).sourceFile ( ), inputs [ 1 ] );
+    message = index.find ( "built.NestedMessageOne" );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).sourceFile ( ), inputs [ 0 ] );
+
+    // Outputs depend on the files defining the messages they reference
+    TEST_THROWS_NOTHING( dependencies->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( dependencies->outputs ( ).size ( ), 10 );
+    TEST_EQUALS_TRUE( dependencies->externals ( ).empty ( ) );
+
+    std::ostringstream depfile;
+    TEST_THROWS_NOTHING( dependencies->writeDepfile ( depfile ) );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_nestedmessageone.cpp: ./test_files/flat.proto ./test_files/nested.proto\n" ) != std::string::npos );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_flatmessageone.cpp: ./test_files/flat.proto\n" ) != std::string::npos );
+
+    // Every file must exist
+    inputs.push_back ( "./test_files/missing_file.proto" );
+    TEST_THROWS_EXCEPTION( root = parser::parse ( inputs ), std::runtime_error );
+END_TEST
+
+DEFINE_TEST( Imports )
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator mutator;
+    cppwriterfactory factory;
+    filenamegenerator filenamegen ( "out", "hpp", "cpp", true );
+    std::vector<std::string> inputs ( 1, "./test_files/imports.proto" );
+    std::auto_ptr<astwalker> renamer ( new astrenamer );
+    std::auto_ptr<astflattener> flattener ( new astflattener );
+    std::auto_ptr<astindexer> indexer ( new astindexer ( index ) );
+    std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astaliaser> aliaser ( new astaliaser ( index, mutator ) );
+    std::auto_ptr<astextresolver> extresolver ( new astextresolver ( extrefs, index ) );
+    std::auto_ptr<astdependencies> dependencies ( new astdependencies ( extrefs, index, factory, filenamegen, inputs ) );
+
+    // Imported messages are available as externs
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( index.numEnums ( ), 0 );
+    TEST_EQUALS_INT( index.numMessages ( ), 4 );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
+
+    refptr<const definition> message ( index.find ( "built.FlatMessageOne" ) );
+    TEST_EQUALS_TRUE( message.istype<messagedef> ( ) );
+    TEST_EQUALS_TRUE( dynamic_cast<const messagedef &> ( *message ).isExtern ( ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).sourceFile ( ), std::string ( "./test_files/flat.proto" ) );
+
+    // Generated code depends on the imported file, and includes its headers
+    TEST_THROWS_NOTHING( dependencies->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( dependencies->outputs ( ).size ( ), 2 );
+    TEST_EQUALS_INT( dependencies->externals ( ).size ( ), 2 );
+    std::ostringstream depfile;
+    TEST_THROWS_NOTHING( dependencies->writeDepfile ( depfile ) );
+    TEST_EQUALS_TRUE( depfile.str ( ).find ( "out/built_importingmessage.cpp: ./test_files/flat.proto ./test_files/imports.proto\n" ) != std::string::npos );
+
+    TEST_THROWS_NOTHING( renamer->reset ( ) );
+    TEST_THROWS_NOTHING( flattener->reset ( ) );
+    TEST_THROWS_NOTHING( indexer->reset ( ) );
+    TEST_THROWS_NOTHING( resolver->reset ( ) );
+    TEST_THROWS_NOTHING( aliaser->reset ( ) );
+    TEST_THROWS_NOTHING( extresolver->reset ( ) );
+
+    // If the imported file is also an input its definitions replace the stubs
+    inputs.push_back ( "./test_files/flat.proto" );
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs ) );
+    TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+    TEST_EQUALS_INT( index.numEnums ( ), 1 );
+    TEST_EQUALS_INT( index.numMessages ( ), 4 );
+    message = index.find ( "built.FlatMessageOne" );
+    TEST_EQUALS_TRUE( ! dynamic_cast<const messagedef &> ( *message ).isExtern ( ) );
+END_TEST
+
+DEFINE_TEST( Buffers )
+    // Buffers don't need to be null terminated and string literals aren't limited in length
+    const std::string literal ( 4096, 'x' );
+    const std::string source ( "import \"" + literal + "\";\n"
+                               "namespace buffer {\n"
+                               "    message One { int value = 1; }\n"
+                               "    message Two { One one = 1; }\n"
+                               "}\n"
+                               "trailing garbage" );
+    std::vector<std::string> imports;
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( source.data ( ), source.size ( ) - 16, "buffer.proto", imports ) );
+    TEST_EQUALS_INT( root->content ( ).size ( ), 1 );
+    TEST_EQUALS_INT( imports.size ( ), 1 );
+    TEST_EQUALS( imports [ 0 ], literal );
+
+    const namespacedef & ns ( dynamic_cast<const namespacedef &> ( *root->content ( ).front ( ) ) );
+    TEST_EQUALS_INT( ns.content ( ).size ( ), 2 );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *ns.content ( ).back ( ) ).sourceFile ( ), std::string ( "buffer.proto" ) );
+
+    // Errors report the name and line
+    try
+    {
+        parser::parse ( source.data ( ), source.size ( ), "buffer.proto", imports );
+        TEST_EQUALS_TRUE( false );
+    }
+    catch ( const std::runtime_error & error )
+    {
+        TEST_EQUALS_TRUE( std::string ( error.what ( ) ).find ( "Error in \"buffer.proto\" at line 6" ) == 0 );
+    }
+
+    // Parsing several files at once gives the same result, and the same error, as one at a time
+    std::vector<std::string> inputs;
+    inputs.push_back ( "./test_files/flat.proto" );
+    inputs.push_back ( "./test_files/nested.proto" );
+    inputs.push_back ( "./test_files/imports.proto" );
+    inputs.push_back ( "./test_files/array.proto" );
+    refptr<namespacedef> serial;
+    TEST_THROWS_NOTHING( serial = parser::parse ( inputs ) );
+    TEST_THROWS_NOTHING( root = parser::parse ( inputs, 4 ) );
+    TEST_EQUALS_INT( root->content ( ).size ( ), serial->content ( ).size ( ) );
+
+    inputs.push_back ( "./test_files/invalid_modifier.proto" );
+    inputs.push_back ( "./test_files/missing_file.proto" );
+    std::string serialError, parallelError;
+    try { parser::parse ( inputs ); } catch ( const std::runtime_error & error ) { serialError = error.what ( ); }
+    try { parser::parse ( inputs, 4 ); } catch ( const std::runtime_error & error ) { parallelError = error.what ( ); }
+    TEST_EQUALS_TRUE( ! serialError.empty ( ) );
+    TEST_EQUALS( parallelError, serialError );
+END_TEST
+
+DEFINE_TEST( ExternalReferences )
+    // A -> B -> C <-> D -> E, with F referring to itself
+    astextrefs::stringsetmap refs;
+    refs [ "A" ].insert ( "B" );
+    refs [ "B" ].insert ( "C" );
+    refs [ "C" ].insert ( "D" );
+    refs [ "D" ].insert ( "C" );
+    refs [ "D" ].insert ( "E" );
+    refs [ "F" ].insert ( "F" );
+
+    astextrefs extrefs;
+    TEST_THROWS_NOTHING( extrefs.load ( refs ) );
+    TEST_EQUALS_INT( extrefs.allrefs ( ).size ( ), 6 );
+
+    astextrefs::stringset result;
+    extrefs.findAllrefs ( result, "A" );
+    TEST_EQUALS_INT( result.size ( ), 4 );
+    TEST_EQUALS_TRUE( result.count ( "E" ) );
+    extrefs.findAllrefs ( result, "C" );
+    TEST_EQUALS_INT( result.size ( ), 2 );
+    TEST_EQUALS_TRUE( result.count ( "D" ) && result.count ( "E" ) );
+    extrefs.findAllrefs ( result, "F" );
+    TEST_EQUALS_TRUE( result.empty ( ) );
+    extrefs.findAllrefs ( result, "E" );
+    TEST_EQUALS_TRUE( result.empty ( ) );
+
+    // Reverse dependencies are transitive too
+    extrefs.findDependents ( result, "E" );
+    TEST_EQUALS_INT( result.size ( ), 4 );
+    TEST_EQUALS_TRUE( ! result.count ( "E" ) );
+    extrefs.findDependents ( result, "C" );
+    TEST_EQUALS_INT( result.size ( ), 3 );
+    TEST_EQUALS_TRUE( result.count ( "A" ) && result.count ( "B" ) && result.count ( "D" ) );
+    extrefs.findDependents ( result, "A" );
+    TEST_EQUALS_TRUE( result.empty ( ) );
+END_TEST
+
+DEFINE_TEST( FusedStages )
+    // The fused stages must leave the tree, index and references exactly as
+    // the separate stages do
+    const char * files [ ] = { "./test_files/flat.proto",
+                               "./test_files/nested.proto",
+                               "./test_files/deep_inheritance.proto",
+                               "./test_files/optional_objects.proto",
+                               "./test_files/field_notclash.proto" };
+    for ( size_t file ( 0 ); file < sizeof ( files ) / sizeof ( files [ 0 ] ); ++file )
+    {
+        astindex index, fusedIndex;
+        astextrefs extrefs, fusedExtrefs;
+        identifiermutator mutator;
+        std::auto_ptr<astwalker> renamer ( new astrenamer );
+        std::auto_ptr<astflattener> flattener ( new astflattener );
+        std::auto_ptr<astindexer> indexer ( new astindexer ( index ) );
+        std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+        std::auto_ptr<astaliaser> aliaser ( new astaliaser ( index, mutator ) );
+        std::auto_ptr<astextresolver> extresolver ( new astextresolver ( extrefs, index ) );
+        std::auto_ptr<astwalker> preparer ( new astpreparer ( fusedIndex ) );
+        std::auto_ptr<astresolver> fusedResolver ( new astresolver ( fusedIndex ) );
+        std::auto_ptr<astwalker> finaliser ( new astfinaliser ( fusedExtrefs, fusedIndex, mutator ) );
+
+        refptr<namespacedef> root, fusedRoot;
+        TEST_THROWS_NOTHING( root = parser::parse ( files [ file ] ) );
+        TEST_THROWS_NOTHING( fusedRoot = parser::parse ( files [ file ] ) );
+
+        TEST_THROWS_NOTHING( renamer->walk ( root.get ( ) ) );
+        TEST_THROWS_NOTHING( flattener->walk ( root.get ( ) ) );
+        TEST_THROWS_NOTHING( indexer->walk ( root.get ( ) ) );
+        TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+        TEST_THROWS_NOTHING( aliaser->walk ( root.get ( ) ) );
+        TEST_THROWS_NOTHING( extresolver->walk ( root.get ( ) ) );
+
+        TEST_THROWS_NOTHING( preparer->walk ( fusedRoot.get ( ) ) );
+        TEST_THROWS_NOTHING( fusedResolver->walk ( fusedRoot.get ( ) ) );
+        TEST_THROWS_NOTHING( finaliser->walk ( fusedRoot.get ( ) ) );
+
+        TEST_EQUALS_INT( fusedIndex.numEnums ( ), index.numEnums ( ) );
+        TEST_EQUALS_INT( fusedIndex.numMessages ( ), index.numMessages ( ) );
+        TEST_EQUALS_TRUE( fusedExtrefs.allrefs ( ) == extrefs.allrefs ( ) );
+
+        std::ostringstream dump, fusedDump;
+        astdumper dumper ( dump ), fusedDumper ( fusedDump );
+        static_cast<astwalker &> ( dumper ).walk ( root.get ( ) );
+        static_cast<astwalker &> ( fusedDumper ).walk ( fusedRoot.get ( ) );
+        TEST_EQUALS( fusedDump.str ( ), dump.str ( ) );
+    }
+
+    // Name clashes are still caught
+    astindex index;
+    std::auto_ptr<astwalker> preparer ( new astpreparer ( index ) );
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( "./test_files/field_clash.proto" ) );
+    TEST_THROWS_EXCEPTION( preparer->walk ( root.get ( ) ), std::runtime_error );
+END_TEST
+
+DEFINE_TEST( AliasRestore )
+    // Restoring the names after aliasing leaves the tree as it was resolved,
+    // so it can be aliased again for another output
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator first, second;
+    refptr<identifier> from ( identifier::createFromString ( "built", "." ) ),
+                       to ( identifier::createFromString ( "first", "." ) );
+    first.add ( *from, *to );
+    second.add ( *( to = identifier::createFromString ( "second", "." ) ) );
+    std::auto_ptr<astwalker> preparer ( new astpreparer ( index ) );
+    std::auto_ptr<astresolver> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astfinaliser> finaliser ( new astfinaliser ( extrefs, index, first ) );
+    std::auto_ptr<astfinaliser> refinaliser ( new astfinaliser ( extrefs, index, second ) );
+
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( "./test_files/deep_inheritance.proto" ) );
+    TEST_THROWS_NOTHING( preparer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+
+    std::ostringstream resolved, restored;
+    astdumper dumper ( resolved ), redumper ( restored );
+    static_cast<astwalker &> ( dumper ).walk ( root.get ( ) );
+
+    TEST_THROWS_NOTHING( finaliser->walk ( root.get ( ) ) );
+    refptr<const definition> message ( index.find ( "first.TopMessage" ) );
+    TEST_EQUALS_TRUE( message.istype<messagedef> ( ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).parents ( ) [ 0 ]->dotted ( ), std::string ( "first.IntermediateMessage" ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).originalIdString ( ), std::string ( "built.TopMessage" ) );
+
+    TEST_THROWS_NOTHING( finaliser->restore ( ) );
+    TEST_EQUALS_TRUE( ! index.find ( "first.TopMessage" ) );
+    static_cast<astwalker &> ( redumper ).walk ( root.get ( ) );
+    TEST_EQUALS( restored.str ( ), resolved.str ( ) );
+
+    TEST_THROWS_NOTHING( refinaliser->walk ( root.get ( ) ) );
+    message = index.find ( "second.built.TopMessage" );
+    TEST_EQUALS_TRUE( message.istype<messagedef> ( ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).parents ( ) [ 0 ]->dotted ( ), std::string ( "second.built.IntermediateMessage" ) );
+    TEST_EQUALS( dynamic_cast<const messagedef &> ( *message ).originalIdString ( ), std::string ( "built.TopMessage" ) );
+    TEST_EQUALS_TRUE( extrefs.allrefs ( ).count ( "second.built.TopMessage" ) );
+END_TEST
+
+DEFINE_TEST( ParseCache )
+    const std::string filename ( "parsecache.proto" );
+    {
+        std::ofstream output ( filename.c_str ( ) );
+        output << "namespace cached { message One { int value = 1; } }" << std::endl;
+    }
+
+    // Cached files are not parsed again, each parse gets its own copy of them
+    parsecache cache;
+    const std::vector<std::string> inputs ( 1, filename );
+    refptr<namespacedef> first, second;
+    TEST_THROWS_NOTHING( first = parser::parse ( inputs, 1, &cache ) );
+    TEST_EQUALS_INT( cache.files ( ).size ( ), 1 );
+    const namespacedef * cached ( cache.files ( ) [ filename ].root.get ( ) );
+    TEST_THROWS_NOTHING( second = parser::parse ( inputs, 1, &cache ) );
+    TEST_EQUALS_TRUE( cache.files ( ) [ filename ].root.get ( ) == cached );
+    TEST_EQUALS_INT( first->content ( ).size ( ), 1 );
+    TEST_EQUALS_TRUE( first->content ( ).front ( ) != second->content ( ).front ( ) );
+    TEST_EQUALS_TRUE( first->content ( ).front ( ) != cached->content ( ).front ( ) );
+
+    // Processing a copy leaves the cached tree alone
+    astindex index;
+    std::auto_ptr<astwalker> preparer ( new astpreparer ( index ) );
+    TEST_THROWS_NOTHING( preparer->walk ( first.get ( ) ) );
+    TEST_EQUALS_INT( index.numMessages ( ), 1 );
+    TEST_EQUALS( first->content ( ).front ( )->idString ( ), std::string ( "cached.One" ) );
+    TEST_EQUALS( cached->content ( ).front ( )->idString ( ), std::string ( "cached" ) );
+
+    // Unchanged files are kept, changed ones are dropped and parsed again
+    std::set<std::string> changed;
+    cache.invalidate ( changed );
+    TEST_EQUALS_TRUE( changed.empty ( ) );
+    {
+        std::ofstream output ( filename.c_str ( ) );
+        output << "namespace cached { message One { int value = 1; } message Two { One one = 1; } }" << std::endl;
+    }
+    cache.invalidate ( changed );
+    TEST_EQUALS_INT( changed.size ( ), 1 );
+    TEST_EQUALS_INT( cache.files ( ).size ( ), 0 );
+    TEST_THROWS_NOTHING( first = parser::parse ( inputs, 1, &cache ) );
+    TEST_EQUALS_INT( dynamic_cast<const namespacedef &> ( *first->content ( ).front ( ) ).content ( ).size ( ), 2 );
+
+    // An edit that keeps the size, made straight away, is still seen
+    changed.clear ( );
+    {
+        std::ofstream output ( filename.c_str ( ) );
+        output << "namespace cached { message One { int value = 1; } message Six { One one = 1; } }" << std::endl;
+    }
+    cache.invalidate ( changed );
+    TEST_EQUALS_INT( changed.size ( ), 1 );
+    TEST_EQUALS_INT( cache.files ( ).size ( ), 0 );
+
+    std::remove ( filename.c_str ( ) );
+END_TEST
+
+DEFINE_TEST( AstCache )
+    const std::string filename ( "astcache.proto" ), cachename ( "astcache.cache" );
+    {
+        std::ofstream output ( filename.c_str ( ) );
+        output << "namespace cached {" << std::endl
+               << "  message Base { enum Kind { A; B = 5; } required string name = 1 [default=\"x\"]; }" << std::endl
+               << "  message Derived extends Base { Base.Kind kind = 2; double[] values; message Inner { Base base; } Inner inner; }" << std::endl
+               << "  extern message Remote;" << std::endl
+               << "  message User { Remote remote; optional bool flag [default=true]; }" << std::endl
+               << "}" << std::endl;
+    }
+
+    // Resolve the file as a normal run would, then write the cache
+    parsecache files;
+    astindex index;
+    astextrefs extrefs;
+    identifiermutator mutator;
+    refptr<namespacedef> root;
+    TEST_THROWS_NOTHING( root = parser::parse ( std::vector<std::string> ( 1, filename ), 1, &files ) );
+    std::auto_ptr<astwalker> preparer ( new astpreparer ( index ) );
+    std::auto_ptr<astwalker> resolver ( new astresolver ( index ) );
+    std::auto_ptr<astwalker> finaliser ( new astfinaliser ( extrefs, index, mutator ) );
+    TEST_THROWS_NOTHING( preparer->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( resolver->walk ( root.get ( ) ) );
+    TEST_THROWS_NOTHING( finaliser->walk ( root.get ( ) ) );
+
+    astcache cache ( cachename, "options" );
+    std::auto_ptr<astwalker> writer ( new astcachewriter ( cache, index, files ) );
+    TEST_THROWS_NOTHING( writer->walk ( root.get ( ) ) );
+
+    // The loaded tree and index match, and give the same external references
+    astindex loadedIndex;
+    astextrefs loadedExtrefs;
+    refptr<namespacedef> loaded;
+    astcache reader ( cachename, "options" );
+    TEST_EQUALS_TRUE( reader.load ( loaded, loadedIndex ) );
+    TEST_EQUALS_INT( reader.files ( ).size ( ), 1 );
+    TEST_EQUALS( reader.files ( ).front ( ), filename );
+    TEST_EQUALS_INT( loadedIndex.numEnums ( ), index.numEnums ( ) );
+    TEST_EQUALS_INT( loadedIndex.numMessages ( ), index.numMessages ( ) );
+    std::auto_ptr<astwalker> extresolver ( new astextresolver ( loadedExtrefs, loadedIndex ) );
+    TEST_THROWS_NOTHING( extresolver->walk ( loaded.get ( ) ) );
+    TEST_EQUALS_TRUE( loadedExtrefs.allrefs ( ) == extrefs.allrefs ( ) );
+
+    std::ostringstream dump, loadedDump;
+    astdumper dumper ( dump ), loadedDumper ( loadedDump );
+    static_cast<astwalker &> ( dumper ).walk ( root.get ( ) );
+    static_cast<astwalker &> ( loadedDumper ).walk ( loaded.get ( ) );
+    TEST_EQUALS( loadedDump.str ( ), dump.str ( ) );
+
+    // Different options, a changed input or a damaged cache are all misses
+    astindex missIndex;
+    refptr<namespacedef> miss;
+    astcache other ( cachename, "other options" );
+    TEST_EQUALS_TRUE( ! other.load ( miss, missIndex ) );
+    {
+        std::ofstream output ( cachename.c_str ( ), std::ios::app );
+        output << "trailing";
+    }
+    TEST_EQUALS_TRUE( ! reader.load ( miss, missIndex ) );
+    TEST_THROWS_NOTHING( writer->walk ( root.get ( ) ) );
+    TEST_EQUALS_TRUE( reader.load ( miss, missIndex ) );
+    {
+        std::ofstream output ( filename.c_str ( ), std::ios::app );
+        output << "namespace cached { message Extra { } }" << std::endl;
+    }
+    TEST_EQUALS_TRUE( ! reader.load ( miss, missIndex ) );
+    std::remove ( cachename.c_str ( ) );
+    TEST_EQUALS_TRUE( ! reader.load ( miss, missIndex ) );
+
+    std::remove ( filename.c_str ( ) );
 END_TEST
 
 DEFINE_TEST_SUITE( Parser )
     REGISTER_TEST( Parsing )
     REGISTER_TEST( ProcessingFailures )
+    REGISTER_TEST( Dependencies )
+    REGISTER_TEST( Amalgamation )
+    REGISTER_TEST( MultipleFiles )
+    REGISTER_TEST( Imports )
+    REGISTER_TEST( Buffers )
+    REGISTER_TEST( ExternalReferences )
+    REGISTER_TEST( FusedStages )
+    REGISTER_TEST( AliasRestore )
+    REGISTER_TEST( ParseCache )
+    REGISTER_TEST( AstCache )
 END_TEST_SUITE
 
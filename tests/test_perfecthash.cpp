@@ -0,0 +1,83 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "perfecthash.hpp"
+#include "simpletest.hpp"
+#include <sstream>
+#include <stdexcept>
+
+using namespace fudgeproto;
+
+DEFINE_TEST( SmallKeySets )
+    std::vector<std::string> keys;
+    keys.push_back ( "built.FlatMessageOne" );
+
+    perfecthash single ( keys );
+    TEST_EQUALS_INT( single.size ( ), 1 );
+    TEST_EQUALS_INT( single.find ( "built.FlatMessageOne" ), 0 );
+    TEST_EQUALS_TRUE( single.find ( "built.FlatMessageTwo" ) == perfecthash::npos );
+    TEST_EQUALS_TRUE( single.find ( "" ) == perfecthash::npos );
+
+    keys.push_back ( "built.FlatMessageTwo" );
+    keys.push_back ( "built.Combined.FlatMessage" );
+
+    perfecthash three ( keys );
+    for ( size_t index ( 0 ); index < keys.size ( ); ++index )
+        TEST_EQUALS_INT( three.find ( keys [ index ] ), index );
+    TEST_EQUALS_TRUE( three.find ( "built.Combined" ) == perfecthash::npos );
+END_TEST
+
+DEFINE_TEST( LargeKeySet )
+    std::vector<std::string> keys;
+    for ( size_t index ( 0 ); index < 2000; ++index )
+    {
+        std::ostringstream key;
+        key << "generated.namespace" << index % 7 << ".Message" << index;
+        keys.push_back ( key.str ( ) );
+    }
+
+    perfecthash hash ( keys );
+    TEST_EQUALS_TRUE( hash.size ( ) >= keys.size ( ) );
+    for ( size_t index ( 0 ); index < keys.size ( ); ++index )
+        TEST_EQUALS_INT( hash.find ( keys [ index ] ), index );
+    TEST_EQUALS_TRUE( hash.find ( "generated.namespace0.Message2000" ) == perfecthash::npos );
+END_TEST
+
+DEFINE_TEST( InvalidKeySets )
+    std::vector<std::string> keys;
+    TEST_THROWS_EXCEPTION( perfecthash hash ( keys ), std::invalid_argument );
+
+    keys.push_back ( "duplicate" );
+    keys.push_back ( "unique" );
+    keys.push_back ( "duplicate" );
+    TEST_THROWS_EXCEPTION( perfecthash hash ( keys ), std::invalid_argument );
+END_TEST
+
+DEFINE_TEST( StableHash )
+    // Generated code embeds this function, so its output must never change
+    TEST_EQUALS_TRUE( perfecthash::hash ( "", 0, 0 ) == 2872998923u );
+    TEST_EQUALS_TRUE( perfecthash::hash ( "built.FlatMessageOne", 20, 0 ) == 3343536985u );
+    TEST_EQUALS_TRUE( perfecthash::hash ( "abc", 3, 0 ) != perfecthash::hash ( "abc", 3, 1 ) );
+    TEST_EQUALS_TRUE( perfecthash::hash ( "abc", 3, 0 ) != perfecthash::hash ( "abd", 3, 0 ) );
+END_TEST
+
+DEFINE_TEST_SUITE( PerfectHash )
+    REGISTER_TEST( SmallKeySets )
+    REGISTER_TEST( LargeKeySet )
+    REGISTER_TEST( InvalidKeySets )
+    REGISTER_TEST( StableHash )
+END_TEST_SUITE
+
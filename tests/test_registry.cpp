@@ -0,0 +1,121 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "encoderutils.hpp"
+#include "simpletest.hpp"
+#include "memoryutil.hpp"
+#include "built_flatregistry.hpp"
+#include "built_typeidregistry.hpp"
+
+using namespace fudgeproto;
+using namespace built;
+
+namespace
+{
+    class CountingHandler : public FlatRegistry::Handler
+    {
+        public:
+            CountingHandler ( )
+                : one ( 0 )
+                , combined ( 0 )
+                , identifier ( 0 )
+            {
+            }
+
+            void on ( FlatMessageOne * message )
+            {
+                identifier = message->identifier ( );
+                ++one;
+                delete message;
+            }
+
+            void on ( Combined::FlatMessage * message )
+            {
+                identifier = message->identifier ( );
+                ++combined;
+                delete message;
+            }
+
+            int one, combined;
+            fudge_i32 identifier;
+    };
+}
+
+DEFINE_TEST( TypeLookup )
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::string ( "built.FlatMessageOne" ) ), FlatRegistry::built_FlatMessageOne );
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::string ( "built.FlatMessageTwo" ) ), FlatRegistry::built_FlatMessageTwo );
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::string ( "built.Combined.FlatMessage" ) ), FlatRegistry::built_Combined_FlatMessage );
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::string ( "built.FlatMessage" ) ), FlatRegistry::UnknownType );
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::string ( "" ) ), FlatRegistry::UnknownType );
+
+    TEST_EQUALS( std::string ( FlatRegistry::typeName ( FlatRegistry::built_Combined_FlatMessage ) ),
+                 std::string ( "built.Combined.FlatMessage" ) );
+    TEST_EQUALS_TRUE( FlatRegistry::typeName ( FlatRegistry::UnknownType ) == 0 );
+
+    FlatMessageTwo message;
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( message.asFudgeMessage ( ) ), FlatRegistry::built_FlatMessageTwo );
+    TEST_EQUALS_INT( FlatRegistry::typeOf ( fudge::message ( ) ), FlatRegistry::UnknownType );
+END_TEST
+
+DEFINE_TEST( DecodeAny )
+    CountingHandler handler;
+
+    FlatMessageOne one;
+    one.setidentifier ( 123 );
+    TEST_EQUALS_INT( FlatRegistry::decodeAny ( one.asFudgeMessage ( ), handler ), FlatRegistry::built_FlatMessageOne );
+    TEST_EQUALS_INT( handler.one, 1 );
+    TEST_EQUALS_INT( handler.identifier, 123 );
+
+    // Decoding from bytes, and unhandled types falling back to the default handler
+    Combined::FlatMessage combined;
+    combined.setidentifier ( 456 );
+    combined.setintegers ( std::vector<fudge_i32> ( 4 ) );
+    combined.setmatrix ( std::vector< std::vector<fudge_f32> > ( 2, std::vector<fudge_f32> ( 2 ) ) );
+    std::pair<fudge_byte *, fudge_i32> encoded ( encode ( combined, "registry_combined.dat" ) );
+    TEST_EQUALS_INT( FlatRegistry::decodeAny ( encoded.first, encoded.second, handler ), FlatRegistry::built_Combined_FlatMessage );
+    free ( encoded.first );
+    TEST_EQUALS_INT( handler.combined, 1 );
+    TEST_EQUALS_INT( handler.identifier, 456 );
+
+    FlatMessageTwo two;
+    TEST_EQUALS_INT( FlatRegistry::decodeAny ( two.asFudgeMessage ( ), handler ), FlatRegistry::built_FlatMessageTwo );
+    TEST_EQUALS_INT( handler.one, 1 );
+    TEST_EQUALS_INT( handler.combined, 1 );
+
+    // Unknown type strings aren't dispatched
+    fudge::message unknown;
+    unknown.addField ( fudge::string ( "built.NotAMessage" ), fudge::message::noname, 0 );
+    TEST_EQUALS_INT( FlatRegistry::decodeAny ( unknown, handler ), FlatRegistry::UnknownType );
+END_TEST
+
+DEFINE_TEST( TypeIdNames )
+    // Holder.Inner and Holder_Inner would both be Holder_Inner if the
+    // underscores in names weren't escaped
+    TEST_EQUALS_INT( TypeIdRegistry::typeOf ( fudge::string ( "built.typeids.Holder.Inner" ) ), TypeIdRegistry::built_typeids_Holder_Inner );
+    TEST_EQUALS_INT( TypeIdRegistry::typeOf ( fudge::string ( "built.typeids.Holder_Inner" ) ), TypeIdRegistry::built_typeids_Holder_1Inner );
+    TEST_EQUALS_TRUE( TypeIdRegistry::built_typeids_Holder_Inner != TypeIdRegistry::built_typeids_Holder_1Inner );
+
+    typeids::Holder_Inner message;
+    message.setother ( 7 );
+    TEST_EQUALS_INT( TypeIdRegistry::typeOf ( message.asFudgeMessage ( ) ), TypeIdRegistry::built_typeids_Holder_1Inner );
+END_TEST
+
+DEFINE_TEST_SUITE( Registry )
+    REGISTER_TEST( TypeLookup )
+    REGISTER_TEST( DecodeAny )
+    REGISTER_TEST( TypeIdNames )
+END_TEST_SUITE
+
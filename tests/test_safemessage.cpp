@@ -18,7 +18,9 @@
 #include "simpletest.hpp"
 #include "memoryutil.hpp"
 #include "built_safe_safemessageone.hpp"
+#include "built_safe_safemessagetwo.hpp"
 #include "built_unsafe_safemessageone.hpp"
+#include "built_unsafe_safemessagetwo.hpp"
 #include <fudge-cpp/exception.hpp>
 #include <cstdio>
 
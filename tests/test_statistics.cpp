@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "outputfile.hpp"
+#include "simpletest.hpp"
+#include "statistics.hpp"
+#include <cstdio>
+#include <sstream>
+
+using namespace fudgeproto;
+
+DEFINE_TEST( Timers )
+    // Allocations are counted for every thread and for the calling thread alone
+    statistics::enableCounting ( );
+    const statistics::timer total, thread ( true );
+    for ( int index ( 0 ); index < 3; ++index )
+        statistics::countAllocation ( );
+
+    statistics::record record ( "timed" );
+    total.stop ( record );
+    TEST_EQUALS_INT( record.allocations, 3 );
+    TEST_EQUALS_TRUE( record.seconds >= 0.0 );
+    thread.stop ( record );
+    TEST_EQUALS_INT( record.allocations, 3 );
+    TEST_EQUALS( record.name, std::string ( "timed" ) );
+END_TEST
+
+DEFINE_TEST( Reports )
+    statistics stats;
+    statistics::record stage ( "PARSER STAGE" );
+    stage.allocations = 12;
+    stats.addStage ( stage );
+
+    // Files are reported in name order, however they were added
+    statistics::record file ( "out/second.cpp" );
+    file.bytes = 100;
+    file.written = true;
+    stats.addFile ( file );
+    file.name = "out/\"first\".cpp";
+    file.bytes = 20;
+    file.written = false;
+    stats.addFile ( file );
+
+    statistics::record total;
+    total.seconds = 0.5;
+    stats.setTotal ( total );
+    TEST_EQUALS( stats.total ( ).name, std::string ( "TOTAL" ) );
+
+    std::ostringstream text;
+    stats.write ( text, false );
+    TEST_EQUALS_TRUE( text.str ( ).find ( "PARSER STAGE" ) < text.str ( ).find ( "out/\"first\".cpp (unchanged)" ) );
+    TEST_EQUALS_TRUE( text.str ( ).find ( "out/\"first\".cpp" ) < text.str ( ).find ( "out/second.cpp\n" ) );
+    TEST_EQUALS_TRUE( text.str ( ).find ( "120  TOTAL\n" ) != std::string::npos );
+    TEST_EQUALS_TRUE( text.str ( ).find ( "2 files generated, 1 written\n" ) != std::string::npos );
+
+    std::ostringstream json;
+    stats.write ( json, true );
+    TEST_EQUALS_TRUE( json.str ( ).find ( "{ \"name\": \"PARSER STAGE\", \"seconds\": 0.000000, \"allocations\": 12," ) != std::string::npos );
+    TEST_EQUALS_TRUE( json.str ( ).find ( "\"name\": \"out/\\\"first\\\".cpp\"" ) != std::string::npos );
+    TEST_EQUALS_TRUE( json.str ( ).find ( "\"bytes\": 20, \"written\": false }" ) != std::string::npos );
+    TEST_EQUALS_TRUE( json.str ( ).find ( "\"bytes\": 120, \"files\": 2, \"written\": 1 }" ) != std::string::npos );
+
+    // Writing the report doesn't change the stream's formatting
+    std::ostringstream formatted;
+    stats.write ( formatted, true );
+    formatted << 0.25;
+    TEST_EQUALS_TRUE( formatted.str ( ).find ( "}\n0.25" ) != std::string::npos );
+END_TEST
+
+DEFINE_TEST( OutputFiles )
+    const std::string filename ( "statistics.dat" );
+    std::remove ( filename.c_str ( ) );
+
+    // Files are only reported while a collector is current
+    statistics stats;
+    {
+        outputfile output ( filename );
+        output.stream ( ) << "unreported";
+        TEST_EQUALS_TRUE( output.commit ( ) );
+    }
+    TEST_EQUALS_INT( stats.files ( ).size ( ), 0 );
+
+    statistics::scope statsscope ( stats );
+    TEST_EQUALS_TRUE( statistics::current ( ) == &stats );
+    for ( int index ( 0 ); index < 2; ++index )
+    {
+        outputfile output ( filename );
+        output.stream ( ) << "reported";
+        output.commit ( );
+    }
+    TEST_EQUALS_INT( stats.files ( ).size ( ), 2 );
+    TEST_EQUALS( stats.files ( ) [ 0 ].name, filename );
+    TEST_EQUALS_INT( stats.files ( ) [ 0 ].bytes, 8 );
+    TEST_EQUALS_TRUE( stats.files ( ) [ 0 ].written );
+    TEST_EQUALS_TRUE( ! stats.files ( ) [ 1 ].written );
+
+    std::remove ( filename.c_str ( ) );
+END_TEST
+
+DEFINE_TEST_SUITE( Statistics )
+    REGISTER_TEST( Timers )
+    REGISTER_TEST( Reports )
+    REGISTER_TEST( OutputFiles )
+END_TEST_SUITE
+
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2012 - 2012, Vrai Stacey.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ast.hpp"
+#include "astindex.hpp"
+#include "simpletest.hpp"
+
+using namespace fudgeproto;
+
+DEFINE_TEST( Interning )
+    const symbol first ( symboltable::intern ( "symboltable.first" ) );
+    TEST_EQUALS( *first, std::string ( "symboltable.first" ) );
+    TEST_EQUALS_TRUE( symboltable::intern ( std::string ( "symboltable." ) + "first" ) == first );
+    TEST_EQUALS_TRUE( symboltable::find ( "symboltable.first" ) == first );
+    TEST_EQUALS_TRUE( symboltable::intern ( "symboltable.second" ) != first );
+
+    // Looking up a name doesn't intern it
+    const size_t size ( symboltable::size ( ) );
+    TEST_EQUALS_TRUE( symboltable::find ( "symboltable.missing" ) == 0 );
+    TEST_EQUALS_INT( symboltable::size ( ), size );
+END_TEST
+
+DEFINE_TEST( Identifiers )
+    refptr<identifier> id ( identifier::createFromString ( "first.second.third", "." ) );
+    TEST_EQUALS( id->dotted ( ), std::string ( "first.second.third" ) );
+    TEST_EQUALS( id->scoped ( ), std::string ( "first::second::third" ) );
+    TEST_EQUALS( id->asString ( "_" ), std::string ( "first_second_third" ) );
+    TEST_EQUALS_TRUE( id->key ( ) == symboltable::find ( "first.second.third" ) );
+
+    // The cached forms follow changes to the identifier
+    id->pop ( );
+    id->prepend ( "zero" );
+    TEST_EQUALS( id->asString ( "." ), std::string ( "zero.first.second" ) );
+    TEST_EQUALS( id->asString ( "::" ), std::string ( "zero::first::second" ) );
+
+    refptr<identifier> copy ( id->clone ( ) );
+    TEST_EQUALS_TRUE( copy->equals ( *id ) );
+    TEST_EQUALS_TRUE( copy->key ( ) == id->key ( ) );
+    copy->append ( "third" );
+    TEST_EQUALS_TRUE( ! copy->equals ( *id ) );
+
+    // Names containing the separator are still distinct identifiers
+    refptr<identifier> joined ( identifier::createFromString ( "zero.first->second", "->" ) );
+    TEST_EQUALS_TRUE( joined->key ( ) == id->key ( ) );
+    TEST_EQUALS_TRUE( ! joined->equals ( *id ) );
+END_TEST
+
+DEFINE_TEST( IndexLookup )
+    refptr<identifier> id ( identifier::createFromString ( "index.Message", "." ) );
+    refptr<messagedef> message ( new messagedef ( id.get ( ) ) );
+    astindex::definitionmap types;
+    types [ id->key ( ) ] = message.get ( );
+
+    astindex index;
+    index.load ( types );
+    refptr<const definition> found ( index.find ( "index.Message" ) );
+    TEST_EQUALS_TRUE( found.get ( ) == message.get ( ) );
+    found = index.find ( *id );
+    TEST_EQUALS_TRUE( found.get ( ) == message.get ( ) );
+    found = index.find ( "index.Missing" );
+    TEST_EQUALS_TRUE( found.get ( ) == 0 );
+
+    // Replacing re-keys the definition under its new name
+    const symbol oldid ( id->key ( ) );
+    message->resetIdentifier ( identifier::createFromString ( "index.Renamed", "." ) );
+    refcounted::dec ( &message->id ( ) );
+    TEST_THROWS_NOTHING( index.replace ( oldid, message.get ( ) ) );
+    found = index.find ( "index.Renamed" );
+    TEST_EQUALS_TRUE( found.get ( ) == message.get ( ) );
+    found = index.find ( *id );
+    TEST_EQUALS_TRUE( found.get ( ) == 0 );
+    TEST_THROWS_EXCEPTION( index.replace ( oldid, message.get ( ) ), std::runtime_error );
+END_TEST
+
+namespace
+{
+    void addMessage ( astindex::definitionmap & types, const std::string & name )
+    {
+        refptr<identifier> id ( identifier::createFromString ( name, "." ) );
+        types [ id->key ( ) ] = new messagedef ( id.get ( ) );
+    }
+
+    std::string findScoped ( const astindex & index, const std::string & name, const std::string & scope )
+    {
+        refptr<identifier> id ( identifier::createFromString ( name, "." ) ),
+                           scopeid ( identifier::createFromString ( scope, "." ) );
+        refptr<const definition> result ( index.findScoped ( *id, *scopeid ) );
+        return result.get ( ) ? result->idString ( ) : "";
+    }
+}
+
+DEFINE_TEST( ScopedLookup )
+    astindex::definitionmap types;
+    addMessage ( types, "Type" );
+    addMessage ( types, "scoped.Type" );
+    addMessage ( types, "scoped.inner.Type" );
+    addMessage ( types, "scoped.inner.Outer" );
+    addMessage ( types, "scoped.inner.Outer.Nested" );
+
+    astindex index;
+    index.load ( types );
+    astindex::decrementMap ( types );
+
+    // Absolute names win, then the innermost scope that has the name
+    TEST_EQUALS( findScoped ( index, "Type", "scoped.inner.Outer" ), std::string ( "Type" ) );
+    TEST_EQUALS( findScoped ( index, "inner.Type", "scoped.inner.Outer" ), std::string ( "scoped.inner.Type" ) );
+    TEST_EQUALS( findScoped ( index, "Nested", "scoped.inner.Outer" ), std::string ( "scoped.inner.Outer.Nested" ) );
+    TEST_EQUALS( findScoped ( index, "Outer.Nested", "scoped.Type" ), std::string ( ) );
+    TEST_EQUALS( findScoped ( index, "inner.Outer.Nested", "scoped.Type" ), std::string ( "scoped.inner.Outer.Nested" ) );
+
+    // Scopes without a definition don't resolve, nor do unknown names
+    TEST_EQUALS( findScoped ( index, "inner", "scoped.Type" ), std::string ( ) );
+    TEST_EQUALS( findScoped ( index, "Missing", "scoped.inner.Outer" ), std::string ( ) );
+    TEST_EQUALS( findScoped ( index, "Nested", "unindexed.Scope" ), std::string ( ) );
+
+    // Renamed definitions are found by their new names only
+    refptr<const definition> outer ( index.find ( "scoped.inner.Outer" ) );
+    definition * renamed ( const_cast<definition *> ( outer.get ( ) ) );
+    const symbol oldid ( renamed->id ( ).key ( ) );
+    refptr<identifier> newid ( identifier::createFromString ( "scoped.Renamed", "." ) );
+    renamed->resetIdentifier ( newid.get ( ) );
+    TEST_THROWS_NOTHING( index.replace ( oldid, renamed ) );
+    TEST_EQUALS( findScoped ( index, "Renamed", "scoped.inner.Type" ), std::string ( "scoped.Renamed" ) );
+    TEST_EQUALS( findScoped ( index, "Outer", "scoped.inner.Type" ), std::string ( ) );
+    TEST_EQUALS( findScoped ( index, "Outer.Nested", "scoped.inner.Type" ), std::string ( "scoped.inner.Outer.Nested" ) );
+END_TEST
+
+DEFINE_TEST_SUITE( SymbolTable )
+    REGISTER_TEST( Interning )
+    REGISTER_TEST( Identifiers )
+    REGISTER_TEST( IndexLookup )
+    REGISTER_TEST( ScopedLookup )
+END_TEST_SUITE